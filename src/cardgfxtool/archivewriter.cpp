@@ -0,0 +1,214 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+#include <array>
+#include "contrib/minizip/zip.h"
+
+#include "elib/elib.h"
+#include "archivewriter.h"
+
+// tar files are written through a large stdio buffer, so the archive goes
+// out as a few big sequential writes
+static constexpr size_t TAR_BUFFER_SIZE = 1024 * 1024;
+static constexpr size_t TAR_BLOCK_SIZE  = 512;
+
+//
+// Pick a format from a file name's extension
+//
+bool WCTArchiveWriter::FormatForFilename(const char *filename, Format &fmt)
+{
+    const char *const ext = std::strrchr(filename, '.');
+    if(ext == nullptr)
+        return false;
+
+    if(strcasecmp(ext, ".zip") == 0)
+        fmt = Format::ZIP;
+    else if(strcasecmp(ext, ".tar") == 0)
+        fmt = Format::TAR;
+    else
+        return false;
+    return true;
+}
+
+//
+// Create the archive file
+//
+bool WCTArchiveWriter::Open(const char *filename, Format fmt)
+{
+    Close();
+
+    m_time  = std::time(nullptr);
+    m_error = false;
+
+    if(fmt == Format::ZIP)
+    {
+        m_zip = zipOpen64(filename, APPEND_STATUS_CREATE);
+        return m_zip != nullptr;
+    }
+    else
+    {
+        m_tar = std::fopen(filename, "wb");
+        if(m_tar == nullptr)
+            return false;
+        std::setvbuf(m_tar, nullptr, _IOFBF, TAR_BUFFER_SIZE);
+        return true;
+    }
+}
+
+//
+// Append one file
+//
+bool WCTArchiveWriter::AddFile(const char *name, const void *data, size_t size)
+{
+    bool res = false;
+    if(m_zip != nullptr)
+        res = AddZipFile(name, data, size);
+    else if(m_tar != nullptr)
+        res = AddTarFile(name, data, size);
+
+    if(res == false)
+        m_error = true;
+    return res;
+}
+
+//
+// Add a stored entry to the zip file
+//
+bool WCTArchiveWriter::AddZipFile(const char *name, const void *data, size_t size)
+{
+    zip_fileinfo info {};
+    if(const std::tm *const lt = std::localtime(&m_time); lt != nullptr)
+    {
+        info.tmz_date.tm_sec  = uInt(lt->tm_sec);
+        info.tmz_date.tm_min  = uInt(lt->tm_min);
+        info.tmz_date.tm_hour = uInt(lt->tm_hour);
+        info.tmz_date.tm_mday = uInt(lt->tm_mday);
+        info.tmz_date.tm_mon  = uInt(lt->tm_mon);
+        info.tmz_date.tm_year = uInt(lt->tm_year + 1900);
+    }
+
+    const int zip64 = size >= 0xFFFFFFFFu ? 1 : 0;
+    if(zipOpenNewFileInZip64(m_zip, name, &info, nullptr, 0, nullptr, 0, nullptr, 0, 0, zip64) != ZIP_OK)
+        return false;
+
+    // zipWriteInFileInZip takes a 32-bit length
+    const uint8_t *src = static_cast<const uint8_t *>(data);
+    bool res = true;
+    while(size > 0 && res)
+    {
+        const unsigned int len = unsigned(std::min<size_t>(size, 0x40000000u));
+        res = zipWriteInFileInZip(m_zip, src, len) == ZIP_OK;
+        src  += len;
+        size -= len;
+    }
+
+    return zipCloseFileInZip(m_zip) == ZIP_OK && res;
+}
+
+//
+// Format an octal number into a tar header field, NUL terminated
+//
+static bool PutTarOctal(char *field, size_t fieldlen, uint64_t value)
+{
+    field[fieldlen - 1] = '\0';
+    for(size_t i = fieldlen - 1; i > 0; i--)
+    {
+        field[i - 1] = char('0' + (value & 7));
+        value >>= 3;
+    }
+    return value == 0; // false if it didn't fit
+}
+
+//
+// Add a file to the tar archive, as a ustar header block followed by the
+// data padded out to a whole number of blocks
+//
+bool WCTArchiveWriter::AddTarFile(const char *name, const void *data, size_t size)
+{
+    // ustar header layout
+    constexpr size_t OFFS_NAME   = 0;
+    constexpr size_t LEN_NAME    = 100;
+    constexpr size_t OFFS_MODE   = 100;
+    constexpr size_t OFFS_UID    = 108;
+    constexpr size_t OFFS_GID    = 116;
+    constexpr size_t LEN_ID      = 8;
+    constexpr size_t OFFS_SIZE   = 124;
+    constexpr size_t OFFS_MTIME  = 136;
+    constexpr size_t LEN_NUMBER  = 12;
+    constexpr size_t OFFS_CHKSUM = 148;
+    constexpr size_t LEN_CHKSUM  = 8;
+    constexpr size_t OFFS_TYPE   = 156;
+    constexpr size_t OFFS_MAGIC  = 257;
+
+    const size_t namelen = std::strlen(name);
+    if(namelen == 0 || namelen > LEN_NAME)
+        return false;
+
+    std::array<char, TAR_BLOCK_SIZE> header {};
+    std::memcpy(&header[OFFS_NAME], name, namelen);
+    std::memcpy(&header[OFFS_MODE], "0000644", 8);
+    std::memcpy(&header[OFFS_UID],  "0000000", LEN_ID);
+    std::memcpy(&header[OFFS_GID],  "0000000", LEN_ID);
+    if(PutTarOctal(&header[OFFS_SIZE], LEN_NUMBER, size) == false)
+        return false;
+    PutTarOctal(&header[OFFS_MTIME], LEN_NUMBER, uint64_t(m_time > 0 ? m_time : 0));
+    header[OFFS_TYPE] = '0'; // regular file
+    std::memcpy(&header[OFFS_MAGIC], "ustar\0" "00", 8);
+
+    // checksum is computed with its own field full of spaces, and then
+    // written as six digits, a NUL, and a space
+    std::memset(&header[OFFS_CHKSUM], ' ', LEN_CHKSUM);
+    uint32_t chksum = 0;
+    for(char c : header)
+        chksum += uint8_t(c);
+    PutTarOctal(&header[OFFS_CHKSUM], LEN_CHKSUM - 1, chksum);
+
+    static const std::array<char, TAR_BLOCK_SIZE> zeroes {};
+    const size_t padding = (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+
+    return
+        std::fwrite(header.data(), header.size(), 1, m_tar) == 1 &&
+        (size == 0 || std::fwrite(data, size, 1, m_tar) == 1) &&
+        (padding == 0 || std::fwrite(zeroes.data(), padding, 1, m_tar) == 1);
+}
+
+//
+// Finish the archive
+//
+bool WCTArchiveWriter::Close()
+{
+    if(m_zip != nullptr)
+    {
+        if(zipClose(m_zip, nullptr) != ZIP_OK)
+            m_error = true;
+        m_zip = nullptr;
+    }
+    else if(m_tar != nullptr)
+    {
+        // end of archive is two empty blocks
+        static const std::array<char, TAR_BLOCK_SIZE * 2> zeroes {};
+        if(std::fwrite(zeroes.data(), zeroes.size(), 1, m_tar) != 1)
+            m_error = true;
+        if(std::fclose(m_tar) != 0)
+            m_error = true;
+        m_tar = nullptr;
+    }
+    return m_error == false;
+}
+
+// EOF
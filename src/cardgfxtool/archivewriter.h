@@ -0,0 +1,65 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <ctime>
+
+//
+// Writes a stream of in-memory files into a single zip or tar archive, so
+// that output of many small files costs one file creation instead of one
+// per entry. Zip entries are stored rather than deflated, since the files
+// going into them are PNGs which are already compressed.
+//
+class WCTArchiveWriter final
+{
+public:
+    enum class Format
+    {
+        ZIP,
+        TAR
+    };
+
+    // Pick a format from a file name's extension
+    static bool FormatForFilename(const char *filename, Format &fmt);
+
+    WCTArchiveWriter() = default;
+    ~WCTArchiveWriter() { Close(); }
+
+    WCTArchiveWriter(const WCTArchiveWriter &) = delete;
+    WCTArchiveWriter &operator = (const WCTArchiveWriter &) = delete;
+
+    // Create the archive file
+    bool Open(const char *filename, Format fmt);
+
+    // Append one file
+    bool AddFile(const char *name, const void *data, size_t size);
+
+    // Finish the archive. Returns false if anything failed to be written.
+    bool Close();
+
+private:
+    void       *m_zip   = nullptr; // minizip handle
+    FILE       *m_tar   = nullptr;
+    std::time_t m_time  = 0;       // modification time given to every entry
+    bool        m_error = false;
+
+    bool AddZipFile(const char *name, const void *data, size_t size);
+    bool AddTarFile(const char *name, const void *data, size_t size);
+};
+
+// EOF
@@ -0,0 +1,311 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "png.h"
+
+#include "elib/elib.h"
+#include "elib/misc.h"
+#include "elib/qstring.h"
+#include "cardatlas.h"
+#include "cardgallery.h"
+#include "colorconvert.h"
+#include "pngautorelease.h"
+#include "../common/outbuffer.h"
+#include "../common/parallel.h"
+
+using namespace WCTConstants;
+
+//
+// Layout of one sheet
+//
+struct sheet_t
+{
+    uint32_t first;   // first picture number on the sheet
+    uint32_t count;   // number of pictures on the sheet
+    uint32_t width;   // in pixels
+    uint32_t height;
+    bool     indexed; // all cards share the first card's palette
+    qstring  filename;
+};
+
+//
+// Check whether every card on a sheet has the same palette
+//
+static bool PalettesMatch(const WCTCardGallery &gallery, uint32_t first, uint32_t count)
+{
+    const WCTCardGallery::palette_t &pal = gallery.GetPalette(first);
+    for(uint32_t i = 1; i < count; i++)
+    {
+        if(gallery.GetPalette(first + i) != pal)
+            return false;
+    }
+    return true;
+}
+
+//
+// Copy each card's pixels into its cell on an indexed sheet
+//
+static void ComposeIndexed(const WCTCardGallery &gallery, const sheet_t &sheet, uint32_t columns, unsigned int numthreads, uint8_t *dst)
+{
+    WCTParallel::ForRanges(sheet.count, numthreads, [&] (unsigned int, size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+        {
+            const uint8_t *src  = gallery.GetPixels(sheet.first + uint32_t(i));
+            uint8_t       *cell = dst + (i / columns) * CARDGFX_FULLHEIGHT_PX * sheet.width + (i % columns) * CARDGFX_FULLWIDTH_PX;
+            for(uint32_t y = 0; y < CARDGFX_FULLHEIGHT_PX; y++)
+            {
+                std::memcpy(cell, src, CARDGFX_FULLWIDTH_PX);
+                src  += CARDGFX_FULLWIDTH_PX;
+                cell += sheet.width;
+            }
+        }
+    });
+}
+
+//
+// Translate each card's pixels through its palette into its cell on an RGBA
+// sheet
+//
+static void ComposeRGBA(const WCTCardGallery &gallery, const sheet_t &sheet, uint32_t columns, unsigned int numthreads, uint8_t *dst)
+{
+    constexpr size_t BYTESPP = 4;
+    const size_t pitch = size_t(sheet.width) * BYTESPP;
+
+    WCTParallel::ForRanges(sheet.count, numthreads, [&] (unsigned int, size_t begin, size_t end) {
+        std::array<std::array<uint8_t, BYTESPP>, CARDPALETTE_NUMENTRIES> rgba;
+        for(size_t i = begin; i < end; i++)
+        {
+            const uint32_t picnum = sheet.first + uint32_t(i);
+
+            const WCTCardGallery::palette_t &pal = gallery.GetPalette(picnum);
+            WCTColorConvert::ToRGBA(pal.data(), pal.size(), WCTColorConvert::Expand::REPLICATE, rgba[0].data());
+
+            const uint8_t *src  = gallery.GetPixels(picnum);
+            uint8_t       *cell = dst + (i / columns) * CARDGFX_FULLHEIGHT_PX * pitch + (i % columns) * CARDGFX_FULLWIDTH_PX * BYTESPP;
+            for(uint32_t y = 0; y < CARDGFX_FULLHEIGHT_PX; y++)
+            {
+                for(uint32_t x = 0; x < CARDGFX_FULLWIDTH_PX; x++)
+                    std::memcpy(cell + x * BYTESPP, rgba[src[x] % CARDPALETTE_NUMENTRIES].data(), BYTESPP);
+                src  += CARDGFX_FULLWIDTH_PX;
+                cell += pitch;
+            }
+        }
+    });
+}
+
+//
+// Stream a composed sheet out to a PNG a row at a time
+//
+static bool WriteSheetPNG(const sheet_t &sheet, const uint8_t *image, const WCTCardGallery::palette_t *palette)
+{
+    // open file for output
+    const EAutoFile upFile { std::fopen(sheet.filename.c_str(), "wb") };
+    if(upFile == nullptr)
+        return false;
+
+    // create write struct
+    png_structp pngptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    if(pngptr == nullptr)
+        return false;
+    WCTPNGAutoRelease cRel { pngptr };
+
+    // create png info struct
+    png_infop infoptr = png_create_info_struct(pngptr);
+    if(infoptr == nullptr)
+        return false;
+    cRel.SetInfoPtr(infoptr);
+
+    // translate palette for indexed sheets
+    png_color pngpal[CARDPALETTE_NUMENTRIES];
+    static_assert(sizeof(pngpal) == CARDPALETTE_NUMENTRIES * 3);
+    if(palette != nullptr)
+        WCTColorConvert::ToRGB(palette->data(), CARDPALETTE_NUMENTRIES, WCTColorConvert::Expand::REPLICATE, reinterpret_cast<uint8_t *>(pngpal));
+    const size_t pitch = size_t(sheet.width) * (palette != nullptr ? 1 : 4);
+
+    // setup error handling - no C++ objects in this scope!
+    if(setjmp(png_jmpbuf(pngptr)) == 0)
+    {
+        // init output
+        png_init_io(pngptr, upFile.get());
+
+        // set IHDR information
+        png_set_IHDR(
+            pngptr, infoptr,
+            sheet.width, sheet.height,
+            8,
+            palette != nullptr ? PNG_COLOR_TYPE_PALETTE : PNG_COLOR_TYPE_RGBA,
+            PNG_INTERLACE_NONE,
+            PNG_COMPRESSION_TYPE_DEFAULT,
+            PNG_FILTER_TYPE_DEFAULT
+        );
+
+        // set palette
+        if(palette != nullptr)
+            png_set_PLTE(pngptr, infoptr, pngpal, int(CARDPALETTE_NUMENTRIES));
+
+        // write header info
+        png_write_info(pngptr, infoptr);
+
+        // write image data
+        for(uint32_t y = 0; y < sheet.height; y++)
+            png_write_row(pngptr, image + y * pitch);
+
+        // finish write
+        png_write_end(pngptr, infoptr);
+    }
+    else
+    {
+        return false;
+    }
+
+    // done
+    return true;
+}
+
+//
+// Write the JSON sidecar describing where every card is
+//
+static bool WriteSidecar(const char *filename, const std::vector<sheet_t> &sheets, uint32_t columns)
+{
+    const EAutoFile upFile { std::fopen(filename, "w") };
+    if(upFile == nullptr)
+        return false;
+
+    WCTOutBuffer out { upFile.get() };
+
+    out.Puts("{\n  \"cellWidth\": ");
+    out.PutUint(CARDGFX_FULLWIDTH_PX);
+    out.Puts(",\n  \"cellHeight\": ");
+    out.PutUint(CARDGFX_FULLHEIGHT_PX);
+    out.Puts(",\n  \"sheets\": [");
+    for(size_t s = 0; s < sheets.size(); s++)
+    {
+        const sheet_t &sheet = sheets[s];
+
+        // only the leaf name, as the sidecar sits beside the sheets
+        const char *leaf = sheet.filename.c_str();
+        for(const char *c = leaf; *c != '\0'; c++)
+        {
+            if(*c == '/' || *c == '\\')
+                leaf = c + 1;
+        }
+
+        out.Puts(s == 0 ? "\n    { \"file\": " : ",\n    { \"file\": ");
+        out.PutJSONString(leaf);
+        out.Puts(", \"width\": ");
+        out.PutUint(sheet.width);
+        out.Puts(", \"height\": ");
+        out.PutUint(sheet.height);
+        out.Puts(sheet.indexed ? ", \"format\": \"indexed\" }" : ", \"format\": \"rgba\" }");
+    }
+    out.Puts("\n  ],\n  \"cards\": [");
+    bool firstcard = true;
+    for(size_t s = 0; s < sheets.size(); s++)
+    {
+        const sheet_t &sheet = sheets[s];
+        for(uint32_t i = 0; i < sheet.count; i++)
+        {
+            out.Puts(firstcard ? "\n    { \"card\": " : ",\n    { \"card\": ");
+            out.PutUint(sheet.first + i + 1); // card numbers are 1-based
+            out.Puts(", \"sheet\": ");
+            out.PutUint(uint32_t(s));
+            out.Puts(", \"x\": ");
+            out.PutUint(i % columns * CARDGFX_FULLWIDTH_PX);
+            out.Puts(", \"y\": ");
+            out.PutUint(i / columns * CARDGFX_FULLHEIGHT_PX);
+            out.Puts(", \"w\": ");
+            out.PutUint(CARDGFX_FULLWIDTH_PX);
+            out.Puts(", \"h\": ");
+            out.PutUint(CARDGFX_FULLHEIGHT_PX);
+            out.Puts(" }");
+            firstcard = false;
+        }
+    }
+    out.Puts("\n  ]\n}\n");
+
+    return out.Flush();
+}
+
+//
+// Write the gallery out as atlas sheets plus a JSON sidecar
+//
+bool WCTCardAtlas::Write(const WCTCardGallery &gallery, const char *outdir, const char *basename, const params_t &params)
+{
+    const uint32_t total = gallery.GetCount();
+    if(total == 0 || params.columns == 0)
+        return false;
+
+    const uint32_t percard   = params.sheetCards != 0 ? params.sheetCards : total;
+    const uint32_t numsheets = (total + percard - 1) / percard;
+
+    // lay out the sheets
+    std::vector<sheet_t> sheets(numsheets);
+    for(uint32_t s = 0; s < numsheets; s++)
+    {
+        sheet_t &sheet = sheets[s];
+        sheet.first   = gallery.GetFirst() + s * percard;
+        sheet.count   = std::min(percard, total - s * percard);
+        sheet.width   = std::min(params.columns, sheet.count) * CARDGFX_FULLWIDTH_PX;
+        sheet.height  = (sheet.count + params.columns - 1) / params.columns * CARDGFX_FULLHEIGHT_PX;
+        sheet.indexed = params.mode == Mode::AUTO && PalettesMatch(gallery, sheet.first, sheet.count);
+        if(numsheets == 1)
+            sheet.filename.printf("%s/%s.png", outdir, basename);
+        else
+            sheet.filename.printf("%s/%s_%u.png", outdir, basename, s);
+    }
+
+    // compose and write each sheet in turn, reusing one image buffer
+    bool res = true;
+    std::unique_ptr<uint8_t []> upImage;
+    size_t imagesize = 0;
+    for(const sheet_t &sheet : sheets)
+    {
+        const size_t size = size_t(sheet.width) * sheet.height * (sheet.indexed ? 1 : 4);
+        if(size > imagesize)
+        {
+            upImage.reset(new uint8_t [size]);
+            imagesize = size;
+        }
+        std::memset(upImage.get(), 0, size); // empty cells at the end stay blank
+
+        if(sheet.indexed)
+            ComposeIndexed(gallery, sheet, params.columns, params.numThreads, upImage.get());
+        else
+            ComposeRGBA(gallery, sheet, params.columns, params.numThreads, upImage.get());
+
+        if(WriteSheetPNG(sheet, upImage.get(), sheet.indexed ? &gallery.GetPalette(sheet.first) : nullptr) == false)
+        {
+            std::printf("Warning: failed to write atlas sheet '%s'\n", sheet.filename.c_str());
+            res = false;
+        }
+    }
+
+    qstring sidecar;
+    sidecar.printf("%s/%s.json", outdir, basename);
+    if(WriteSidecar(sidecar.c_str(), sheets, params.columns) == false)
+    {
+        std::printf("Warning: failed to write atlas sidecar '%s'\n", sidecar.c_str());
+        res = false;
+    }
+
+    return res;
+}
+
+// EOF
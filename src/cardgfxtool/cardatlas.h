@@ -0,0 +1,54 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+class WCTCardGallery;
+
+//
+// Card atlases: every picture in a gallery laid out in a grid on one or more
+// sheet images, plus a JSON sidecar giving each card's rectangle.
+//
+// Cards each have their own palette, so sheets are normally RGBA. A sheet
+// whose cards all share one palette is written as an indexed image instead,
+// unless RGBA is forced.
+//
+namespace WCTCardAtlas
+{
+    enum class Mode
+    {
+        AUTO, // indexed when a sheet's palettes all match, otherwise RGBA
+        RGBA  // always RGBA
+    };
+
+    struct params_t
+    {
+        uint32_t     columns    = 32; // cards across each sheet
+        uint32_t     sheetCards = 0;  // cards per sheet, or 0 to put every card on one sheet
+        Mode         mode       = Mode::AUTO;
+        unsigned int numThreads = 0;  // for composing sheets; 0 for one per core
+    };
+
+    //
+    // Write the gallery out as atlas sheets in outdir. With one sheet it is
+    // named <basename>.png, otherwise <basename>_<n>.png counting from 0; the
+    // sidecar is <basename>.json. Returns false if any file can't be written.
+    //
+    bool Write(const WCTCardGallery &gallery, const char *outdir, const char *basename, const params_t &params);
+}
+
+// EOF
@@ -0,0 +1,179 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+
+#include "elib/elib.h"
+#include "cardgallery.h"
+#include "pixelcodec.h"
+#include "../common/parallel.h"
+#include "../common/romfile.h"
+
+static_assert(WCTCardGallery::MAX_PICTURES * WCTConstants::CARDPALETTE_READ_SIZEOF <= WCTConstants::SIZE_ALL_CARDPALETTES_BYTES);
+static_assert(sizeof(WCTCardGallery::palette_t) == WCTConstants::CARDPALETTE_READ_SIZEOF);
+
+//
+// Empty the gallery
+//
+void WCTCardGallery::Clear()
+{
+    m_first = m_count = 0;
+    m_picnums.clear();
+    m_rawdata.clear();
+    m_pixels.clear();
+    m_palettes.clear();
+}
+
+//
+// Decode each thread's share of the pictures read
+//
+void WCTCardGallery::Decode(unsigned int numthreads)
+{
+    using namespace WCTConstants;
+
+    m_pixels.resize(size_t(m_count) * CARDGFX_PIXEL_COUNT);
+    WCTParallel::ForRanges(m_count, numthreads, [this] (unsigned int, size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++)
+            WCTPixelCodec::Unpack6bpp(m_rawdata.data() + i * CARDGFX_READ_SIZEOF, m_pixels.data() + i * CARDGFX_PIXEL_COUNT);
+    });
+}
+
+//
+// Read and decode a range of card pictures
+//
+bool WCTCardGallery::ReadFromROM(FILE *f, uint32_t first, uint32_t count, unsigned int numthreads)
+{
+    using namespace WCTConstants;
+
+    Clear();
+
+    if(f == nullptr || count == 0 || first >= MAX_PICTURES || count > MAX_PICTURES - first)
+        return false;
+
+    // one read for each region
+    m_palettes.resize(count);
+    if(WCTROMFile::GetVectorFromOffset(f, OFFS_CARDPALETTES_START + first * CARDPALETTE_READ_SIZEOF, m_palettes) == false)
+        return false;
+
+    m_rawdata.resize(size_t(count) * CARDGFX_READ_SIZEOF);
+    if(WCTROMFile::GetVectorFromOffset(f, OFFS_CARDGFX_START + first * CARDGFX_READ_SIZEOF, m_rawdata) == false)
+        return false;
+
+    m_first = first;
+    m_count = count;
+    Decode(numthreads);
+    return true;
+}
+
+//
+// Read and decode a selection of card pictures
+//
+bool WCTCardGallery::ReadSelection(FILE *f, std::vector<uint32_t> picnums, unsigned int numthreads)
+{
+    using namespace WCTConstants;
+
+    Clear();
+
+    // sorting by picture number puts them in ROM order in both regions
+    std::sort(picnums.begin(), picnums.end());
+    picnums.erase(std::unique(picnums.begin(), picnums.end()), picnums.end());
+    if(f == nullptr || picnums.empty() || picnums.back() >= MAX_PICTURES)
+        return false;
+
+    const size_t count = picnums.size();
+    m_palettes.resize(count);
+    m_rawdata.resize(count * CARDGFX_READ_SIZEOF);
+
+    // one read per run of consecutive pictures, for each region in turn
+    for(size_t pass = 0; pass < 2; pass++)
+    {
+        for(size_t run = 0, end; run < count; run = end)
+        {
+            for(end = run + 1; end < count && picnums[end] == picnums[end - 1] + 1; end++)
+                ;
+
+            const bool read = pass == 0 ?
+                WCTROMFile::GetArrayFromOffset(f, OFFS_CARDPALETTES_START + picnums[run] * CARDPALETTE_READ_SIZEOF, m_palettes.data() + run, end - run) :
+                WCTROMFile::GetArrayFromOffset(f, OFFS_CARDGFX_START + picnums[run] * CARDGFX_READ_SIZEOF, m_rawdata.data() + run * CARDGFX_READ_SIZEOF, (end - run) * CARDGFX_READ_SIZEOF);
+            if(read == false)
+            {
+                Clear();
+                return false;
+            }
+        }
+    }
+
+    m_first   = picnums.front();
+    m_count   = uint32_t(count);
+    m_picnums = std::move(picnums);
+    Decode(numthreads);
+    return true;
+}
+
+//
+// Find where a picture is held
+//
+size_t WCTCardGallery::IndexOf(uint32_t picnum) const
+{
+    if(m_picnums.empty())
+        return picnum - m_first;
+    return size_t(std::lower_bound(m_picnums.begin(), m_picnums.end(), picnum) - m_picnums.begin());
+}
+
+//
+// Check whether a picture is held
+//
+bool WCTCardGallery::HasPicture(uint32_t picnum) const
+{
+    if(m_picnums.empty())
+        return picnum >= m_first && picnum - m_first < m_count;
+    return std::binary_search(m_picnums.begin(), m_picnums.end(), picnum);
+}
+
+//
+// Get the packed tile data for one picture
+//
+const uint8_t *WCTCardGallery::GetRawData(uint32_t picnum) const
+{
+    return m_rawdata.data() + IndexOf(picnum) * WCTConstants::CARDGFX_READ_SIZEOF;
+}
+
+//
+// Get the decoded pixels for one picture
+//
+const uint8_t *WCTCardGallery::GetPixels(uint32_t picnum) const
+{
+    return m_pixels.data() + IndexOf(picnum) * WCTConstants::CARDGFX_PIXEL_COUNT;
+}
+
+//
+// Get the palette for one picture
+//
+const WCTCardGallery::palette_t &WCTCardGallery::GetPalette(uint32_t picnum) const
+{
+    return m_palettes[IndexOf(picnum)];
+}
+
+//
+// Copy one picture out into a standalone card pic
+//
+void WCTCardGallery::GetCardPic(uint32_t picnum, WCTCardPic &pic) const
+{
+    pic.SetPicture(GetPalette(picnum), GetRawData(picnum), GetPixels(picnum));
+}
+
+// EOF
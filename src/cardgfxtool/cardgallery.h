@@ -0,0 +1,85 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <vector>
+#include "cardpic.h"
+
+//
+// A range of card pictures read out of the ROM in one go. The palette and
+// graphics regions are each read with a single bulk read, and the graphics
+// are decoded in parallel into one contiguous 8bpp buffer, so tools working
+// on many cards don't pay a seek and two reads for each of them.
+//
+// A gallery can also hold a selection of pictures with gaps between them.
+// Those are read in ROM order with one read per run of consecutive pictures,
+// and are stored in picture number order; walk them with GetPicNum.
+//
+// Picture numbers are 0-based, i.e. one less than the card number.
+//
+class WCTCardGallery final
+{
+public:
+    using palette_t = WCTCardPic::palette_t;
+
+    // Number of pictures the ROM's palette and graphics regions have room for
+    static constexpr uint32_t MAX_PICTURES = WCTConstants::SIZE_ALL_CARDGFX_BYTES / WCTConstants::CARDGFX_READ_SIZEOF;
+
+    // Read and decode pictures [first, first + count) using numthreads threads (0 for one per core)
+    bool ReadFromROM(FILE *f, uint32_t first, uint32_t count, unsigned int numthreads = 0);
+
+    // Read and decode a selection of pictures, in any order and possibly
+    // with duplicates
+    bool ReadSelection(FILE *f, std::vector<uint32_t> picnums, unsigned int numthreads = 0);
+
+    uint32_t GetFirst() const { return m_first; }
+    uint32_t GetCount() const { return m_count; }
+    bool HasPicture(uint32_t picnum) const;
+
+    // Picture number of the index'th picture held, counting from 0
+    uint32_t GetPicNum(uint32_t index) const { return m_picnums.empty() ? m_first + index : m_picnums[index]; }
+
+    // Data for one picture, which must be within the range read
+    const uint8_t   *GetRawData(uint32_t picnum) const;
+    const uint8_t   *GetPixels(uint32_t picnum) const;
+    const palette_t &GetPalette(uint32_t picnum) const;
+
+    // Copy one picture out into a standalone card pic
+    void GetCardPic(uint32_t picnum, WCTCardPic &pic) const;
+
+    // Every picture held, back to back
+    const uint8_t *GetAllRawData() const { return m_rawdata.data(); }
+    const uint8_t *GetAllPixels() const { return m_pixels.data(); }
+    const std::vector<palette_t> &GetAllPalettes() const { return m_palettes; }
+
+private:
+    uint32_t m_first = 0;
+    uint32_t m_count = 0;
+
+    std::vector<uint32_t>  m_picnums;  // for a selection, each picture's number in order; empty for a range
+
+    std::vector<uint8_t>   m_rawdata;  // m_count * CARDGFX_READ_SIZEOF bytes of packed tiles
+    std::vector<uint8_t>   m_pixels;   // m_count * CARDGFX_PIXEL_COUNT linear pixels
+    std::vector<palette_t> m_palettes;
+
+    void   Clear();
+    void   Decode(unsigned int numthreads);
+    size_t IndexOf(uint32_t picnum) const;
+};
+
+// EOF
@@ -15,7 +15,18 @@
   along with this program.  If not, see http://www.gnu.org/licenses/
 */
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
 #include <filesystem>
+#include <functional>
+#include <memory>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 #include "elib/elib.h"
 #include "elib/m_argv.h"
@@ -23,11 +34,47 @@
 #include "elib/qstring.h"
 #include "hal/hal_init.h"
 
+#include "../common/cardids.h"
+#include "../common/contenthash.h"
+#include "../common/ctrrng.h"
 #include "../common/numcards.h"
+#include "../common/parallel.h"
 #include "../common/romfile.h"
+#include "archivewriter.h"
+#include "cardatlas.h"
+#include "cardgallery.h"
 #include "cardpic.h"
+#include "colorconvert.h"
+#include "importpipeline.h"
+#include "manifest.h"
+#include "paletteclusters.h"
+#include "pixelcodec.h"
+#include "pngarena.h"
+#include "quantizer.h"
+#include "tileanalysis.h"
+#include "upscale.h"
+
+// Where messages go. With -dump -stdout, stdout carries the frames, so they
+// go to stderr instead.
+static FILE *s_msgfile = stdout;
+
+//
+// Name of the image file for a card, or of its preview upscaled by factor
+//
+static qstring CardImageName(uint32_t cardnum, WCTCardPic::ImageFormat fmt, uint32_t factor = 1)
+{
+    qstring name;
+    if(factor > 1)
+        name.printf("card%04u@%ux%s", cardnum, factor, WCTCardPic::ImageFormatExtension(fmt));
+    else
+        name.printf("card%04u%s", cardnum, WCTCardPic::ImageFormatExtension(fmt));
+    return name;
+}
 
-static bool WriteOneCard(FILE *romfile, uint32_t cardnum, uint32_t numcards, const qstring &outloc)
+static bool WriteOneCard(
+    FILE *romfile, uint32_t cardnum, uint32_t numcards, const qstring &outloc, WCTCardPic::ImageFormat fmt,
+    WCTCardPic::PNGPreset preset, const WCTUpscale::params_t &upscale
+)
 {
     if(cardnum < 1 || cardnum >= numcards)
     {
@@ -46,20 +93,429 @@ static bool WriteOneCard(FILE *romfile, uint32_t cardnum, uint32_t numcards, con
     }
     
     qstring outfn;
-    outfn.printf("%s/card%04u.png", outloc.c_str(), cardnum);
+    outfn.printf("%s/%s", outloc.c_str(), CardImageName(cardnum, fmt).c_str());
 
     // write it
-    return thePic.WriteToPNG(outfn.c_str());
+    if(thePic.WriteImage(outfn.c_str(), fmt, preset) == false)
+        return false;
+
+    // and its preview
+    if(upscale.factor > 1)
+    {
+        std::vector<uint8_t> preview;
+        qstring previewfn;
+        previewfn.printf("%s/%s", outloc.c_str(), CardImageName(cardnum, fmt, upscale.factor).c_str());
+        return
+            thePic.EncodeUpscaledImage(preview, fmt, preset, upscale) &&
+            M_WriteFile(previewfn.c_str(), preview.data(), preview.size()) != 0;
+    }
+    return true;
+}
+
+//
+// Read every card picture in the ROM into a gallery
+//
+static bool ReadAllCards(FILE *romfile, unsigned int numthreads, WCTCardGallery &gallery)
+{
+    const uint32_t numcards = WCTUtils::GetNumCards(romfile);
+    if(numcards < 2)
+    {
+        std::fputs("No cards defined in ROM, or file was unreadable\n\n", s_msgfile);
+        return false;
+    }
+    if(numcards - 1 > WCTCardGallery::MAX_PICTURES)
+    {
+        std::fprintf(s_msgfile, "ROM defines %u cards but only has room for %u pictures\n", numcards, WCTCardGallery::MAX_PICTURES);
+        return false;
+    }
+
+    // cardnums are 1-based but the picture storage is 0-based, and card 0 is a dummy
+    if(gallery.ReadFromROM(romfile, 0, numcards - 1, numthreads) == false)
+    {
+        std::fputs("Could not read in card pictures\n\n", s_msgfile);
+        return false;
+    }
+    return true;
+}
+
+//
+// Parse a list of numbers and inclusive ranges, such as "1-200,350,900-1138".
+// The numbers are read in the given base, as for strtoull, so with base 0
+// they can also be hex such as "0x0FC9-0x0FD0".
+//
+static bool ParseNumberRanges(const char *spec, int base, std::vector<std::pair<uint64_t, uint64_t>> &ranges)
+{
+    ranges.clear();
+    for(const char *p = spec; ; p++)
+    {
+        char *end;
+        if(std::isdigit(static_cast<unsigned char>(*p)) == 0)
+            return false;
+        const uint64_t lo = std::strtoull(p, &end, base);
+        uint64_t       hi = lo;
+        p = end;
+        if(*p == '-')
+        {
+            ++p;
+            if(std::isdigit(static_cast<unsigned char>(*p)) == 0)
+                return false;
+            hi = std::strtoull(p, &end, base);
+            p  = end;
+        }
+        if(hi < lo)
+            return false;
+        ranges.emplace_back(lo, hi);
+
+        if(*p == '\0')
+            return true;
+        if(*p != ',')
+            return false;
+    }
+}
+
+//
+// Read the cards picked by -cards, as a list of card numbers and ranges, and
+// by -ids, as a list of card IDs and ranges, into a gallery. Every card is
+// read if neither is given.
+//
+static bool ReadSelectedCards(FILE *romfile, unsigned int numthreads, WCTCardGallery &gallery)
+{
+    const EArgManager &args = EArgManager::GetGlobalArgs();
+    const char *const *argv = args.getArgv();
+
+    const int cardsarg = args.getArgParameters("-cards", 1);
+    const int idsarg   = args.getArgParameters("-ids", 1);
+    if(cardsarg == 0 && idsarg == 0)
+        return ReadAllCards(romfile, numthreads, gallery);
+
+    const uint32_t numcards = WCTUtils::GetNumCards(romfile);
+    std::vector<uint32_t> picnums;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+
+    if(cardsarg != 0)
+    {
+        if(ParseNumberRanges(argv[cardsarg], 10, ranges) == false)
+        {
+            std::fprintf(s_msgfile, "Invalid card list '%s' (e.g. 1-200,350,900-1138)\n", argv[cardsarg]);
+            return false;
+        }
+        for(const auto &[lo, hi] : ranges)
+        {
+            if(lo < 1 || hi >= numcards)
+            {
+                std::fprintf(s_msgfile, "Invalid card number in '%s' (1 to %u)\n", argv[cardsarg], numcards - 1);
+                return false;
+            }
+            for(uint64_t cardnum = lo; cardnum <= hi; cardnum++)
+                picnums.push_back(uint32_t(cardnum - 1)); // cardnums are 1-based
+        }
+    }
+
+    if(idsarg != 0)
+    {
+        WCTCardIDs ids;
+        if(ids.ReadCardIDs(romfile) == false)
+        {
+            std::fputs("Could not read card IDs from ROM\n\n", s_msgfile);
+            return false;
+        }
+        if(ParseNumberRanges(argv[idsarg], 0, ranges) == false)
+        {
+            std::fprintf(s_msgfile, "Invalid card ID list '%s' (e.g. 0x0FA7,0x1004-0x1068)\n", argv[idsarg]);
+            return false;
+        }
+        for(const auto &[lo, hi] : ranges)
+        {
+            // a range only has to contain some valid IDs, as they aren't contiguous
+            bool found = false;
+            for(uint64_t id = lo; id <= hi && id <= UINT16_MAX; id++)
+            {
+                const size_t cardnum = ids.CardNumForID(WCTCardIDs::cardid_t(id));
+                if(cardnum != WCTCardIDs::npos && cardnum != 0) // card 0 is a dummy
+                {
+                    picnums.push_back(uint32_t(cardnum - 1));
+                    found = true;
+                }
+            }
+            if(found == false)
+            {
+                if(lo == hi)
+                    std::fprintf(s_msgfile, "No card has ID 0x%04llX\n", static_cast<unsigned long long>(lo));
+                else
+                    std::fprintf(s_msgfile, "No card has an ID from 0x%04llX to 0x%04llX\n", static_cast<unsigned long long>(lo), static_cast<unsigned long long>(hi));
+                return false;
+            }
+        }
+    }
+
+    // the gallery reads them in ROM order
+    if(gallery.ReadSelection(romfile, std::move(picnums), numthreads) == false)
+    {
+        std::fputs("Could not read in card pictures\n\n", s_msgfile);
+        return false;
+    }
+    return true;
+}
+
+//
+// Write the cards in a gallery out as images across numthreads threads. Each
+// thread has its own card pic and libpng state.
+//
+// When incremental, cards whose palette and pixel data match the manifest
+// left in the output directory by the last run, and whose image is still
+// there at the recorded size, are skipped. A partial gallery updates just
+// its own cards' manifest entries, keeping the rest.
+//
+// When upscaling, each card's preview is written beside it, and its manifest
+// entry covers both.
+//
+static bool WriteCards(
+    const WCTCardGallery &gallery, const qstring &outloc, WCTCardPic::ImageFormat fmt, WCTCardPic::PNGPreset preset,
+    const WCTUpscale::params_t &upscale, unsigned int numthreads, bool incremental, bool partial
+)
+{
+    qstring settings;
+    const char *const what = fmt == WCTCardPic::ImageFormat::PNG ? WCTCardPic::PNGPresetName(preset) : WCTCardPic::ImageFormatName(fmt);
+    if(upscale.factor > 1)
+        settings.printf("dump %s upscale %u %s", what, upscale.factor, WCTUpscale::FilterName(upscale.filter));
+    else
+        settings.printf("dump %s", what);
+    WCTManifest manifest { WCTManifest::DUMP_FILENAME, settings.c_str() };
+    if(incremental)
+        manifest.Load(outloc.c_str());
+
+    enum : uint8_t { FAILED, WRITTEN, SKIPPED };
+    const uint32_t numpics = gallery.GetCount();
+    std::vector<WCTManifest::entry_t> entries(numpics);
+    std::vector<uint8_t> states(numpics, FAILED);
+
+    WCTParallel::ForRanges(numpics, numthreads, [&] (unsigned int, size_t begin, size_t end) {
+        WCTCardPic thePic;
+        std::vector<uint8_t> image, preview;
+        for(size_t i = begin; i < end; i++)
+        {
+            const uint32_t picnum = gallery.GetPicNum(uint32_t(i));
+
+            const qstring name = CardImageName(picnum + 1, fmt);
+            qstring outfn, previewfn;
+            outfn.printf("%s/%s", outloc.c_str(), name.c_str());
+            if(upscale.factor > 1)
+                previewfn.printf("%s/%s", outloc.c_str(), CardImageName(picnum + 1, fmt, upscale.factor).c_str());
+
+            WCTManifest::entry_t &entry = entries[i];
+            const WCTCardGallery::palette_t &palette = gallery.GetPalette(picnum);
+            entry.source1 = WCTContentHash::Hash64(palette.data(), sizeof(palette));
+            entry.source2 = WCTContentHash::Hash64(gallery.GetRawData(picnum), WCTConstants::CARDGFX_READ_SIZEOF);
+
+            if(incremental && manifest.IsCurrent(name.c_str(), entry.source1, entry.source2))
+            {
+                const WCTManifest::entry_t &prev = *manifest.Find(name.c_str());
+                const uint64_t outputsize = upscale.factor > 1 ?
+                    WCTManifest::OutputSize({ outfn.c_str(), previewfn.c_str() }) :
+                    WCTManifest::OutputSize({ outfn.c_str() });
+                if(outputsize == prev.outputSize)
+                {
+                    entry = prev;
+                    states[i] = SKIPPED;
+                    continue;
+                }
+            }
+
+            gallery.GetCardPic(picnum, thePic);
+            if(thePic.EncodeImage(image, fmt, preset) == false || M_WriteFile(outfn.c_str(), image.data(), image.size()) == 0)
+                continue;
+            entry.output     = WCTContentHash::Hash64(image.data(), image.size());
+            entry.outputSize = image.size();
+
+            if(upscale.factor > 1)
+            {
+                if(thePic.EncodeUpscaledImage(preview, fmt, preset, upscale) == false ||
+                   M_WriteFile(previewfn.c_str(), preview.data(), preview.size()) == 0)
+                {
+                    continue;
+                }
+                entry.output      = WCTContentHash::Hash64(preview.data(), preview.size(), entry.output);
+                entry.outputSize += preview.size();
+            }
+            states[i] = WRITTEN;
+        }
+    });
+
+    // the new manifest only lists what is actually there now
+    WCTManifest written = partial ? manifest : WCTManifest { WCTManifest::DUMP_FILENAME, settings.c_str() };
+    uint32_t numfailed = 0, numskipped = 0;
+    for(uint32_t i = 0; i < numpics; i++)
+    {
+        const qstring name = CardImageName(gallery.GetPicNum(i) + 1, fmt);
+
+        if(states[i] == FAILED)
+        {
+            written.Remove(name.c_str());
+            ++numfailed;
+            continue;
+        }
+        if(states[i] == SKIPPED)
+            ++numskipped;
+
+        written.Set(name.c_str(), entries[i]);
+    }
+
+    if(numfailed != 0)
+        std::printf("Warning: failed to write %u card pictures\n", numfailed);
+    if(incremental)
+    {
+        std::printf("Wrote %u card pictures, %u unchanged\n", numpics - numfailed - numskipped, numskipped);
+        if(written.Save(outloc.c_str()) == false)
+            std::puts("Warning: failed to write manifest\n");
+    }
+    return numfailed == 0;
+}
+
+//
+// Encode the card pics in a gallery and hand them to a sink in order. Batches
+// of cards are encoded into memory in parallel, then passed on one at a time;
+// the buffers are reused from one batch to the next. Returns the number that
+// failed to encode or that the sink rejected.
+//
+// The sink gets each image with its scale factor. When upscaling, a card's
+// preview is encoded alongside it and passed on straight after it.
+//
+static uint32_t EncodeCardsInOrder(
+    const WCTCardGallery &gallery, WCTCardPic::ImageFormat fmt, WCTCardPic::PNGPreset preset,
+    const WCTUpscale::params_t &upscale, unsigned int numthreads,
+    const std::function<bool (uint32_t, uint32_t, const std::vector<uint8_t> &)> &sink
+)
+{
+    constexpr uint32_t CARDSPERTHREAD = 32;
+    const uint32_t count     = gallery.GetCount();
+    const uint32_t batchsize = WCTParallel::ThreadsFor(count, numthreads) * CARDSPERTHREAD;
+
+    std::vector<std::vector<uint8_t>> images(batchsize), previews(upscale.factor > 1 ? batchsize : 0);
+    std::vector<uint8_t> encoded(batchsize);
+    uint32_t numfailed = 0;
+    for(uint32_t batch = 0; batch < count; batch += batchsize)
+    {
+        const uint32_t n = std::min(batchsize, count - batch);
+        WCTParallel::ForRanges(n, numthreads, [&] (unsigned int, size_t begin, size_t end) {
+            WCTCardPic thePic;
+            for(size_t i = begin; i < end; i++)
+            {
+                gallery.GetCardPic(gallery.GetPicNum(batch + uint32_t(i)), thePic);
+                encoded[i] =
+                    thePic.EncodeImage(images[i], fmt, preset) &&
+                    (previews.empty() || thePic.EncodeUpscaledImage(previews[i], fmt, preset, upscale));
+            }
+        });
+
+        for(uint32_t i = 0; i < n; i++)
+        {
+            const uint32_t picnum = gallery.GetPicNum(batch + i);
+            if(encoded[i] == 0 ||
+               sink(picnum, 1, images[i]) == false ||
+               (previews.empty() == false && sink(picnum, upscale.factor, previews[i]) == false))
+            {
+                ++numfailed;
+            }
+        }
+    }
+    return numfailed;
 }
 
 //
-// Dump the card pics from the ROM to PNG files
+// Write the card pics in a gallery into a single zip or tar archive
+//
+static bool WriteCardsToArchive(
+    const WCTCardGallery &gallery, const char *filename, WCTArchiveWriter::Format archivefmt,
+    WCTCardPic::ImageFormat fmt, WCTCardPic::PNGPreset preset, const WCTUpscale::params_t &upscale, unsigned int numthreads
+)
+{
+    WCTArchiveWriter archive;
+    if(archive.Open(filename, archivefmt) == false)
+    {
+        std::printf("Could not create archive '%s'\n", filename);
+        return false;
+    }
+
+    const uint32_t numfailed = EncodeCardsInOrder(gallery, fmt, preset, upscale, numthreads, [&] (uint32_t picnum, uint32_t factor, const std::vector<uint8_t> &image) {
+        const qstring name = CardImageName(picnum + 1, fmt, factor);
+        return archive.AddFile(name.c_str(), image.data(), image.size());
+    });
+
+    if(numfailed != 0)
+        std::printf("Warning: failed to write %u card pictures to archive\n", numfailed);
+    if(archive.Close() == false)
+    {
+        std::printf("Error writing archive '%s'\n", filename);
+        return false;
+    }
+    return numfailed == 0;
+}
+
+//
+// Stream the card pics in a gallery to stdout for another process to read,
+// as a run of frames each made of a 16-byte header and the encoded image:
+//
+//    0  4  "WCTF"
+//    4  2  card number
+//    6  1  image format, as WCTCardPic::ImageFormat
+//    7  1  reserved, 0
+//    8  2  width in pixels
+//   10  2  height in pixels
+//   12  4  size of the image data that follows, in bytes
+//
+// Numbers are little-endian. Messages go to stderr so they can't get mixed
+// in with the frames. Upscaled previews follow their card as frames of their
+// own, told apart by their size.
+//
+static bool WriteCardsToStream(
+    const WCTCardGallery &gallery, WCTCardPic::ImageFormat fmt, WCTCardPic::PNGPreset preset,
+    const WCTUpscale::params_t &upscale, unsigned int numthreads
+)
+{
+    constexpr size_t STREAM_BUFFER_SIZE = 1024 * 1024;
+    constexpr size_t FRAME_HEADER_SIZE  = 16;
+
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    std::setvbuf(stdout, nullptr, _IOFBF, STREAM_BUFFER_SIZE);
+
+    const auto put16 = [] (uint8_t *p, uint32_t v) { p[0] = uint8_t(v); p[1] = uint8_t(v >> 8); };
+    const auto put32 = [] (uint8_t *p, uint32_t v) { p[0] = uint8_t(v); p[1] = uint8_t(v >> 8); p[2] = uint8_t(v >> 16); p[3] = uint8_t(v >> 24); };
+
+    const uint32_t numfailed = EncodeCardsInOrder(gallery, fmt, preset, upscale, numthreads, [&] (uint32_t picnum, uint32_t factor, const std::vector<uint8_t> &image) {
+        uint8_t header[FRAME_HEADER_SIZE] = { 'W', 'C', 'T', 'F' };
+        put16(header + 4, picnum + 1); // cardnums are 1-based
+        header[6] = uint8_t(fmt);
+        put16(header + 8,  WCTConstants::CARDGFX_FULLWIDTH_PX * factor);
+        put16(header + 10, WCTConstants::CARDGFX_FULLHEIGHT_PX * factor);
+        put32(header + 12, uint32_t(image.size()));
+        return
+            std::fwrite(header, sizeof(header), 1, stdout) == 1 &&
+            std::fwrite(image.data(), image.size(), 1, stdout) == 1;
+    });
+
+    const bool flushed = std::fflush(stdout) == 0;
+    if(numfailed != 0)
+        std::fprintf(stderr, "Warning: failed to stream %u card pictures\n", numfailed);
+    if(flushed == false)
+        std::fputs("Error writing to stdout\n", stderr);
+    return numfailed == 0 && flushed;
+}
+
+//
+// Dump the card pics from the ROM to image files
 //
 static void DumpCardPics()
 {
     const EArgManager &args = EArgManager::GetGlobalArgs();
     const char *const *argv = args.getArgv();
 
+    // streaming to another process?
+    const bool tostdout = args.findArgument("-stdout");
+    if(tostdout)
+        s_msgfile = stderr;
+
     FILE *romfile = nullptr;
 
     // need ROM file
@@ -69,13 +525,13 @@ static void DumpCardPics()
         romfile = std::fopen(filename, "rb");
         if(romfile == nullptr)
         {
-            std::printf("Could not open file '%s'\n", filename);
+            std::fprintf(s_msgfile, "Could not open file '%s'\n", filename);
             return; // bork
         }
     }
     else
     {
-        std::puts("Need a WCT2004 ROM file\n");
+        std::fputs("Need a WCT2004 ROM file\n\n", s_msgfile);
         return; // bork
     }
 
@@ -87,7 +543,7 @@ static void DumpCardPics()
         outloc.normalizeSlashes();
         if(hal_platform.makeDirectory(outloc.c_str()) == HAL_FALSE)
         {
-            std::puts("Could not create output directory\n");
+            std::fputs("Could not create output directory\n\n", s_msgfile);
             return;
         }
     }
@@ -95,6 +551,12 @@ static void DumpCardPics()
     // basic verify
     if(WCTROMFile::VerifyROM(romfile) == false)
     {
+        if(tostdout)
+        {
+            // stdout is spoken for, so there's no asking
+            std::fputs("File does not look like a YWCT2K4 ROM\n", s_msgfile);
+            return;
+        }
         std::puts("File does not look like a YWCT2K4 ROM, continue anyway? (Y/N)\n");
         std::fflush(stdout);
         char resp[2];
@@ -109,7 +571,7 @@ static void DumpCardPics()
     const uint32_t numcards = WCTUtils::GetNumCards(romfile);
     if(numcards == 0)
     {
-        std::puts("No cards defined in ROM, or file was unreadable\n");
+        std::fputs("No cards defined in ROM, or file was unreadable\n\n", s_msgfile);
         return;
     }
 
@@ -118,16 +580,109 @@ static void DumpCardPics()
     if(const int p = args.getArgParameters("-card", 1); p != 0)
         cardnum = uint32_t(std::strtoul(argv[p], nullptr, 10));
 
+    // allow choice of PNG encoding speed vs. size
+    WCTCardPic::PNGPreset preset = WCTCardPic::PNGPreset::BALANCED;
+    if(const int p = args.getArgParameters("-pngpreset", 1); p != 0)
+    {
+        if(WCTCardPic::PNGPresetForName(argv[p], preset) == false)
+        {
+            std::fprintf(s_msgfile, "Unknown PNG preset '%s' (fastest, balanced, or smallest)\n", argv[p]);
+            return;
+        }
+    }
+
+    // allow choice of output format; PNG unless asked otherwise
+    WCTCardPic::ImageFormat fmt = WCTCardPic::ImageFormat::PNG;
+    if(const int p = args.getArgParameters("-format", 1); p != 0)
+    {
+        if(WCTCardPic::ImageFormatForName(argv[p], fmt) == false)
+        {
+            std::fprintf(s_msgfile, "Unknown image format '%s' (png, indexed, rgba, ppm, or qoi)\n", argv[p]);
+            return;
+        }
+    }
+
+    // allow upscaled previews to be written alongside the images
+    WCTUpscale::params_t upscale;
+    if(const int p = args.getArgParameters("-upscale", 1); p != 0)
+    {
+        upscale.factor = uint32_t(std::strtoul(argv[p], nullptr, 10));
+        if(upscale.factor < WCTUpscale::MIN_FACTOR || upscale.factor > WCTUpscale::MAX_FACTOR)
+        {
+            std::fprintf(s_msgfile, "Upscale factor must be %u to %u\n", WCTUpscale::MIN_FACTOR, WCTUpscale::MAX_FACTOR);
+            return;
+        }
+    }
+    if(const int p = args.getArgParameters("-upscalefilter", 1); p != 0)
+    {
+        if(WCTUpscale::FilterForName(argv[p], upscale.filter) == false)
+        {
+            std::fprintf(s_msgfile, "Unknown upscale filter '%s' (nearest or scalex)\n", argv[p]);
+            return;
+        }
+    }
+
+    // allow number of threads to write with; default is one per core
+    unsigned int numthreads = 0;
+    if(const int p = args.getArgParameters("-jobs", 1); p != 0)
+        numthreads = unsigned(std::strtoul(argv[p], nullptr, 10));
+
+    // read the cards to write out
+    const auto readgallery = [&] (WCTCardGallery &gallery) {
+        if(cardnum == 0)
+            return ReadSelectedCards(romfile, numthreads, gallery);
+        if(cardnum >= numcards)
+        {
+            std::fprintf(s_msgfile, "Invalid card number %u (1 to %u)\n", cardnum, numcards);
+            return false;
+        }
+        if(gallery.ReadFromROM(romfile, cardnum - 1, 1) == false)
+        {
+            std::fprintf(s_msgfile, "Could not read in picture for card %u\n", cardnum);
+            return false;
+        }
+        return true;
+    };
+
+    // allow streaming everything to stdout for another process to read
+    if(tostdout)
+    {
+        WCTCardGallery gallery;
+        if(readgallery(gallery) == true)
+            WriteCardsToStream(gallery, fmt, preset, upscale, numthreads);
+        return;
+    }
+
+    // allow writing everything into one zip or tar file instead of loose files
+    if(const int p = args.getArgParameters("-archive", 1); p != 0)
+    {
+        WCTArchiveWriter::Format archivefmt;
+        if(WCTArchiveWriter::FormatForFilename(argv[p], archivefmt) == false)
+        {
+            std::fprintf(s_msgfile, "Archive '%s' must be a .zip or .tar file\n", argv[p]);
+            return;
+        }
+
+        WCTCardGallery gallery;
+        if(readgallery(gallery) == true)
+            WriteCardsToArchive(gallery, argv[p], archivefmt, fmt, preset, upscale, numthreads);
+        return;
+    }
+
     if(cardnum == 0)
     {
-        // write all cards
-        for(uint32_t i = 1; i < numcards; i++)
-            WriteOneCard(romfile, i, numcards, outloc);
+        // write all cards, or those selected
+        WCTCardGallery gallery;
+        if(readgallery(gallery) == true)
+        {
+            const bool partial = args.findArgument("-cards") || args.findArgument("-ids");
+            WriteCards(gallery, outloc, fmt, preset, upscale, numthreads, args.findArgument("-incremental"), partial);
+        }
     }
     else
     {
         // write a specific card
-        WriteOneCard(romfile, cardnum, numcards, outloc);
+        WriteOneCard(romfile, cardnum, numcards, outloc, fmt, preset, upscale);
     }
 }
 
@@ -160,60 +715,1340 @@ static void GenerateCardPics()
         }
     }
 
-    using namespace std::filesystem;
+    WCTImportPipeline::params_t params;
+    params.inDir  = inloc.c_str();
+    params.outDir = outloc.c_str();
 
-    std::error_code ec;
-    directory_iterator dir { path { inloc.c_str() }, ec };
-    std::string infn;
-    qstring outfn;
-    for(const directory_entry &entry : dir)
+    // only repack PNGs that changed since the last run?
+    params.incremental = args.findArgument("-incremental");
+
+    // dither truecolor PNGs as they are quantized?
+    if(args.findArgument("-dither") == true)
+        params.dither = WCTQuantizer::Dither::ORDERED;
+
+    // allow number of threads to decode and pack with; default is one per core
+    if(const int p = args.getArgParameters("-jobs", 1); p != 0)
+        params.numThreads = unsigned(std::strtoul(argv[p], nullptr, 10));
+
+    WCTImportPipeline::results_t results;
+    if(WCTImportPipeline::Run(params, results) == false)
     {
-        if(entry.is_regular_file() == true)
-        {
-            const path &entpath = entry.path();
-            if(strcasecmp(entpath.extension().string().c_str(), ".png") == 0)
-            {
-                WCTCardPic pic;
-                infn = entpath.filename().string();
+        std::printf("Could not read input directory '%s'\n", inloc.c_str());
+        return;
+    }
 
-                if(pic.ReadFromPNG(entpath.string().c_str()) == true)
-                {
-                    outfn = outloc / infn.c_str();
-                    if(pic.WriteGBAData(outfn.c_str()) == false)
-                        std::printf("Warning: failed to write GBA data for PNG file '%s'\n", infn.c_str());
-                }
-                else
-                {
-                    std::printf("Warning: failed to read PNG file '%s'\n", infn.c_str());
-                }
-            }
-        }
+    for(const std::string &warning : results.warnings)
+        std::printf("Warning: %s\n", warning.c_str());
+
+    if(params.incremental)
+        std::printf("Packed %u PNG files, %u unchanged\n", results.packed, results.unchanged);
+
+    // report where the time went
+    if(args.findArgument("-timing") == true)
+    {
+        std::printf("Stage timing (%u threads; worker stages summed over threads):\n", results.threads);
+        std::printf("  list:   %8.2f ms\n", results.listSecs   * 1000.0);
+        std::printf("  read:   %8.2f ms\n", results.readSecs   * 1000.0);
+        std::printf("  decode: %8.2f ms\n", results.decodeSecs * 1000.0);
+        std::printf("  pack:   %8.2f ms\n", results.packSecs   * 1000.0);
+        std::printf("  write:  %8.2f ms\n", results.writeSecs  * 1000.0);
+        std::printf("  total:  %8.2f ms wall\n", results.totalSecs * 1000.0);
     }
 }
 
-// 
-// Main routine
 //
-void cardgfxtool_main()
+// Get the card number from a PNG named as -dump names them, card<number>.png
+//
+static bool CardNumForPNG(const std::string &name, uint32_t &cardnum)
 {
-    // init elib HAL
-    HAL_Init();
+    constexpr size_t PREFIXLEN = 4;
+    if(name.size() <= PREFIXLEN || strncasecmp(name.c_str(), "card", PREFIXLEN) != 0 ||
+       std::isdigit(static_cast<unsigned char>(name[PREFIXLEN])) == 0)
+    {
+        return false;
+    }
 
-    const EArgManager &args = EArgManager::GetGlobalArgs();
+    char *end = nullptr;
+    cardnum = uint32_t(std::strtoul(name.c_str() + PREFIXLEN, &end, 10));
+    return strcasecmp(end, ".png") == 0;
+}
 
-    if(args.findArgument("-dump") == true)
+//
+// Replace a file's contents without ever leaving it half written: the data
+// goes to a temporary file beside it, which is renamed over it once it is
+// complete. If backup is given, the old file is kept under that name.
+//
+static bool ReplaceFile(const char *filename, const void *data, size_t len, const char *backup)
+{
+    qstring tmpname;
+    tmpname.printf("%s.tmp", filename);
+    if(M_WriteFile(tmpname.c_str(), data, len) == 0)
     {
-        // dump mode
-        DumpCardPics();
+        std::remove(tmpname.c_str());
+        return false;
     }
-    else if(args.findArgument("-generate") == true)
+
+    std::error_code ec;
+    if(backup != nullptr)
     {
-        // generate mode
-        GenerateCardPics();
+        std::filesystem::remove(backup, ec);
+        std::filesystem::rename(filename, backup, ec);
+        if(ec)
+        {
+            std::remove(tmpname.c_str());
+            return false;
+        }
+    }
+
+    std::filesystem::rename(tmpname.c_str(), filename, ec);
+    if(ec)
+    {
+        // put the original back where it was
+        if(backup != nullptr)
+            std::filesystem::rename(backup, filename, ec);
+        std::remove(tmpname.c_str());
+        return false;
+    }
+    return true;
+}
+
+//
+// Pack PNGs straight into a copy of the ROM held in memory, then write the
+// patched ROM out once. Patching the input in place keeps the original as
+// <rom>.bak.
+//
+static void InjectCardPics()
+{
+    const EArgManager &args = EArgManager::GetGlobalArgs();
+    const char *const *argv = args.getArgv();
+
+    // need ROM file
+    const int romarg = args.getArgParameters("-rom", 1);
+    if(romarg == 0)
+    {
+        std::puts("Need a WCT2004 ROM file\n");
+        return;
+    }
+    EAutoFile upRomFile { std::fopen(argv[romarg], "rb") };
+    if(upRomFile == nullptr)
+    {
+        std::printf("Could not open file '%s'\n", argv[romarg]);
+        return;
+    }
+
+    // refuse to patch something that isn't the game
+    if(WCTROMFile::VerifyROM(upRomFile.get()) == false)
+    {
+        std::printf("File '%s' does not look like a YWCT2K4 ROM\n", argv[romarg]);
+        return;
+    }
+
+    // allow input directory spec
+    qstring inloc { "." };
+    if(const int p = args.getArgParameters("-in", 1); p != 0)
+    {
+        inloc = argv[p];
+        inloc.normalizeSlashes();
+    }
+
+    // output ROM; default is to patch the input in place, keeping a backup
+    const char *outrom = argv[romarg];
+    if(const int p = args.getArgParameters("-out", 1); p != 0)
+        outrom = argv[p];
+    std::error_code ec;
+    const bool inplace = outrom == argv[romarg] || std::filesystem::equivalent(outrom, argv[romarg], ec);
+    qstring backup;
+    if(inplace)
+        backup.printf("%s.bak", argv[romarg]);
+
+    // dither truecolor PNGs as they are quantized?
+    const WCTQuantizer::Dither dither = args.findArgument("-dither") ? WCTQuantizer::Dither::ORDERED : WCTQuantizer::Dither::NONE;
+
+    // allow number of threads to pack with; default is one per core
+    unsigned int numthreads = 0;
+    if(const int p = args.getArgParameters("-jobs", 1); p != 0)
+        numthreads = unsigned(std::strtoul(argv[p], nullptr, 10));
+
+    const uint32_t numcards = WCTUtils::GetNumCards(upRomFile.get());
+    if(numcards < 2)
+    {
+        std::puts("No cards defined in ROM, or file was unreadable\n");
+        return;
+    }
+
+    // work out which card each PNG replaces
+    std::vector<std::filesystem::path> files;
+    if(WCTImportPipeline::ListPNGs(inloc.c_str(), files) == false)
+    {
+        std::printf("Could not read input directory '%s'\n", inloc.c_str());
+        return;
+    }
+
+    struct inject_t
+    {
+        std::filesystem::path file;
+        uint16_t              picnum;
+        bool                  ok;
+    };
+    std::vector<inject_t> injects;
+    for(const std::filesystem::path &file : files)
+    {
+        const std::string name = file.filename().string();
+        uint32_t cardnum = 0;
+        if(CardNumForPNG(name, cardnum) == false)
+            std::printf("Warning: skipping '%s', which is not named card<number>.png\n", name.c_str());
+        else if(cardnum < 1 || cardnum >= numcards || cardnum > WCTCardGallery::MAX_PICTURES)
+            std::printf("Warning: skipping '%s', invalid card number %u (1 to %u)\n", name.c_str(), cardnum, numcards - 1);
+        else
+            injects.push_back({ file, uint16_t(cardnum - 1), false }); // cardnums are 1-based but the picture storage is 0-based
+    }
+    if(injects.empty())
+    {
+        std::puts("No card PNGs to inject\n");
+        return;
+    }
+
+    // names such as card1.png and card0001.png are the same card; rather than
+    // guess which was meant, refuse to inject either
+    std::stable_sort(injects.begin(), injects.end(), [] (const inject_t &a, const inject_t &b) { return a.picnum < b.picnum; });
+    bool duplicates = false;
+    for(size_t i = 1; i < injects.size(); i++)
+    {
+        if(injects[i].picnum == injects[i - 1].picnum)
+        {
+            std::printf(
+                "'%s' and '%s' are both card %u\n", injects[i - 1].file.filename().string().c_str(),
+                injects[i].file.filename().string().c_str(), injects[i].picnum + 1u
+            );
+            duplicates = true;
+        }
+    }
+    if(duplicates)
+    {
+        std::puts("More than one PNG for the same card; ROM left unchanged\n");
+        return;
+    }
+
+    // read the whole ROM
+    const long romlen = M_FileLength(upRomFile.get());
+    std::vector<uint8_t> rom(romlen > 0 ? size_t(romlen) : 0);
+    if(rom.empty() || std::fseek(upRomFile.get(), 0, SEEK_SET) != 0 ||
+       std::fread(rom.data(), 1, rom.size(), upRomFile.get()) != rom.size())
+    {
+        std::printf("Could not read file '%s'\n", argv[romarg]);
+        return;
+    }
+
+    // every card has its own slots, so threads can store into the image
+    // without getting in each other's way
+    WCTParallel::ForRanges(injects.size(), numthreads, [&] (unsigned int, size_t begin, size_t end) {
+        WCTCardPic pic;
+        std::vector<uint8_t> pngdata;
+        for(size_t i = begin; i < end; i++)
+        {
+            inject_t &inj = injects[i];
+            inj.ok =
+                WCTCardPic::LoadPNGFile(inj.file.string().c_str(), pngdata) &&
+                pic.ReadFromPNGData(pngdata.data(), pngdata.size(), dither) &&
+                pic.WriteToROMImage(rom.data(), rom.size(), inj.picnum);
+        }
+    });
+
+    uint32_t numinjected = 0;
+    for(const inject_t &inj : injects)
+    {
+        if(inj.ok)
+            ++numinjected;
+        else
+            std::printf("Warning: failed to inject PNG file '%s'\n", inj.file.filename().string().c_str());
+    }
+
+    if(numinjected == 0)
+    {
+        std::puts("Nothing was injected; ROM left unchanged\n");
+        return;
+    }
+
+    // done with the input, which may be the output too
+    upRomFile.reset();
+    if(ReplaceFile(outrom, rom.data(), rom.size(), inplace ? backup.c_str() : nullptr) == false)
+    {
+        std::printf("Could not write ROM file '%s'; it is left as it was\n", outrom);
+        return;
+    }
+    if(inplace)
+        std::printf("Injected %u card pictures into '%s', original kept as '%s'\n", numinjected, outrom, backup.c_str());
+    else
+        std::printf("Injected %u card pictures into '%s'\n", numinjected, outrom);
+}
+
+//
+// Write all card pics from the ROM into atlas sheets
+//
+static void WriteAtlas()
+{
+    const EArgManager &args = EArgManager::GetGlobalArgs();
+    const char *const *argv = args.getArgv();
+
+    // need ROM file
+    const int p = args.getArgParameters("-rom", 1);
+    if(p == 0)
+    {
+        std::puts("Need a WCT2004 ROM file\n");
+        return;
+    }
+    const EAutoFile upRomFile { std::fopen(argv[p], "rb") };
+    if(upRomFile == nullptr)
+    {
+        std::printf("Could not open file '%s'\n", argv[p]);
+        return;
+    }
+
+    // allow output directory spec
+    qstring outloc { "." };
+    if(const int op = args.getArgParameters("-out", 1); op != 0)
+    {
+        outloc = argv[op];
+        outloc.normalizeSlashes();
+        if(hal_platform.makeDirectory(outloc.c_str()) == HAL_FALSE)
+        {
+            std::puts("Could not create output directory\n");
+            return;
+        }
+    }
+
+    // allow sheet file name spec
+    const char *basename = "atlas";
+    if(const int np = args.getArgParameters("-atlasname", 1); np != 0)
+        basename = argv[np];
+
+    WCTCardAtlas::params_t params;
+    if(const int cp = args.getArgParameters("-columns", 1); cp != 0)
+        params.columns = uint32_t(std::strtoul(argv[cp], nullptr, 10));
+    if(const int sp = args.getArgParameters("-sheetcards", 1); sp != 0)
+        params.sheetCards = uint32_t(std::strtoul(argv[sp], nullptr, 10));
+    if(args.findArgument("-rgba") == true)
+        params.mode = WCTCardAtlas::Mode::RGBA;
+    if(const int jp = args.getArgParameters("-jobs", 1); jp != 0)
+        params.numThreads = unsigned(std::strtoul(argv[jp], nullptr, 10));
+
+    if(params.columns == 0)
+    {
+        std::puts("Atlas must be at least one column wide\n");
+        return;
+    }
+
+    WCTCardGallery gallery;
+    if(ReadAllCards(upRomFile.get(), params.numThreads, gallery) == false)
+        return;
+
+    WCTCardAtlas::Write(gallery, outloc.c_str(), basename, params);
+}
+
+//
+// Print up to maxgroups sets of cards sharing something
+//
+static void PrintCardGroups(const char *what, const std::vector<std::vector<uint32_t>> &groups, size_t maxgroups)
+{
+    constexpr size_t MAXLISTED = 12;
+
+    for(size_t g = 0; g < groups.size() && g < maxgroups; g++)
+    {
+        std::printf("  %zu cards share a %s:", groups[g].size(), what);
+        for(size_t i = 0; i < groups[g].size() && i < MAXLISTED; i++)
+            std::printf(" %u", groups[g][i] + 1); // cardnums are 1-based
+        std::puts(groups[g].size() > MAXLISTED ? " ..." : "");
+    }
+    if(groups.size() > maxgroups)
+        std::printf("  (%zu more sets; use -groups to list more)\n", groups.size() - maxgroups);
+}
+
+//
+// Report duplicated tiles, card graphics, and palettes in the ROM, and how
+// much space sharing them could save
+//
+static void AnalyzeCardPics()
+{
+    using namespace WCTConstants;
+
+    const EArgManager &args = EArgManager::GetGlobalArgs();
+    const char *const *argv = args.getArgv();
+
+    const int p = args.getArgParameters("-rom", 1);
+    if(p == 0)
+    {
+        std::puts("Need a WCT2004 ROM file\n");
+        return;
+    }
+    const EAutoFile upRomFile { std::fopen(argv[p], "rb") };
+    if(upRomFile == nullptr)
+    {
+        std::printf("Could not open file '%s'\n", argv[p]);
+        return;
+    }
+
+    // how many sets of sharing cards to list
+    size_t maxgroups = 10;
+    if(const int gp = args.getArgParameters("-groups", 1); gp != 0)
+        maxgroups = size_t(std::strtoul(argv[gp], nullptr, 10));
+
+    // how far a color may move for cards to share a palette
+    WCTPaletteClusters::params_t palparams;
+    if(const int tp = args.getArgParameters("-paltolerance", 1); tp != 0)
+        palparams.tolerance = uint32_t(std::strtoul(argv[tp], nullptr, 10));
+
+    WCTCardGallery gallery;
+    if(ReadAllCards(upRomFile.get(), 0, gallery) == false)
+        return;
+
+    const auto start = std::chrono::steady_clock::now();
+    WCTTileAnalysis::results_t results;
+    WCTTileAnalysis::Analyze(gallery, results);
+    WCTPaletteClusters::results_t palresults;
+    WCTPaletteClusters::Analyze(gallery, palparams, palresults);
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    constexpr uint32_t TILE_BYTES     = CARDGFX_TILE_WIDTH_PX * CARDGFX_TILE_HEIGHT_PX * CARDGFX_BPP / 8;
+    constexpr uint32_t TILES_PER_CARD = CARDGFX_TILEMAP_WIDTH * CARDGFX_TILEMAP_HEIGHT;
+
+    // a shared tile pool needs a map per card: a tile number plus two flip bits per tile
+    uint32_t indexbits = 1;
+    while((1u << indexbits) < results.uniqueTilesFlipped)
+        ++indexbits;
+    const uint32_t entrybytes = (indexbits + 2 + 7) / 8;
+
+    const uint64_t tilebytes   = uint64_t(results.numTiles) * TILE_BYTES;
+    const uint64_t pooledbytes = uint64_t(results.uniqueTilesFlipped) * TILE_BYTES + uint64_t(results.numCards) * TILES_PER_CARD * entrybytes;
+    const uint64_t palbytes    = uint64_t(results.numCards) * CARDPALETTE_READ_SIZEOF;
+
+    std::printf("Analyzed %u cards, %u tiles in %.2f ms\n\n", results.numCards, results.numTiles, secs * 1000.0);
+
+    std::printf("Tiles:\n");
+    std::printf("  distinct, exact:      %6u (%u duplicates)\n", results.uniqueTiles, results.numTiles - results.uniqueTiles);
+    std::printf("  distinct, with flips: %6u (%u more match only when flipped)\n", results.uniqueTilesFlipped, results.uniqueTiles - results.uniqueTilesFlipped);
+    if(results.topTileCounts.empty() == false)
+    {
+        std::printf("  most used tiles occur:");
+        for(uint32_t count : results.topTileCounts)
+            std::printf(" %u", count);
+        std::puts(" times");
+    }
+    std::printf(
+        "  as stored: %llu bytes; as a shared pool with %u-byte map entries: %llu bytes (%lld saved)\n\n",
+        static_cast<unsigned long long>(tilebytes), entrybytes, static_cast<unsigned long long>(pooledbytes),
+        static_cast<long long>(tilebytes) - static_cast<long long>(pooledbytes)
+    );
+
+    std::printf("Card graphics:\n");
+    std::printf("  distinct: %u of %u (%u bytes saved by sharing)\n", results.uniqueGraphics, results.numCards, (results.numCards - results.uniqueGraphics) * CARDGFX_READ_SIZEOF);
+    std::printf("  distinct with palette: %u\n", results.uniqueCardPics);
+    PrintCardGroups("graphic", results.graphicGroups, maxgroups);
+
+    std::printf("\nPalettes:\n");
+    std::printf(
+        "  distinct: %u of %u (%llu bytes as stored, %u saved by sharing)\n",
+        results.uniquePalettes, results.numCards, static_cast<unsigned long long>(palbytes),
+        (results.numCards - results.uniquePalettes) * CARDPALETTE_READ_SIZEOF
+    );
+    PrintCardGroups("palette", results.paletteGroups, maxgroups);
+
+    std::printf("\nPalette sharing, counting only the colors each card uses:\n");
+    std::printf(
+        "  distinct color sets: %u (%u bytes saved by sharing)\n",
+        palresults.uniqueColorSets, (palresults.numCards - palresults.uniqueColorSets) * CARDPALETTE_READ_SIZEOF
+    );
+    PrintCardGroups("set of colors", palresults.colorSetGroups, maxgroups);
+    std::printf(
+        "  palettes within tolerance %u: %u (%u bytes saved by sharing; colors move by up to %u)\n",
+        palparams.tolerance, palresults.numClusters, (palresults.numCards - palresults.numClusters) * CARDPALETTE_READ_SIZEOF,
+        palresults.maxDistance
+    );
+    PrintCardGroups("palette within tolerance, the first card's", palresults.clusterGroups, maxgroups);
+}
+
+//
+// Find the first byte at which two buffers differ. Returns false if they
+// are the same.
+//
+static bool FirstDifference(const uint8_t *a, const uint8_t *b, size_t size, size_t &index)
+{
+    const auto [pa, pb] = std::mismatch(a, a + size, b);
+    index = size_t(pa - a);
+    return index != size;
+}
+
+//
+// Check one card every way it can be decoded and encoded again. Returns a
+// description of the first thing that didn't reproduce the ROM, or an empty
+// string if everything did.
+//
+static qstring VerifyOneCard(
+    const WCTCardGallery &gallery, uint32_t picnum,
+    const std::vector<WCTPixelCodec::unpackimpl_t> &unpacks, const std::vector<WCTPixelCodec::packimpl_t> &packs,
+    WCTCardPic::PNGPreset preset, WCTCardPic &thePic, WCTCardPic &readBack, std::vector<uint8_t> &png
+)
+{
+    using namespace WCTConstants;
+
+    const uint8_t *const raw       = gallery.GetRawData(picnum);
+    const uint8_t *const pixels    = gallery.GetPixels(picnum);
+    const uint32_t       gfxoffset = OFFS_CARDGFX_START + picnum * CARDGFX_READ_SIZEOF;
+    const uint32_t       paloffset = OFFS_CARDPALETTES_START + picnum * CARDPALETTE_READ_SIZEOF;
+
+    qstring problem;
+    size_t  index = 0;
+    std::array<uint8_t, CARDGFX_PIXEL_COUNT>  unpacked;
+    std::array<uint8_t, CARDGFX_READ_SIZEOF>  packed;
+
+    // every unpacker must agree on the pixels
+    for(const WCTPixelCodec::unpackimpl_t &impl : unpacks)
+    {
+        impl.fn(raw, unpacked.data());
+        if(FirstDifference(unpacked.data(), pixels, CARDGFX_PIXEL_COUNT, index))
+        {
+            problem.printf(
+                "%s unpack differs at pixel %u,%u", impl.name,
+                unsigned(index % CARDGFX_FULLWIDTH_PX), unsigned(index / CARDGFX_FULLWIDTH_PX)
+            );
+            return problem;
+        }
+    }
+
+    // and every packer must give back the ROM bytes
+    for(const WCTPixelCodec::packimpl_t &impl : packs)
+    {
+        impl.fn(pixels, packed.data());
+        if(FirstDifference(packed.data(), raw, CARDGFX_READ_SIZEOF, index))
+        {
+            problem.printf("%s pack differs at ROM offset 0x%X", impl.name, unsigned(gfxoffset + index));
+            return problem;
+        }
+    }
+
+    // through a PNG and back
+    gallery.GetCardPic(picnum, thePic);
+    if(thePic.EncodePNG(png, preset) == false)
+    {
+        problem = "PNG encoding failed";
+        return problem;
+    }
+    if(readBack.ReadFromPNGData(png.data(), png.size()) == false)
+    {
+        problem = "PNG decoding failed";
+        return problem;
+    }
+    if(FirstDifference(readBack.GetPixels().data(), pixels, CARDGFX_PIXEL_COUNT, index))
+    {
+        problem.printf(
+            "PNG pixels differ at %u,%u",
+            unsigned(index % CARDGFX_FULLWIDTH_PX), unsigned(index / CARDGFX_FULLWIDTH_PX)
+        );
+        return problem;
+    }
+
+    // PNG can't carry a palette entry's unused top bit, so it's left out
+    const WCTCardGallery::palette_t &palette = gallery.GetPalette(picnum);
+    for(size_t c = 0; c < CARDPALETTE_NUMENTRIES; c++)
+    {
+        if(readBack.GetPalette()[c] != (palette[c] & 0x7FFF))
+        {
+            problem.printf("PNG palette differs at ROM offset 0x%X", unsigned(paloffset + c * sizeof(palette[c])));
+            return problem;
+        }
+    }
+    if(FirstDifference(readBack.GetRawData().data(), raw, CARDGFX_READ_SIZEOF, index))
+    {
+        problem.printf("PNG repack differs at ROM offset 0x%X", unsigned(gfxoffset + index));
+        return problem;
+    }
+
+    return problem;
+}
+
+//
+// Verify mode: check that every card's graphics and palette survive being
+// unpacked and packed again by every codec implementation, and a round
+// trip through the PNG writer and reader, reporting where each card that
+// doesn't first goes wrong. -cards and -ids limit it to a selection.
+//
+static void VerifyCardPics()
+{
+    using namespace WCTConstants;
+
+    const EArgManager &args = EArgManager::GetGlobalArgs();
+    const char *const *argv = args.getArgv();
+
+    const int p = args.getArgParameters("-rom", 1);
+    if(p == 0)
+    {
+        std::puts("Need a WCT2004 ROM file\n");
+        return;
+    }
+    const EAutoFile upRomFile { std::fopen(argv[p], "rb") };
+    if(upRomFile == nullptr)
+    {
+        std::printf("Could not open file '%s'\n", argv[p]);
+        return;
+    }
+
+    unsigned int numthreads = 0;
+    if(const int jp = args.getArgParameters("-jobs", 1); jp != 0)
+        numthreads = unsigned(std::strtoul(argv[jp], nullptr, 10));
+
+    // the fastest preset is the default, since the reader doesn't care
+    WCTCardPic::PNGPreset preset = WCTCardPic::PNGPreset::FASTEST;
+    if(const int pp = args.getArgParameters("-pngpreset", 1); pp != 0)
+    {
+        if(WCTCardPic::PNGPresetForName(argv[pp], preset) == false)
+        {
+            std::printf("Unknown PNG preset '%s'\n", argv[pp]);
+            return;
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    WCTCardGallery gallery;
+    if(ReadSelectedCards(upRomFile.get(), numthreads, gallery) == false)
+        return;
+    const uint32_t numpics = gallery.GetCount();
+
+    const std::vector<WCTPixelCodec::unpackimpl_t> unpacks = WCTPixelCodec::UnpackImplementations();
+    const std::vector<WCTPixelCodec::packimpl_t>   packs   = WCTPixelCodec::PackImplementations();
+
+    std::vector<qstring>  problems(numpics);
+    std::vector<uint32_t> topbits(WCTParallel::ThreadsFor(numpics, numthreads));
+    WCTParallel::ForRanges(numpics, numthreads, [&] (unsigned int threadnum, size_t begin, size_t end) {
+        WCTCardPic thePic, readBack;
+        std::vector<uint8_t> png;
+        for(size_t i = begin; i < end; i++)
+        {
+            const uint32_t picnum = gallery.GetPicNum(uint32_t(i));
+            problems[i] = VerifyOneCard(gallery, picnum, unpacks, packs, preset, thePic, readBack, png);
+            for(WCTColor::gbacolor_t color : gallery.GetPalette(picnum))
+                topbits[threadnum] += (color & 0x8000) != 0;
+        }
+    });
+
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint32_t numbad = 0;
+    for(uint32_t i = 0; i < numpics; i++)
+    {
+        if(problems[i].empty() == false)
+        {
+            std::printf("card %u: %s\n", gallery.GetPicNum(i) + 1, problems[i].c_str()); // card numbers are 1-based
+            ++numbad;
+        }
+    }
+
+    uint32_t numtopbits = 0;
+    for(uint32_t n : topbits)
+        numtopbits += n;
+
+    std::printf(
+        "Verified %u cards with %u thread(s) in %.1f ms | codecs: %zu unpack, %zu pack | PNG preset %s\n",
+        numpics, WCTParallel::ThreadsFor(numpics, numthreads), secs * 1000.0, unpacks.size(), packs.size(),
+        WCTCardPic::PNGPresetName(preset)
+    );
+    if(numtopbits != 0)
+    {
+        std::printf(
+            "Note: %u palette entries have the unused top bit set; the hardware ignores it, but it is cleared by a PNG round trip\n",
+            numtopbits
+        );
+    }
+    if(numbad == 0)
+        std::puts("All cards verified");
+    else
+        std::printf("VERIFY FAILED: %u of %u cards did not round-trip\n", numbad, numpics);
+}
+
+//
+// Benchmark each PNG preset over the whole card set, encoding into memory
+//
+static void BenchPNG()
+{
+    const EArgManager &args = EArgManager::GetGlobalArgs();
+    const char *const *argv = args.getArgv();
+
+    // need ROM file
+    const int p = args.getArgParameters("-rom", 1);
+    if(p == 0)
+    {
+        std::puts("Need a WCT2004 ROM file\n");
+        return;
+    }
+    const EAutoFile upRomFile { std::fopen(argv[p], "rb") };
+    if(upRomFile == nullptr)
+    {
+        std::printf("Could not open file '%s'\n", argv[p]);
+        return;
+    }
+
+    unsigned int numthreads = 0;
+    if(const int jp = args.getArgParameters("-jobs", 1); jp != 0)
+        numthreads = unsigned(std::strtoul(argv[jp], nullptr, 10));
+
+    WCTCardGallery gallery;
+    if(ReadAllCards(upRomFile.get(), numthreads, gallery) == false)
+        return;
+    const uint32_t numpics = gallery.GetCount();
+
+    const unsigned int usedthreads = WCTParallel::ThreadsFor(numpics, numthreads);
+    std::printf("Encoding %u cards with %u thread(s)\n", numpics, usedthreads);
+
+    for(size_t i = 0; i < size_t(WCTCardPic::PNGPreset::NUMPRESETS); i++)
+    {
+        const WCTCardPic::PNGPreset preset = WCTCardPic::PNGPreset(i);
+
+        std::vector<uint64_t> bytes(usedthreads);
+        std::vector<uint32_t> failures(usedthreads);
+        const auto start = std::chrono::steady_clock::now();
+        WCTParallel::ForRanges(numpics, numthreads, [&] (unsigned int threadnum, size_t begin, size_t end) {
+            WCTCardPic thePic;
+            std::vector<uint8_t> out;
+            for(size_t picnum = begin; picnum < end; picnum++)
+            {
+                gallery.GetCardPic(uint32_t(picnum), thePic);
+                if(thePic.EncodePNG(out, preset) == true)
+                    bytes[threadnum] += out.size();
+                else
+                    ++failures[threadnum];
+            }
+        });
+        const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t totalbytes  = 0;
+        uint32_t totalfailed = 0;
+        for(unsigned int t = 0; t < usedthreads; t++)
+        {
+            totalbytes  += bytes[t];
+            totalfailed += failures[t];
+        }
+
+        const double pixelmb = double(numpics) * WCTConstants::CARDGFX_PIXEL_COUNT / (1024.0 * 1024.0);
+        std::printf(
+            "%-8s: %8.1f ms | %8.0f cards/s | %6.1f MB/s of pixels | %8llu bytes total, %6.0f bytes/card",
+            WCTCardPic::PNGPresetName(preset), secs * 1000.0, numpics / secs, pixelmb / secs,
+            static_cast<unsigned long long>(totalbytes), double(totalbytes) / numpics
+        );
+        if(totalfailed != 0)
+            std::printf(" | %u FAILED", totalfailed);
+        std::putchar('\n');
+    }
+}
+
+//
+// Check every unpacking implementation against the portable one, over input
+// covering every possible value of each 3-byte (4-pixel) group, and time them
+//
+static bool SelfTestUnpack()
+{
+    using namespace WCTConstants;
+
+    constexpr uint32_t GROUPBYTES    = 3;
+    constexpr uint32_t GROUPSPERCARD = CARDGFX_READ_SIZEOF / GROUPBYTES;
+    constexpr uint32_t NUMPATTERNS   = 1u << 24;
+    constexpr uint32_t NUMCARDS      = (NUMPATTERNS + GROUPSPERCARD - 1) / GROUPSPERCARD;
+
+    // build the input: pattern k goes in group k, running on through as many cards as needed
+    std::unique_ptr<uint8_t []> upRaw { new uint8_t [size_t(NUMCARDS) * CARDGFX_READ_SIZEOF] };
+    for(uint32_t k = 0; k < NUMCARDS * GROUPSPERCARD; k++)
+    {
+        const uint32_t pattern = k & (NUMPATTERNS - 1);
+        uint8_t *const group   = upRaw.get() + size_t(k) * GROUPBYTES;
+        group[0] = uint8_t(pattern);
+        group[1] = uint8_t(pattern >> 8);
+        group[2] = uint8_t(pattern >> 16);
+    }
+
+    const std::vector<WCTPixelCodec::unpackimpl_t> impls = WCTPixelCodec::UnpackImplementations();
+    std::unique_ptr<uint8_t []> upRef { new uint8_t [size_t(NUMCARDS) * CARDGFX_PIXEL_COUNT] };
+    std::unique_ptr<uint8_t []> upOut { new uint8_t [size_t(NUMCARDS) * CARDGFX_PIXEL_COUNT] };
+
+    bool ok = true;
+    for(const WCTPixelCodec::unpackimpl_t &impl : impls)
+    {
+        uint8_t *const out = (impl.fn == impls.front().fn) ? upRef.get() : upOut.get();
+
+        const auto start = std::chrono::steady_clock::now();
+        for(uint32_t c = 0; c < NUMCARDS; c++)
+            impl.fn(upRaw.get() + size_t(c) * CARDGFX_READ_SIZEOF, out + size_t(c) * CARDGFX_PIXEL_COUNT);
+        const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const bool match = (out == upRef.get()) ||
+            std::memcmp(out, upRef.get(), size_t(NUMCARDS) * CARDGFX_PIXEL_COUNT) == 0;
+        std::printf(
+            "unpack %-6s: %s | %u cards in %.1f ms (%.2f us/card)\n",
+            impl.name, match ? "ok" : "MISMATCH", NUMCARDS, secs * 1000.0, secs * 1000000.0 / NUMCARDS
+        );
+        ok = ok && match;
+    }
+    return ok;
+}
+
+//
+// Check every packing implementation against the portable one and against
+// unpacking. Random images use all 8 bits of each pixel, to check that the
+// packers agree about discarding the top two. If a ROM is given, every card
+// graphic in it must also come back out of an unpack and repack unchanged.
+//
+static bool SelfTestPack(FILE *romfile)
+{
+    using namespace WCTConstants;
+
+    constexpr uint32_t NUMRANDOM = 4096;
+
+    std::vector<std::array<uint8_t, CARDGFX_READ_SIZEOF>> raws;
+    if(romfile != nullptr)
+    {
+        const uint32_t numcards = WCTUtils::GetNumCards(romfile);
+        for(uint32_t i = 0; i + 1 < numcards; i++)
+        {
+            std::array<uint8_t, CARDGFX_READ_SIZEOF> &raw = raws.emplace_back();
+            if(WCTROMFile::GetStdArrayFromOffset(romfile, OFFS_CARDGFX_START + i * CARDGFX_READ_SIZEOF, raw) == false)
+            {
+                std::printf("Could not read graphic for card %u\n", i + 1);
+                return false;
+            }
+        }
+    }
+
+    const std::vector<WCTPixelCodec::packimpl_t> impls = WCTPixelCodec::PackImplementations();
+
+    std::array<uint8_t, CARDGFX_PIXEL_COUNT> pixels, masked, unpacked;
+    std::array<uint8_t, CARDGFX_READ_SIZEOF> ref, out;
+
+    bool ok = true;
+    for(const WCTPixelCodec::packimpl_t &impl : impls)
+    {
+        bool match = true;
+
+        // random images
+        for(uint32_t n = 0; n < NUMRANDOM && match; n++)
+        {
+            for(uint32_t i = 0; i < CARDGFX_PIXEL_COUNT; i++)
+            {
+                pixels[i] = uint8_t(WCTCounterRNG::At(n, i));
+                masked[i] = pixels[i] & 63;
+            }
+            impls.front().fn(pixels.data(), ref.data());
+            impl.fn(pixels.data(), out.data());
+            WCTPixelCodec::Unpack6bpp(out.data(), unpacked.data());
+            match = (out == ref && unpacked == masked);
+        }
+
+        // real graphics
+        for(size_t c = 0; c < raws.size() && match; c++)
+        {
+            WCTPixelCodec::Unpack6bpp(raws[c].data(), unpacked.data());
+            impl.fn(unpacked.data(), out.data());
+            match = (out == raws[c]);
+        }
+
+        // timing
+        const auto start = std::chrono::steady_clock::now();
+        for(uint32_t n = 0; n < NUMRANDOM; n++)
+            impl.fn(pixels.data(), out.data());
+        const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf(
+            "pack   %-6s: %s | %u random, %zu from ROM | %.2f us/card\n",
+            impl.name, match ? "ok" : "MISMATCH", NUMRANDOM, raws.size(), secs * 1000000.0 / NUMRANDOM
+        );
+        ok = ok && match;
+    }
+    return ok;
+}
+
+//
+// Check that a bulk read of every card picture matches reading each card by
+// itself, and time the two approaches
+//
+static bool SelfTestGallery(FILE *romfile)
+{
+    const uint32_t numcards = WCTUtils::GetNumCards(romfile);
+    if(numcards < 2)
+    {
+        std::puts("gallery: no cards defined in ROM");
+        return false;
+    }
+    const uint32_t numpics = std::min(numcards - 1, WCTCardGallery::MAX_PICTURES);
+
+    auto start = std::chrono::steady_clock::now();
+    WCTCardGallery gallery;
+    const bool read = gallery.ReadFromROM(romfile, 0, numpics);
+    const double gallerysecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if(read == false)
+    {
+        std::puts("gallery: could not read card pictures");
+        return false;
+    }
+
+    start = std::chrono::steady_clock::now();
+    std::vector<WCTCardPic> pics(numpics);
+    bool match = true;
+    for(uint32_t picnum = 0; picnum < numpics && match; picnum++)
+        match = pics[picnum].ReadCardPic(romfile, uint16_t(picnum));
+    const double singlesecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for(uint32_t picnum = 0; picnum < numpics && match; picnum++)
+    {
+        match =
+            pics[picnum].GetPalette() == gallery.GetPalette(picnum) &&
+            std::memcmp(pics[picnum].GetPixels().data(), gallery.GetPixels(picnum), WCTConstants::CARDGFX_PIXEL_COUNT) == 0;
+    }
+
+    std::printf(
+        "gallery     : %s | %u cards in %.1f ms, %.1f ms reading one at a time\n",
+        match ? "ok" : "MISMATCH", numpics, gallerysecs * 1000.0, singlesecs * 1000.0
+    );
+    return match;
+}
+
+//
+// Check every color conversion implementation against the portable one over
+// every 16-bit value and random 8-bit colors, including odd counts and
+// offsets, and time them converting the whole card palette region
+//
+static bool SelfTestColors()
+{
+    using namespace WCTConstants;
+    using WCTColorConvert::Expand;
+
+    constexpr size_t NUMVALUES  = 0x10000;
+    constexpr size_t NUMREGION  = SIZE_ALL_CARDPALETTES_BYTES / sizeof(WCTColor::gbacolor_t);
+    constexpr int    TIMINGREPS = 64;
+    constexpr size_t NUMBUFFER  = std::max(NUMVALUES, NUMREGION);
+
+    // every 16-bit value, repeating to fill out the buffer
+    std::vector<WCTColor::gbacolor_t> colors(NUMBUFFER);
+    for(size_t c = 0; c < NUMBUFFER; c++)
+        colors[c] = WCTColor::gbacolor_t(c);
+
+    std::vector<uint8_t> bytes(NUMBUFFER * 4);
+    for(size_t i = 0; i < bytes.size(); i++)
+        bytes[i] = uint8_t(WCTCounterRNG::At(NUMVALUES, i));
+
+    std::vector<uint8_t>              ref(NUMBUFFER * 4), out(NUMBUFFER * 4);
+    std::vector<WCTColor::gbacolor_t> ref555(NUMBUFFER), out555(NUMBUFFER);
+
+    // time one conversion over the palette region, in ns per color
+    const auto timeit = [] (const auto &fn) {
+        const auto start = std::chrono::steady_clock::now();
+        for(int r = 0; r < TIMINGREPS; r++)
+            fn();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / (double(NUMREGION) * TIMINGREPS);
+    };
+
+    bool ok = true;
+    const std::vector<WCTColorConvert::expandimpl_t> expands = WCTColorConvert::ExpandImplementations();
+    for(const WCTColorConvert::expandimpl_t &impl : expands)
+    {
+        bool match = true;
+        for(Expand expand : { Expand::SHIFT, Expand::REPLICATE })
+        {
+            for(size_t offset : { size_t(0), size_t(1) })
+            {
+                const size_t count = NUMVALUES - offset * 3;
+                expands.front().toRGB(colors.data() + offset, count, expand, ref.data());
+                impl.toRGB(colors.data() + offset, count, expand, out.data());
+                match = match && std::equal(ref.begin(), ref.begin() + count * 3, out.begin());
+
+                expands.front().toRGBA(colors.data() + offset, count, expand, ref.data());
+                impl.toRGBA(colors.data() + offset, count, expand, out.data());
+                match = match && std::equal(ref.begin(), ref.begin() + count * 4, out.begin());
+            }
+        }
+
+        const double rgbns  = timeit([&] { impl.toRGB(colors.data(), NUMREGION, Expand::REPLICATE, out.data()); });
+        const double rgbans = timeit([&] { impl.toRGBA(colors.data(), NUMREGION, Expand::REPLICATE, out.data()); });
+        std::printf(
+            "expand %-6s: %s | %.2f ns/color to RGB, %.2f ns/color to RGBA over %zu palette colors\n",
+            impl.name, match ? "ok" : "MISMATCH", rgbns, rgbans, NUMREGION
+        );
+        ok = ok && match;
+    }
+
+    const std::vector<WCTColorConvert::reduceimpl_t> reduces = WCTColorConvert::ReduceImplementations();
+    for(const WCTColorConvert::reduceimpl_t &impl : reduces)
+    {
+        bool match = true;
+        for(size_t offset : { size_t(0), size_t(1) })
+        {
+            const size_t count = NUMVALUES - offset * 3;
+            reduces.front().fromRGB(bytes.data() + offset, count, ref555.data());
+            impl.fromRGB(bytes.data() + offset, count, out555.data());
+            match = match && std::equal(ref555.begin(), ref555.begin() + count, out555.begin());
+
+            reduces.front().fromRGBA(bytes.data() + offset, count, ref555.data());
+            impl.fromRGBA(bytes.data() + offset, count, out555.data());
+            match = match && std::equal(ref555.begin(), ref555.begin() + count, out555.begin());
+        }
+
+        // expanding and reducing again must give back every RGB555 color
+        for(Expand expand : { Expand::SHIFT, Expand::REPLICATE })
+        {
+            WCTColorConvert::ToRGB(colors.data(), 0x8000, expand, out.data());
+            impl.fromRGB(out.data(), 0x8000, out555.data());
+            match = match && std::equal(colors.begin(), colors.begin() + 0x8000, out555.begin());
+        }
+
+        const double rgbns  = timeit([&] { impl.fromRGB(bytes.data(), NUMREGION, out555.data()); });
+        const double rgbans = timeit([&] { impl.fromRGBA(bytes.data(), NUMREGION, out555.data()); });
+        std::printf(
+            "reduce %-6s: %s | %.2f ns/color from RGB, %.2f ns/color from RGBA over %zu palette colors\n",
+            impl.name, match ? "ok" : "MISMATCH", rgbns, rgbans, NUMREGION
+        );
+        ok = ok && match;
+    }
+
+    return ok;
+}
+
+//
+// Check every upscaling row kernel against the portable one over random
+// images of many widths, drawn from a few colors so that the edge rules
+// all fire, and time each filter and factor over card-sized images
+//
+static bool SelfTestUpscale()
+{
+    using namespace WCTConstants;
+
+    constexpr uint32_t MAXWIDTH  = CARDGFX_FULLWIDTH_PX * 2;
+    constexpr uint32_t NUMTIMED  = 256;
+    constexpr uint32_t MAXFACTOR = WCTUpscale::MAX_FACTOR;
+
+    // three rows of random pixels, from 3 colors
+    std::vector<uint8_t> rows(MAXWIDTH * 3);
+    std::vector<uint8_t> ref(MAXWIDTH * MAXFACTOR * MAXFACTOR), out(ref.size());
+
+    const std::vector<WCTUpscale::impl_t> impls = WCTUpscale::Implementations();
+
+    bool ok = true;
+    for(const WCTUpscale::impl_t &impl : impls)
+    {
+        bool match = true;
+        for(uint32_t width = 1; width <= MAXWIDTH && match; width++)
+        {
+            for(uint32_t n = 0; n < 16 && match; n++)
+            {
+                for(size_t i = 0; i < rows.size(); i++)
+                    rows[i] = uint8_t(WCTCounterRNG::At(width * 16 + n, i) % 3);
+                const uint8_t *const above = rows.data();
+                const uint8_t *const row   = rows.data() + MAXWIDTH;
+                const uint8_t *const below = rows.data() + MAXWIDTH * 2;
+                const size_t         pitch = size_t(width) * MAXFACTOR;
+
+                for(uint32_t factor = WCTUpscale::MIN_FACTOR; factor <= MAXFACTOR; factor++)
+                {
+                    impls.front().nearest(row, width, factor, ref.data());
+                    impl.nearest(row, width, factor, out.data());
+                    match = match && std::equal(ref.begin(), ref.begin() + width * factor, out.begin());
+                }
+
+                impls.front().scale2x(above, row, below, width, ref.data(), ref.data() + pitch);
+                impl.scale2x(above, row, below, width, out.data(), out.data() + pitch);
+                for(uint32_t r = 0; r < 2; r++)
+                    match = match && std::equal(ref.begin() + r * pitch, ref.begin() + r * pitch + width * 2, out.begin() + r * pitch);
+
+                impls.front().scale3x(above, row, below, width, ref.data(), ref.data() + pitch, ref.data() + pitch * 2);
+                impl.scale3x(above, row, below, width, out.data(), out.data() + pitch, out.data() + pitch * 2);
+                for(uint32_t r = 0; r < 3; r++)
+                    match = match && std::equal(ref.begin() + r * pitch, ref.begin() + r * pitch + width * 3, out.begin() + r * pitch);
+            }
+        }
+        std::printf("upscale %-6s: %s | rows of 1-%u pixels\n", impl.name, match ? "ok" : "MISMATCH", MAXWIDTH);
+        ok = ok && match;
+    }
+
+    // timing, with whichever implementation Upscale picked
+    std::vector<uint8_t> card(CARDGFX_PIXEL_COUNT), scaled(size_t(CARDGFX_PIXEL_COUNT) * MAXFACTOR * MAXFACTOR);
+    for(size_t i = 0; i < card.size(); i++)
+        card[i] = uint8_t(WCTCounterRNG::At(MAXWIDTH, i / 4) % CARDPALETTE_NUMENTRIES); // short runs, like real art
+    for(size_t f = 0; f < size_t(WCTUpscale::Filter::NUMFILTERS); f++)
+    {
+        for(uint32_t factor = WCTUpscale::MIN_FACTOR; factor <= MAXFACTOR; factor++)
+        {
+            const WCTUpscale::params_t params { factor, WCTUpscale::Filter(f) };
+            const auto start = std::chrono::steady_clock::now();
+            for(uint32_t n = 0; n < NUMTIMED; n++)
+                WCTUpscale::Upscale(card.data(), CARDGFX_FULLWIDTH_PX, CARDGFX_FULLHEIGHT_PX, params, scaled.data());
+            const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::printf("upscale %-7s %ux: %.2f us/card\n", WCTUpscale::FilterName(params.filter), factor, secs * 1e6 / NUMTIMED);
+        }
+    }
+
+    return ok;
+}
+
+//
+// Check every nearest-color implementation against the portable one over
+// every RGB555 color and random palettes of every size. Then check that
+// quantizing truecolor art which already fits in a palette gives back the
+// same colors, using the ROM's card graphics if a ROM is given, and time the
+// quantizer on smooth gradients which don't fit.
+//
+static bool SelfTestQuantize(FILE *romfile)
+{
+    using namespace WCTConstants;
+    using WCTQuantizer::palette_t;
+
+    constexpr uint32_t NUMCOLORS555 = 0x8000;
+
+    std::vector<WCTColor::gbacolor_t> colors(NUMCOLORS555);
+    for(uint32_t c = 0; c < NUMCOLORS555; c++)
+        colors[c] = WCTColor::gbacolor_t(c);
+
+    const std::vector<WCTQuantizer::nearestimpl_t> impls = WCTQuantizer::NearestImplementations();
+    std::vector<uint8_t> ref(NUMCOLORS555), out(NUMCOLORS555);
+
+    bool ok = true;
+    for(const WCTQuantizer::nearestimpl_t &impl : impls)
+    {
+        bool   match = true;
+        double secs  = 0.0;
+        for(uint32_t numentries = 1; numentries <= CARDPALETTE_NUMENTRIES && match; numentries++)
+        {
+            palette_t palette;
+            for(uint32_t p = 0; p < CARDPALETTE_NUMENTRIES; p++)
+                palette[p] = WCTColor::gbacolor_t(WCTCounterRNG::At(numentries, p) & 0x7FFF);
+
+            impls.front().fn(colors.data(), colors.size(), palette, numentries, ref.data());
+            const auto start = std::chrono::steady_clock::now();
+            impl.fn(colors.data(), colors.size(), palette, numentries, out.data());
+            secs += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            match = (out == ref);
+        }
+        std::printf(
+            "nearest %-6s: %s | %.2f ns/color over 1-%u entry palettes\n",
+            impl.name, match ? "ok" : "MISMATCH", secs * 1e9 / (double(NUMCOLORS555) * CARDPALETTE_NUMENTRIES),
+            CARDPALETTE_NUMENTRIES
+        );
+        ok = ok && match;
+    }
+
+    std::vector<uint8_t> rgb(size_t(CARDGFX_PIXEL_COUNT) * 3);
+    std::array<uint8_t, CARDGFX_PIXEL_COUNT> indices;
+    palette_t palette;
+
+    // card art that already fits must come back out exactly
+    if(romfile != nullptr)
+    {
+        WCTCardGallery gallery;
+        if(ReadAllCards(romfile, 0, gallery) == false)
+            return false;
+
+        bool   match = true;
+        double secs  = 0.0;
+        for(uint32_t picnum = gallery.GetFirst(); picnum < gallery.GetFirst() + gallery.GetCount() && match; picnum++)
+        {
+            const WCTCardGallery::palette_t &pal = gallery.GetPalette(picnum);
+            const uint8_t *const pixels = gallery.GetPixels(picnum);
+            for(uint32_t i = 0; i < CARDGFX_PIXEL_COUNT; i++)
+            {
+                const WCTColor::gbacolor_t color = pal[pixels[i] % CARDPALETTE_NUMENTRIES];
+                rgb[i * 3 + 0] = WCTColor::Expand5To8(WCTColor::R5(color));
+                rgb[i * 3 + 1] = WCTColor::Expand5To8(WCTColor::G5(color));
+                rgb[i * 3 + 2] = WCTColor::Expand5To8(WCTColor::B5(color));
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            WCTQuantizer::Quantize(rgb.data(), CARDGFX_FULLWIDTH_PX, CARDGFX_FULLHEIGHT_PX, WCTQuantizer::Dither::ORDERED, palette, indices.data());
+            secs += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            for(uint32_t i = 0; i < CARDGFX_PIXEL_COUNT && match; i++)
+                match = (palette[indices[i]] == (pal[pixels[i] % CARDPALETTE_NUMENTRIES] & 0x7FFF)); // bit 15 is unused
+        }
+        std::printf(
+            "quantize exact : %s | %u cards from ROM | %.1f us/card\n",
+            match ? "ok" : "MISMATCH", gallery.GetCount(), secs * 1e6 / gallery.GetCount()
+        );
+        ok = ok && match;
+    }
+
+    // smooth gradients with noise have thousands of colors and must be reduced
+    constexpr uint32_t NUMGRADIENTS = 256;
+    for(WCTQuantizer::Dither dither : { WCTQuantizer::Dither::NONE, WCTQuantizer::Dither::ORDERED })
+    {
+        double secs = 0.0, sqerr = 0.0;
+        for(uint32_t n = 0; n < NUMGRADIENTS; n++)
+        {
+            const uint64_t seed = WCTCounterRNG::At(n, 0);
+            for(uint32_t y = 0; y < CARDGFX_FULLHEIGHT_PX; y++)
+            {
+                for(uint32_t x = 0; x < CARDGFX_FULLWIDTH_PX; x++)
+                {
+                    const uint32_t i     = y * CARDGFX_FULLWIDTH_PX + x;
+                    const uint64_t noise = WCTCounterRNG::At(seed, i);
+                    rgb[i * 3 + 0] = uint8_t(x * 255 / CARDGFX_FULLWIDTH_PX  + (seed & 63)         + (noise & 7));
+                    rgb[i * 3 + 1] = uint8_t(y * 255 / CARDGFX_FULLHEIGHT_PX + ((seed >> 8) & 63)  + ((noise >> 8) & 7));
+                    rgb[i * 3 + 2] = uint8_t((x + y) * 128 / CARDGFX_FULLWIDTH_PX + ((seed >> 16) & 63) + ((noise >> 16) & 7));
+                }
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            WCTQuantizer::Quantize(rgb.data(), CARDGFX_FULLWIDTH_PX, CARDGFX_FULLHEIGHT_PX, dither, palette, indices.data());
+            secs += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            for(uint32_t i = 0; i < CARDGFX_PIXEL_COUNT; i++)
+            {
+                const WCTColor::gbacolor_t color = palette[indices[i]];
+                const double dr = double(WCTColor::Expand5To8(WCTColor::R5(color))) - rgb[i * 3 + 0];
+                const double dg = double(WCTColor::Expand5To8(WCTColor::G5(color))) - rgb[i * 3 + 1];
+                const double db = double(WCTColor::Expand5To8(WCTColor::B5(color))) - rgb[i * 3 + 2];
+                sqerr += dr * dr + dg * dg + db * db;
+            }
+        }
+        std::printf(
+            "quantize %-6s: %u gradients | %.1f us/card | RMS error %.2f\n",
+            dither == WCTQuantizer::Dither::NONE ? "plain" : "dither", NUMGRADIENTS, secs * 1e6 / NUMGRADIENTS,
+            std::sqrt(sqerr / (double(NUMGRADIENTS) * CARDGFX_PIXEL_COUNT * 3))
+        );
+    }
+
+    return ok;
+}
+
+//
+// Round-trip every card through each PNG preset and back, checking the
+// pixels and palette survive. After the first pass has sized this thread's
+// PNG arena, no further libpng allocations should have to go to the heap.
+//
+static bool SelfTestPNGRoundTrip(FILE *romfile)
+{
+    using namespace WCTConstants;
+
+    WCTCardGallery gallery;
+    if(ReadAllCards(romfile, 0, gallery) == false)
+        return false;
+
+    const WCTPNGArena &arena = WCTPNGArena::ForThisThread();
+
+    bool ok = true;
+    WCTCardPic thePic, readBack;
+    std::vector<uint8_t> png;
+    for(size_t i = 0; i < size_t(WCTCardPic::PNGPreset::NUMPRESETS); i++)
+    {
+        const WCTCardPic::PNGPreset preset = WCTCardPic::PNGPreset(i);
+
+        bool   match  = true;
+        double secs   = 0.0;
+        size_t spills = 0;
+        for(uint32_t pass = 0; pass < 2 && match; pass++)
+        {
+            const size_t startspills = arena.GetSpills();
+            const auto   start       = std::chrono::steady_clock::now();
+            for(uint32_t picnum = gallery.GetFirst(); picnum < gallery.GetFirst() + gallery.GetCount() && match; picnum++)
+            {
+                gallery.GetCardPic(picnum, thePic);
+                match =
+                    thePic.EncodePNG(png, preset) &&
+                    readBack.ReadFromPNGData(png.data(), png.size()) &&
+                    readBack.GetPixels() == thePic.GetPixels();
+
+                // palette entries come back without the unused top bit
+                for(size_t c = 0; c < CARDPALETTE_NUMENTRIES && match; c++)
+                    match = (readBack.GetPalette()[c] == (thePic.GetPalette()[c] & 0x7FFF));
+            }
+            secs   = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            spills = arena.GetSpills() - startspills;
+        }
+
+        std::printf(
+            "png %-8s: %s | %u cards | %.1f us/card round trip | %zu heap allocations once warm\n",
+            WCTCardPic::PNGPresetName(preset), match ? "ok" : "MISMATCH", gallery.GetCount(),
+            secs * 1e6 / gallery.GetCount(), spills
+        );
+        ok = ok && match && spills == 0;
+    }
+
+    return ok;
+}
+
+//
+// Self-test mode: verify the optimized pixel conversion routines
+//
+static void SelfTest()
+{
+    const EArgManager &args = EArgManager::GetGlobalArgs();
+    const char *const *argv = args.getArgv();
+
+    // a ROM is optional, to add its graphics to the test data
+    const int       romarg = args.getArgParameters("-rom", 1);
+    const EAutoFile upRomFile { romarg != 0 ? std::fopen(argv[romarg], "rb") : nullptr };
+    if(romarg != 0 && upRomFile == nullptr)
+    {
+        std::printf("Could not open file '%s'\n", argv[romarg]);
+        return;
+    }
+
+    bool ok = SelfTestUnpack();
+    ok = SelfTestPack(upRomFile.get()) && ok;
+    if(upRomFile != nullptr)
+        ok = SelfTestGallery(upRomFile.get()) && ok;
+    ok = SelfTestColors() && ok;
+    ok = SelfTestQuantize(upRomFile.get()) && ok;
+    ok = SelfTestUpscale() && ok;
+    if(upRomFile != nullptr)
+        ok = SelfTestPNGRoundTrip(upRomFile.get()) && ok;
+    std::puts(ok ? "All self-tests passed" : "SELF-TEST FAILED");
+}
+
+// 
+// Main routine
+//
+void cardgfxtool_main()
+{
+    // init elib HAL
+    HAL_Init();
+
+    const EArgManager &args = EArgManager::GetGlobalArgs();
+
+    if(args.findArgument("-dump") == true)
+    {
+        // dump mode
+        DumpCardPics();
+    }
+    else if(args.findArgument("-generate") == true)
+    {
+        // generate mode
+        GenerateCardPics();
+    }
+    else if(args.findArgument("-inject") == true)
+    {
+        // pack PNGs straight into the ROM
+        InjectCardPics();
+    }
+    else if(args.findArgument("-atlas") == true)
+    {
+        // atlas mode
+        WriteAtlas();
+    }
+    else if(args.findArgument("-analyze") == true)
+    {
+        // report duplicated graphics data
+        AnalyzeCardPics();
+    }
+    else if(args.findArgument("-verify") == true)
+    {
+        // check every card round-trips exactly
+        VerifyCardPics();
+    }
+    else if(args.findArgument("-benchpng") == true)
+    {
+        // compare PNG encoding presets
+        BenchPNG();
+    }
+    else if(args.findArgument("-selftest") == true)
+    {
+        // verify optimized code paths
+        SelfTest();
     }
     else
     {
-        std::puts("Supported modes are -dump or -generate\n");
+        std::puts("Supported modes are -dump, -generate, -inject, -atlas, -analyze, -verify, -benchpng, or -selftest\n");
     }
 }
 
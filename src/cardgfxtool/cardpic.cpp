@@ -17,44 +17,20 @@
 
 #include <algorithm>
 #include "png.h"
+#include "zlib.h"
 
 #include "elib/elib.h"
 #include "elib/misc.h"
 #include "elib/qstring.h"
 #include "cardpic.h"
+#include "colorconvert.h"
+#include "pixelcodec.h"
+#include "pngarena.h"
+#include "pngautorelease.h"
+#include "quantizer.h"
 #include "../common/colors.h"
 #include "../common/romfile.h"
 
-//
-// Automatically releases libpng resources at scope exit
-//
-class WCTPNGAutoRelease final
-{
-public:
-    enum class Mode
-    {
-        WRITE,
-        READ
-    };
-
-    explicit WCTPNGAutoRelease(png_structp p, Mode mode = Mode::WRITE) : m_pngptr(p), m_mode(mode) {}
-
-    ~WCTPNGAutoRelease()
-    {
-        if(m_mode == Mode::READ)
-            png_destroy_read_struct(&m_pngptr, &m_infoptr, nullptr);
-        else
-            png_destroy_write_struct(&m_pngptr, &m_infoptr);
-    }
-
-    void SetInfoPtr(png_infop info) { m_infoptr = info; }
-
-private:
-    png_structp m_pngptr  = nullptr;
-    png_infop   m_infoptr = nullptr;
-    Mode        m_mode    = Mode::WRITE;
-};
-
 //
 // Translate GBA color palette to PNG
 //
@@ -64,16 +40,8 @@ static void TranslatePalette(png_colorp outcolors, const WCTCardPic::palette_t &
     std::memset(outcolors, 0, PNG_MAX_PALETTE_LENGTH * sizeof(png_color));
 
     // translate entries from GBA palette RGB555 values
-    for(WCTColor::gbacolor_t gbacol : incolors)
-    {
-        png_color &outcol = *outcolors;
-
-        outcol.red   = WCTColor::Expand5To8(WCTColor::R5(gbacol));
-        outcol.green = WCTColor::Expand5To8(WCTColor::G5(gbacol));
-        outcol.blue  = WCTColor::Expand5To8(WCTColor::B5(gbacol));
-
-        ++outcolors;
-    }
+    static_assert(sizeof(png_color) == 3);
+    WCTColorConvert::ToRGB(incolors.data(), incolors.size(), WCTColorConvert::Expand::REPLICATE, reinterpret_cast<uint8_t *>(outcolors));
 }
 
 //
@@ -81,60 +49,7 @@ static void TranslatePalette(png_colorp outcolors, const WCTCardPic::palette_t &
 //
 void WCTCardPic::UnpackPixels()
 {
-    const uint16_t *src  = reinterpret_cast<uint16_t *>(m_rawdata.data());
-    uint8_t *const  base = m_pixels.data();
-
-    constexpr uint32_t tilepitch = (WCTConstants::CARDGFX_TILE_HEIGHT_PX * WCTConstants::CARDGFX_FULLWIDTH_PX);
-
-    for(uint32_t ty = 0; ty < WCTConstants::CARDGFX_TILEMAP_HEIGHT; ty++)
-    {
-        for(uint32_t tx = 0; tx < WCTConstants::CARDGFX_TILEMAP_WIDTH; tx++)
-        {
-            uint8_t  *dst   = base + ty * tilepitch + tx * WCTConstants::CARDGFX_TILE_WIDTH_PX;
-            uint32_t  count = WCTConstants::CARDGFX_TILE_HEIGHT_PX;
-            do
-            {
-                const uint16_t data0 = *src++;
-                const uint16_t data1 = *src++;
-                const uint16_t data2 = *src++;
-
-                *(dst + 0) = uint8_t(data0 & 63);                          // 0:----|------|xxxxxx
-                *(dst + 1) = uint8_t((data0 & 0xFC0) >> 6);                // 0:----|xxxxxx|------
-                *(dst + 2) = uint8_t((data0 >> 12) | ((data1 & 3) << 4));  // 0:xxxx|------|------  + 1:--|------|------|xx
-                *(dst + 3) = uint8_t((data1 & 0xFC) >> 2);                 // 1:--|------|xxxxxx|--
-                *(dst + 4) = uint8_t((data1 >> 8) & 63);                   // 1:--|xxxxxx|------|--
-                *(dst + 5) = uint8_t((data1 >> 14) | ((data2 & 15) << 2)); // 1:xx|------|------|-- + 2:------|------|xxxx
-                *(dst + 6) = uint8_t((data2 >> 4) & 63);                   // 2:------|xxxxxx|----
-                *(dst + 7) = uint8_t((data2 & 0xFC00) >> 10);              // 2:xxxxxx|------|----
-
-                dst += WCTConstants::CARDGFX_FULLWIDTH_PX;
-            }
-            while(--count != 0);
-        }
-    }
-
-    // if we had tile memory like on GBA, you could just do this...
-#if 0
-    uint32_t count = WCTConstants::CARDGFX_READ_SIZEOF / (2 * 3);
-    do
-    {
-        const uint16_t data0 = *src++;
-        const uint16_t data1 = *src++;
-        const uint16_t data2 = *src++;
-
-        uint8_t *dst = base;
-
-        *dst++ = uint8_t(data0 & 63);
-        *dst++ = uint8_t((data0 & 0xFC0) >> 6);
-        *dst++ = uint8_t((data0 >> 12) | ((data1 & 3) << 4));
-        *dst++ = uint8_t((data1 & 0xFC) >> 2);
-        *dst++ = uint8_t((data1 >> 8) & 63);
-        *dst++ = uint8_t((data1 >> 14) | ((data2 & 15) << 2));
-        *dst++ = uint8_t((data2 >> 4) & 63);
-        *dst++ = uint8_t((data2 & 0xFC00) >> 10);
-    }
-    while(--count != 0);
-#endif
+    WCTPixelCodec::Unpack6bpp(m_rawdata.data(), m_pixels.data());
 }
 
 //
@@ -161,17 +76,105 @@ bool WCTCardPic::ReadCardPic(FILE *f, uint16_t cardnum)
 }
 
 //
-// Write the card graphic out as a PNG
+// Store the card picture into a ROM image in memory
 //
-bool WCTCardPic::WriteToPNG(const char *filename) const
+bool WCTCardPic::WriteToROMImage(uint8_t *rom, size_t romsize, uint16_t picnum) const
 {
-    // open file for output
-    const EAutoFile upFile { std::fopen(filename, "wb") };
-    if(upFile == nullptr)
+    if(rom == nullptr)
         return false;
 
-    // create write struct
-    png_structp pngptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    // both must fit in their regions as well as in the image
+    const uint32_t paletteoffset = WCTConstants::OFFS_CARDPALETTES_START + (picnum * WCTConstants::CARDPALETTE_READ_SIZEOF);
+    const uint32_t gfxoffset     = WCTConstants::OFFS_CARDGFX_START + (picnum * WCTConstants::CARDGFX_READ_SIZEOF);
+    if(paletteoffset + WCTConstants::CARDPALETTE_READ_SIZEOF > WCTConstants::OFFS_CARDPALETTES_END ||
+       gfxoffset + WCTConstants::CARDGFX_READ_SIZEOF > WCTConstants::OFFS_CARDGFX_END ||
+       WCTConstants::OFFS_CARDGFX_END > romsize)
+    {
+        return false;
+    }
+
+    std::memcpy(rom + paletteoffset, m_palette.data(), WCTConstants::CARDPALETTE_READ_SIZEOF);
+    std::memcpy(rom + gfxoffset, m_rawdata.data(), m_rawdata.size());
+    return true;
+}
+
+//
+// Set up from graphics already read and decoded elsewhere
+//
+void WCTCardPic::SetPicture(const palette_t &palette, const pixel_t *rawdata, const pixel_t *pixels)
+{
+    m_palette = palette;
+    std::memcpy(m_rawdata.data(), rawdata, m_rawdata.size());
+    std::memcpy(m_pixels.data(), pixels, m_pixels.size());
+}
+
+//
+// Settings for one attempt at encoding a PNG
+//
+struct pngsettings_t
+{
+    int filters;     // PNG_FILTER_* mask
+    int level;       // zlib compression level
+    int strategy;    // zlib strategy
+    int numcolors;   // entries written to PLTE
+};
+
+static const char *const pngPresetNames[size_t(WCTCardPic::PNGPreset::NUMPRESETS)] =
+{
+    "fastest",
+    "balanced",
+    "smallest"
+};
+static_assert(std::size(pngPresetNames) == size_t(WCTCardPic::PNGPreset::NUMPRESETS));
+
+//
+// Get the name of a PNG preset
+//
+const char *WCTCardPic::PNGPresetName(PNGPreset preset)
+{
+    return size_t(preset) < std::size(pngPresetNames) ? pngPresetNames[size_t(preset)] : "";
+}
+
+//
+// Look up a PNG preset by name
+//
+bool WCTCardPic::PNGPresetForName(const char *name, PNGPreset &preset)
+{
+    for(size_t i = 0; i < std::size(pngPresetNames); i++)
+    {
+        if(strcasecmp(name, pngPresetNames[i]) == 0)
+        {
+            preset = PNGPreset(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// libpng output callback that appends to a vector
+//
+static void PNGWriteToVector(png_structp pngptr, png_bytep data, png_size_t length)
+{
+    auto *const out = static_cast<std::vector<uint8_t> *>(png_get_io_ptr(pngptr));
+    out->insert(out->end(), data, data + length);
+}
+
+static void PNGFlushNothing(png_structp)
+{
+}
+
+//
+// Encode pixels and palette as a PNG with the given settings, appending to out.
+// A null settings pointer leaves libpng's defaults alone.
+//
+static bool EncodePNGWith(
+    std::vector<uint8_t> &out, const WCTCardPic::pixel_t *pixels, uint32_t width, uint32_t height,
+    const WCTCardPic::palette_t &gbapalette, const pngsettings_t *settings
+)
+{
+    // create write struct, with memory from this thread's arena
+    png_structp pngptr = WCTPNGArena::ForThisThread().CreateWriteStruct();
     if(pngptr == nullptr)
         return false;
     WCTPNGAutoRelease cRel { pngptr };
@@ -182,25 +185,30 @@ bool WCTCardPic::WriteToPNG(const char *filename) const
         return false;
     cRel.SetInfoPtr(infoptr);
 
-    // translate palette
-    static png_color palette[PNG_MAX_PALETTE_LENGTH];
-    TranslatePalette(palette, m_palette);
-
-    // setup row pointers
-    std::array<png_const_bytep, WCTConstants::CARDGFX_FULLHEIGHT_PX> rowptrs;
-    for(euint k = 0; k < WCTConstants::CARDGFX_FULLHEIGHT_PX; k++)
-        rowptrs[k] = m_pixels.data() + k * WCTConstants::CARDGFX_FULLWIDTH_PX;
+    // translate palette; kept local so that cards can be encoded concurrently
+    png_color palette[PNG_MAX_PALETTE_LENGTH];
+    TranslatePalette(palette, gbapalette);
+    const int numcolors = settings != nullptr ? settings->numcolors : PNG_MAX_PALETTE_LENGTH;
 
     // setup error handling - no C++ objects in this scope!
     if(setjmp(png_jmpbuf(pngptr)) == 0)
     {
         // init output
-        png_init_io(pngptr, upFile.get());
-        
+        png_set_write_fn(pngptr, &out, PNGWriteToVector, PNGFlushNothing);
+
+        // set compression parameters
+        if(settings != nullptr)
+        {
+            png_set_filter(pngptr, PNG_FILTER_TYPE_BASE, settings->filters);
+            png_set_compression_level(pngptr, settings->level);
+            png_set_compression_strategy(pngptr, settings->strategy);
+            png_set_compression_mem_level(pngptr, MAX_MEM_LEVEL);
+        }
+
         // set IHDR information
         png_set_IHDR(
             pngptr, infoptr, 
-            WCTConstants::CARDGFX_FULLWIDTH_PX, WCTConstants::CARDGFX_FULLHEIGHT_PX, 
+            width, height, 
             8,
             PNG_COLOR_TYPE_PALETTE,
             PNG_INTERLACE_NONE,
@@ -209,14 +217,14 @@ bool WCTCardPic::WriteToPNG(const char *filename) const
         );
         
         // set palette
-        png_set_PLTE(pngptr, infoptr, palette, PNG_MAX_PALETTE_LENGTH);
+        png_set_PLTE(pngptr, infoptr, palette, numcolors);
         
         // write header info
         png_write_info(pngptr, infoptr);
         
-        // write image data
-        for(png_const_bytep row : rowptrs)
-            png_write_row(pngptr, row);
+        // write image data, a row at a time straight from the pixels
+        for(euint row = 0; row < height; row++)
+            png_write_row(pngptr, pixels + size_t(row) * width);
         
         // finish write
         png_write_end(pngptr, infoptr);
@@ -231,58 +239,455 @@ bool WCTCardPic::WriteToPNG(const char *filename) const
 }
 
 //
-// Translate PNG color palette to GBA
+// Encode the card graphic as a PNG into memory
 //
-static void TranslatePaletteReverse(WCTCardPic::palette_t &outcolors, png_const_colorp incolors, int numcolors)
+bool WCTCardPic::EncodePNG(std::vector<uint8_t> &out, PNGPreset preset) const
 {
-    outcolors.fill(0);
-    const size_t len = std::min<>(outcolors.size(), size_t(numcolors));
-    for(size_t i = 0; i < len; i++)
-        outcolors[i] = WCTColor::RGBToRGB555(incolors[i].red, incolors[i].green, incolors[i].blue);
+    return EncodePNGOf(out, preset, m_pixels.data(), WCTConstants::CARDGFX_FULLWIDTH_PX, WCTConstants::CARDGFX_FULLHEIGHT_PX);
 }
 
 //
-// Pack linear 8-bit image into 6bpp tiled data
+// Encode pixels with the card's palette as a PNG into memory
 //
-void WCTCardPic::PackPixels()
+bool WCTCardPic::EncodePNGOf(std::vector<uint8_t> &out, PNGPreset preset, const pixel_t *pixels, uint32_t width, uint32_t height) const
 {
-    uint16_t             *dst  = reinterpret_cast<uint16_t *>(m_rawdata.data());
-    const uint8_t *const  base = m_pixels.data();
+    static_assert(WCTConstants::CARDPALETTE_NUMENTRIES == 1u << WCTConstants::CARDGFX_BPP);
+    constexpr int NUMCOLORS = int(WCTConstants::CARDPALETTE_NUMENTRIES); // pixels never exceed the 6bpp range
 
-    constexpr uint32_t tilepitch = (WCTConstants::CARDGFX_TILE_HEIGHT_PX * WCTConstants::CARDGFX_FULLWIDTH_PX);
+    out.clear();
 
-    for(uint32_t ty = 0; ty < WCTConstants::CARDGFX_TILEMAP_HEIGHT; ty++)
+    switch(preset)
     {
-        for(uint32_t tx = 0; tx < WCTConstants::CARDGFX_TILEMAP_WIDTH; tx++)
+    case PNGPreset::FASTEST:
         {
-            const uint8_t *src   = base + ty * tilepitch + tx * WCTConstants::CARDGFX_TILE_WIDTH_PX;
-            uint32_t       count = WCTConstants::CARDGFX_TILE_HEIGHT_PX;
-            do
+            const pngsettings_t settings { PNG_FILTER_NONE, 1, Z_DEFAULT_STRATEGY, NUMCOLORS };
+            return EncodePNGWith(out, pixels, width, height, m_palette, &settings);
+        }
+    case PNGPreset::BALANCED:
+        return EncodePNGWith(out, pixels, width, height, m_palette, nullptr);
+    case PNGPreset::SMALLEST:
+        {
+            static constexpr int filterchoices[] =
+            {
+                PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH, PNG_ALL_FILTERS
+            };
+            static constexpr int strategychoices[] = { Z_DEFAULT_STRATEGY, Z_FILTERED, Z_RLE };
+
+            // keep whichever combination comes out smallest; the attempt
+            // buffer is kept per thread so it doesn't need reallocating
+            thread_local std::vector<uint8_t> attempt;
+            for(int filters : filterchoices)
             {
-                // pack 8 pixels into 3 words
-                *dst++ =  (src[0] & 63)       | (uint16_t(src[1] & 63) << 6) | (uint16_t(src[2] & 15) << 12);
-                *dst++ = ((src[2] & 48) >> 4) | (uint16_t(src[3] & 63) << 2) | (uint16_t(src[4] & 63) <<  8) | (uint16_t(src[5] & 3) << 14);
-                *dst++ = ((src[5] & 60) >> 2) | (uint16_t(src[6] & 63) << 4) | (uint16_t(src[7] & 63) << 10);
+                for(int strategy : strategychoices)
+                {
+                    const pngsettings_t settings { filters, Z_BEST_COMPRESSION, strategy, NUMCOLORS };
+                    attempt.clear();
+                    if(EncodePNGWith(attempt, pixels, width, height, m_palette, &settings) == false)
+                        return false;
+                    if(out.empty() || attempt.size() < out.size())
+                        out.swap(attempt);
+                }
+            }
+            return true;
+        }
+    default:
+        return false;
+    }
+}
 
-                src += WCTConstants::CARDGFX_FULLWIDTH_PX;
+//
+// Write the card graphic out as a PNG
+//
+bool WCTCardPic::WriteToPNG(const char *filename, PNGPreset preset) const
+{
+    std::vector<uint8_t> out;
+    if(EncodePNG(out, preset) == false)
+        return false;
+
+    return M_WriteFile(filename, out.data(), out.size()) != 0;
+}
+
+static const char *const imageFormatNames[size_t(WCTCardPic::ImageFormat::NUMFORMATS)] =
+{
+    "png",
+    "indexed",
+    "rgba",
+    "ppm",
+    "qoi"
+};
+static_assert(std::size(imageFormatNames) == size_t(WCTCardPic::ImageFormat::NUMFORMATS));
+
+static const char *const imageFormatExtensions[size_t(WCTCardPic::ImageFormat::NUMFORMATS)] =
+{
+    ".png",
+    ".idx",
+    ".rgba",
+    ".ppm",
+    ".qoi"
+};
+static_assert(std::size(imageFormatExtensions) == size_t(WCTCardPic::ImageFormat::NUMFORMATS));
+
+//
+// Get the name of an image format
+//
+const char *WCTCardPic::ImageFormatName(ImageFormat fmt)
+{
+    return size_t(fmt) < std::size(imageFormatNames) ? imageFormatNames[size_t(fmt)] : "";
+}
+
+//
+// Get the file extension for an image format, including the dot
+//
+const char *WCTCardPic::ImageFormatExtension(ImageFormat fmt)
+{
+    return size_t(fmt) < std::size(imageFormatExtensions) ? imageFormatExtensions[size_t(fmt)] : "";
+}
+
+//
+// Look up an image format by name
+//
+bool WCTCardPic::ImageFormatForName(const char *name, ImageFormat &fmt)
+{
+    for(size_t i = 0; i < std::size(imageFormatNames); i++)
+    {
+        if(strcasecmp(name, imageFormatNames[i]) == 0)
+        {
+            fmt = ImageFormat(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// Translate the GBA palette to opaque RGBA, as the PNG palette does
+//
+void WCTCardPic::ExpandPalette(rgbapalette_t &rgba) const
+{
+    static_assert(sizeof(rgba) == WCTConstants::CARDPALETTE_NUMENTRIES * 4);
+    WCTColorConvert::ToRGBA(m_palette.data(), m_palette.size(), WCTColorConvert::Expand::REPLICATE, rgba[0].data());
+}
+
+//
+// Indexed: the palette as 64 RGBA entries, then the pixels as palette indices
+//
+void WCTCardPic::EncodeIndexed(std::vector<uint8_t> &out, const pixel_t *pixels, uint32_t width, uint32_t height) const
+{
+    rgbapalette_t rgba;
+    ExpandPalette(rgba);
+
+    const size_t numpixels = size_t(width) * height;
+    out.resize(sizeof(rgba) + numpixels);
+    std::memcpy(out.data(), rgba.data(), sizeof(rgba));
+    std::memcpy(out.data() + sizeof(rgba), pixels, numpixels);
+}
+
+//
+// RGBA: 4 bytes per pixel, rows top to bottom
+//
+void WCTCardPic::EncodeRGBA(std::vector<uint8_t> &out, const pixel_t *pixels, uint32_t width, uint32_t height) const
+{
+    rgbapalette_t rgba;
+    ExpandPalette(rgba);
+
+    const size_t numpixels = size_t(width) * height;
+    out.resize(numpixels * 4);
+    uint8_t *dst = out.data();
+    for(size_t i = 0; i < numpixels; i++)
+    {
+        std::memcpy(dst, rgba[pixels[i] % WCTConstants::CARDPALETTE_NUMENTRIES].data(), 4);
+        dst += 4;
+    }
+}
+
+//
+// PPM: a short text header, then 3 bytes per pixel
+//
+void WCTCardPic::EncodePPM(std::vector<uint8_t> &out, const pixel_t *pixels, uint32_t width, uint32_t height) const
+{
+    rgbapalette_t rgba;
+    ExpandPalette(rgba);
+
+    char header[32];
+    const int headerlen = std::snprintf(header, sizeof(header), "P6\n%u %u\n255\n", width, height);
+
+    const size_t numpixels = size_t(width) * height;
+    out.resize(size_t(headerlen) + numpixels * 3);
+    std::memcpy(out.data(), header, size_t(headerlen));
+    uint8_t *dst = out.data() + headerlen;
+    for(size_t i = 0; i < numpixels; i++)
+    {
+        std::memcpy(dst, rgba[pixels[i] % WCTConstants::CARDPALETTE_NUMENTRIES].data(), 3);
+        dst += 3;
+    }
+}
+
+//
+// QOI: see https://qoiformat.org/qoi-specification.pdf. Every pixel is
+// opaque, so alpha never changes and the RGBA ops are never needed.
+//
+void WCTCardPic::EncodeQOI(std::vector<uint8_t> &out, const pixel_t *pixels, uint32_t width, uint32_t height) const
+{
+    enum : uint8_t
+    {
+        QOI_OP_INDEX = 0x00,
+        QOI_OP_DIFF  = 0x40,
+        QOI_OP_LUMA  = 0x80,
+        QOI_OP_RUN   = 0xC0,
+        QOI_OP_RGB   = 0xFE
+    };
+    constexpr int MAXRUN = 62;
+
+    rgbapalette_t rgba;
+    ExpandPalette(rgba);
+
+    // worst case is a tag and three bytes for every pixel
+    const size_t numpixels = size_t(width) * height;
+    out.resize(14 + numpixels * 4 + 8);
+    uint8_t *dst = out.data();
+
+    const auto put32 = [&dst] (uint32_t v) {
+        *dst++ = uint8_t(v >> 24);
+        *dst++ = uint8_t(v >> 16);
+        *dst++ = uint8_t(v >> 8);
+        *dst++ = uint8_t(v);
+    };
+
+    // header
+    std::memcpy(dst, "qoif", 4);
+    dst += 4;
+    put32(width);
+    put32(height);
+    *dst++ = 3; // RGB
+    *dst++ = 0; // sRGB
+
+    std::array<std::array<uint8_t, 4>, 64> seen {};
+    std::array<uint8_t, 4> prev { 0, 0, 0, 0xFF };
+    int run = 0;
+    for(size_t i = 0; i < numpixels; i++)
+    {
+        const std::array<uint8_t, 4> &px = rgba[pixels[i] % WCTConstants::CARDPALETTE_NUMENTRIES];
+        if(px == prev)
+        {
+            if(++run == MAXRUN || i + 1 == numpixels)
+            {
+                *dst++ = uint8_t(QOI_OP_RUN | (run - 1));
+                run = 0;
             }
-            while(--count != 0);
+            continue;
         }
+        if(run != 0)
+        {
+            *dst++ = uint8_t(QOI_OP_RUN | (run - 1));
+            run = 0;
+        }
+
+        const size_t hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % seen.size();
+        if(seen[hash] == px)
+        {
+            *dst++ = uint8_t(QOI_OP_INDEX | hash);
+        }
+        else
+        {
+            seen[hash] = px;
+
+            const int dr = int8_t(px[0] - prev[0]);
+            const int dg = int8_t(px[1] - prev[1]);
+            const int db = int8_t(px[2] - prev[2]);
+            const int dgr = dr - dg;
+            const int dgb = db - dg;
+            if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+            {
+                *dst++ = uint8_t(QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+            }
+            else if(dg >= -32 && dg <= 31 && dgr >= -8 && dgr <= 7 && dgb >= -8 && dgb <= 7)
+            {
+                *dst++ = uint8_t(QOI_OP_LUMA | (dg + 32));
+                *dst++ = uint8_t(((dgr + 8) << 4) | (dgb + 8));
+            }
+            else
+            {
+                *dst++ = QOI_OP_RGB;
+                *dst++ = px[0];
+                *dst++ = px[1];
+                *dst++ = px[2];
+            }
+        }
+        prev = px;
+    }
+
+    // end marker
+    static constexpr uint8_t padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    std::memcpy(dst, padding, sizeof(padding));
+    dst += sizeof(padding);
+
+    out.resize(size_t(dst - out.data()));
+}
+
+//
+// Encode the card graphic into memory in any format
+//
+bool WCTCardPic::EncodeImage(std::vector<uint8_t> &out, ImageFormat fmt, PNGPreset preset) const
+{
+    return EncodeImageOf(out, fmt, preset, m_pixels.data(), WCTConstants::CARDGFX_FULLWIDTH_PX, WCTConstants::CARDGFX_FULLHEIGHT_PX);
+}
+
+//
+// Encode pixels with the card's palette into memory in any format
+//
+bool WCTCardPic::EncodeImageOf(std::vector<uint8_t> &out, ImageFormat fmt, PNGPreset preset, const pixel_t *pixels, uint32_t width, uint32_t height) const
+{
+    switch(fmt)
+    {
+    case ImageFormat::PNG:
+        return EncodePNGOf(out, preset, pixels, width, height);
+    case ImageFormat::INDEXED:
+        EncodeIndexed(out, pixels, width, height);
+        return true;
+    case ImageFormat::RGBA:
+        EncodeRGBA(out, pixels, width, height);
+        return true;
+    case ImageFormat::PPM:
+        EncodePPM(out, pixels, width, height);
+        return true;
+    case ImageFormat::QOI:
+        EncodeQOI(out, pixels, width, height);
+        return true;
+    default:
+        return false;
     }
 }
 
+//
+// Encode an upscaled preview of the card graphic into memory in any format.
+// The upscaled pixels go into a buffer kept per thread.
+//
+bool WCTCardPic::EncodeUpscaledImage(std::vector<uint8_t> &out, ImageFormat fmt, PNGPreset preset, const WCTUpscale::params_t &upscale) const
+{
+    using namespace WCTConstants;
+
+    const uint32_t width  = CARDGFX_FULLWIDTH_PX * upscale.factor;
+    const uint32_t height = CARDGFX_FULLHEIGHT_PX * upscale.factor;
+
+    thread_local std::vector<pixel_t> scaled;
+    scaled.resize(size_t(width) * height);
+    if(WCTUpscale::Upscale(m_pixels.data(), CARDGFX_FULLWIDTH_PX, CARDGFX_FULLHEIGHT_PX, upscale, scaled.data()) == false)
+        return false;
+
+    return EncodeImageOf(out, fmt, preset, scaled.data(), width, height);
+}
+
+//
+// Write the card graphic out in any format
+//
+bool WCTCardPic::WriteImage(const char *filename, ImageFormat fmt, PNGPreset preset) const
+{
+    std::vector<uint8_t> out;
+    if(EncodeImage(out, fmt, preset) == false)
+        return false;
+
+    return M_WriteFile(filename, out.data(), out.size()) != 0;
+}
+
+//
+// Translate PNG color palette to GBA
+//
+static void TranslatePaletteReverse(WCTCardPic::palette_t &outcolors, png_const_colorp incolors, int numcolors)
+{
+    outcolors.fill(0);
+    const size_t len = std::min<>(outcolors.size(), size_t(numcolors));
+    WCTColorConvert::FromRGB(reinterpret_cast<const uint8_t *>(incolors), len, outcolors.data());
+}
+
+//
+// Pack linear 8-bit image into 6bpp tiled data
+//
+void WCTCardPic::PackPixels()
+{
+    WCTPixelCodec::Pack6bpp(m_pixels.data(), m_rawdata.data());
+}
+
 //
 // Read in a PNG file
 //
-bool WCTCardPic::ReadFromPNG(const char *filename)
+bool WCTCardPic::ReadFromPNG(const char *filename, WCTQuantizer::Dither dither)
+{
+    std::vector<uint8_t> data;
+    return LoadPNGFile(filename, data) && ReadFromPNGData(data.data(), data.size(), dither);
+}
+
+//
+// Load a whole PNG file into memory
+//
+bool WCTCardPic::LoadPNGFile(const char *filename, std::vector<uint8_t> &data)
 {
-    // open file for input
     const EAutoFile upFile { std::fopen(filename, "rb") };
     if(upFile == nullptr)
         return false;
 
+    const long len = M_FileLength(upFile.get());
+    if(len <= 0)
+        return false;
+    data.resize(size_t(len));
+    return std::fread(data.data(), 1, data.size(), upFile.get()) == data.size();
+}
+
+//
+// Memory source for reading a PNG
+//
+struct pngreadsource_t
+{
+    const uint8_t *data;
+    size_t         remaining;
+};
+
+//
+// libpng input callback that reads from memory
+//
+static void PNGReadFromMemory(png_structp pngptr, png_bytep out, png_size_t length)
+{
+    auto *const src = static_cast<pngreadsource_t *>(png_get_io_ptr(pngptr));
+    if(length > src->remaining)
+        png_error(pngptr, "unexpected end of PNG data");
+    std::memcpy(out, src->data, length);
+    src->data      += length;
+    src->remaining -= length;
+}
+
+//
+// Read in a PNG file already loaded into memory
+//
+bool WCTCardPic::ReadFromPNGData(const uint8_t *data, size_t size, WCTQuantizer::Dither dither)
+{
+    if(DecodePNGData(data, size, dither) == false)
+        return false;
+
+    // translate pixels to 6bpp packed tiles
+    PackPixels();
+    return true;
+}
+
+//
+// Decode a PNG file in memory into the palette and linear pixels only
+//
+bool WCTCardPic::DecodePNGData(const uint8_t *data, size_t size, WCTQuantizer::Dither dither)
+{
+    using namespace WCTConstants;
+
+    // truecolor rows are 8-bit RGB
+    constexpr size_t RGBPITCH = CARDGFX_FULLWIDTH_PX * 3;
+
+    pngreadsource_t source { data, size };
+
+    // paletted rows are decoded straight into m_pixels, and truecolor rows
+    // into the arena's scratch buffer for quantizing
+    WCTPNGArena &arena = WCTPNGArena::ForThisThread();
+    uint8_t *const rgb = arena.Scratch(RGBPITCH * CARDGFX_FULLHEIGHT_PX);
+    if(rgb == nullptr)
+        return false;
+
     // create read struct
-    png_structp pngptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_structp pngptr = arena.CreateReadStruct();
     if(pngptr == nullptr)
         return false;
     WCTPNGAutoRelease cRel { pngptr, WCTPNGAutoRelease::Mode::READ };
@@ -293,51 +698,74 @@ bool WCTCardPic::ReadFromPNG(const char *filename)
         return false;
     cRel.SetInfoPtr(infoptr);
 
+    bool truecolor = false;
+
     // setup error handling - no C++ objects in this scope!
     if(setjmp(png_jmpbuf(pngptr)) == 0)
     {
         // init input
-        png_init_io(pngptr, upFile.get());
-
-        // read image info without any transforms
-        png_read_png(pngptr, infoptr, PNG_TRANSFORM_IDENTITY, nullptr);
+        png_set_read_fn(pngptr, &source, PNGReadFromMemory);
+        png_read_info(pngptr, infoptr);
 
         // format assertions
-        if(png_get_bit_depth(pngptr, infoptr) != 8) // 8bpp only
+        const int bitdepth  = png_get_bit_depth(pngptr, infoptr);
+        const int colortype = png_get_color_type(pngptr, infoptr);
+        if(png_get_image_width(pngptr, infoptr) != CARDGFX_FULLWIDTH_PX) // must be 72px wide
             return false;
-        if(png_get_color_type(pngptr, infoptr) != PNG_COLOR_TYPE_PALETTE) // paletted only
+        if(png_get_image_height(pngptr, infoptr) != CARDGFX_FULLHEIGHT_PX) // must be 80px tall
             return false;
-        if(png_get_image_width(pngptr, infoptr) != WCTConstants::CARDGFX_FULLWIDTH_PX) // must be 72px wide
-            return false;
-        if(png_get_image_height(pngptr, infoptr) != WCTConstants::CARDGFX_FULLHEIGHT_PX) // must be 80px tall
+        if(png_get_interlace_type(pngptr, infoptr) != PNG_INTERLACE_NONE)
             return false;
 
-        // get palette
-        png_colorp pPalette   = nullptr;
-        int        numPalette = 0;
-        png_get_PLTE(pngptr, infoptr, &pPalette, &numPalette);
-        if(pPalette == nullptr) // expecting valid 8bpp palette (only first 64 indices are used)
-            return false;
-
-        // translate to GBA palette format
-        TranslatePaletteReverse(m_palette, pPalette, numPalette);
-
-        // copy pixels to m_pixels
-        png_bytepp rowptrs = png_get_rows(pngptr, infoptr);
-        for(euint row = 0; row < WCTConstants::CARDGFX_FULLHEIGHT_PX; row++)
+        truecolor = (colortype != PNG_COLOR_TYPE_PALETTE);
+        if(truecolor == false)
+        {
+            if(bitdepth != 8) // 8bpp only
+                return false;
+
+            // get palette
+            png_colorp pPalette   = nullptr;
+            int        numPalette = 0;
+            png_get_PLTE(pngptr, infoptr, &pPalette, &numPalette);
+            if(pPalette == nullptr) // expecting valid 8bpp palette (only first 64 indices are used)
+                return false;
+
+            // translate to GBA palette format
+            TranslatePaletteReverse(m_palette, pPalette, numPalette);
+        }
+        else
         {
-            uint8_t *const dst = m_pixels.data() + row * WCTConstants::CARDGFX_FULLWIDTH_PX;
-            std::memcpy(dst, rowptrs[row], WCTConstants::CARDGFX_FULLWIDTH_PX);
+            if(bitdepth != 8 && bitdepth != 16) // 8 or 16 bits per channel only
+                return false;
+
+            // reduce anything else to 8-bit RGB, ignoring alpha; these are only
+            // set up once the image is known not to be paletted, as some of them
+            // would also expand a palette
+            png_set_strip_16(pngptr);
+            png_set_strip_alpha(pngptr);
+            png_set_gray_to_rgb(pngptr);
         }
 
-        // translate pixels to 6bpp packed tiles
-        PackPixels();
+        png_read_update_info(pngptr, infoptr);
+        const size_t pitch = truecolor ? RGBPITCH : CARDGFX_FULLWIDTH_PX;
+        if(png_get_rowbytes(pngptr, infoptr) != pitch)
+            return false;
+
+        // read image data a row at a time
+        uint8_t *const dst = truecolor ? rgb : m_pixels.data();
+        for(euint row = 0; row < CARDGFX_FULLHEIGHT_PX; row++)
+            png_read_row(pngptr, dst + row * pitch, nullptr);
+        png_read_end(pngptr, nullptr);
     }
     else
     {
         return false;
     }
 
+    // reduce truecolor art to a palette
+    if(truecolor)
+        WCTQuantizer::Quantize(rgb, CARDGFX_FULLWIDTH_PX, CARDGFX_FULLHEIGHT_PX, dither, m_palette, m_pixels.data());
+
     // done
     return true;
 }
@@ -18,8 +18,11 @@
 #pragma once
 
 #include <array>
+#include <vector>
 #include "../common/colors.h"
 #include "../common/romoffsets.h"
+#include "quantizer.h"
+#include "upscale.h"
 
 class WCTCardPic final
 {
@@ -33,22 +36,97 @@ public:
     // Read in a card picture from the ROM file
     bool ReadCardPic(FILE *f, uint16_t cardnum);
 
+    // Set up from graphics already read and decoded elsewhere
+    void SetPicture(const palette_t &palette, const pixel_t *rawdata, const pixel_t *pixels);
+
+    const palette_t &GetPalette() const { return m_palette; }
+    const pixels_t  &GetPixels()  const { return m_pixels;  }
+    const rawdata_t &GetRawData() const { return m_rawdata; }
+
+    // PNG encoding tradeoffs, from fastest to smallest output
+    enum class PNGPreset
+    {
+        FASTEST,  // no filtering, zlib level 1, 64-entry palette
+        BALANCED, // libpng's default filter heuristics and zlib settings
+        SMALLEST, // best result of trying every filter and zlib strategy, 64-entry palette
+        NUMPRESETS
+    };
+
+    static const char *PNGPresetName(PNGPreset preset);
+    static bool PNGPresetForName(const char *name, PNGPreset &preset);
+
+    // Encode the card graphic as a PNG into memory
+    bool EncodePNG(std::vector<uint8_t> &out, PNGPreset preset = PNGPreset::BALANCED) const;
+
     // Write the card graphic out as a PNG
-    bool WriteToPNG(const char *filename) const;
+    bool WriteToPNG(const char *filename, PNGPreset preset = PNGPreset::BALANCED) const;
+
+    // Output file formats. Everything but PNG skips deflate, for tools that
+    // only want the pixels back.
+    enum class ImageFormat
+    {
+        PNG,     // paletted PNG, per the PNG preset
+        INDEXED, // 64 RGBA palette entries, then one palette index per pixel
+        RGBA,    // 8-bit RGBA pixels, no header
+        PPM,     // binary PPM (P6)
+        QOI,     // "Quite OK Image" format, RGB
+        NUMFORMATS
+    };
+
+    static const char *ImageFormatName(ImageFormat fmt);
+    static const char *ImageFormatExtension(ImageFormat fmt);
+    static bool ImageFormatForName(const char *name, ImageFormat &fmt);
+
+    // Encode the card graphic into memory in any format
+    bool EncodeImage(std::vector<uint8_t> &out, ImageFormat fmt, PNGPreset preset = PNGPreset::BALANCED) const;
+
+    // Write the card graphic out in any format
+    bool WriteImage(const char *filename, ImageFormat fmt, PNGPreset preset = PNGPreset::BALANCED) const;
 
-    // Read in a PNG file
-    bool ReadFromPNG(const char *filename);
+    // Encode an upscaled preview of the card graphic into memory in any
+    // format. Fails if the upscale parameters are unsupported.
+    bool EncodeUpscaledImage(std::vector<uint8_t> &out, ImageFormat fmt, PNGPreset preset, const WCTUpscale::params_t &upscale) const;
+
+    // Read in a PNG file. Either an 8-bit paletted image, whose palette and
+    // indices are used as they are, or truecolor art, which is quantized.
+    bool ReadFromPNG(const char *filename, WCTQuantizer::Dither dither = WCTQuantizer::Dither::NONE);
+
+    // Read in a PNG file already loaded into memory
+    bool ReadFromPNGData(const uint8_t *data, size_t size, WCTQuantizer::Dither dither = WCTQuantizer::Dither::NONE);
+
+    // Load a whole PNG file into memory, for ReadFromPNGData
+    static bool LoadPNGFile(const char *filename, std::vector<uint8_t> &data);
+
+    // The two halves of ReadFromPNGData, for callers that time them separately:
+    // decode a PNG into the palette and linear pixels, then pack the pixels
+    bool DecodePNGData(const uint8_t *data, size_t size, WCTQuantizer::Dither dither = WCTQuantizer::Dither::NONE);
+    void PackPixels();
 
     // Write raw GBA data to a pair of files (.pix and .pal)
     bool WriteGBAData(const char *basefilename) const;
 
+    // Store the palette and tile data into a ROM image held in memory, at the
+    // slot for the given picture number
+    bool WriteToROMImage(uint8_t *rom, size_t romsize, uint16_t picnum) const;
+
 private:
     rawdata_t m_rawdata;
     palette_t m_palette;
     pixels_t  m_pixels;
 
     void UnpackPixels();
-    void PackPixels();
+
+    using rgbapalette_t = std::array<std::array<uint8_t, 4>, WCTConstants::CARDPALETTE_NUMENTRIES>;
+    void ExpandPalette(rgbapalette_t &rgba) const;
+
+    // Encoders for the card's palette with any pixels, so that previews can
+    // be bigger than the card graphic
+    bool EncodeImageOf(std::vector<uint8_t> &out, ImageFormat fmt, PNGPreset preset, const pixel_t *pixels, uint32_t width, uint32_t height) const;
+    bool EncodePNGOf(std::vector<uint8_t> &out, PNGPreset preset, const pixel_t *pixels, uint32_t width, uint32_t height) const;
+    void EncodeIndexed(std::vector<uint8_t> &out, const pixel_t *pixels, uint32_t width, uint32_t height) const;
+    void EncodeRGBA(std::vector<uint8_t> &out, const pixel_t *pixels, uint32_t width, uint32_t height) const;
+    void EncodePPM(std::vector<uint8_t> &out, const pixel_t *pixels, uint32_t width, uint32_t height) const;
+    void EncodeQOI(std::vector<uint8_t> &out, const pixel_t *pixels, uint32_t width, uint32_t height) const;
 
     bool WritePixels(const char *basefilename) const;
     bool WritePalette(const char *basefilename) const;
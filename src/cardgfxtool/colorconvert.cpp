@@ -0,0 +1,347 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <array>
+#include <memory>
+
+#include "elib/elib.h"
+#include "../common/cpufeatures.h"
+#include "colorconvert.h"
+
+#if WCT_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using WCTColor::gbacolor_t;
+using WCTColorConvert::Expand;
+
+//=============================================================================
+// Portable implementation
+//=============================================================================
+
+//
+// Widen one 5-bit component
+//
+static inline uint8_t Widen(uint8_t component, Expand expand)
+{
+    return expand == Expand::REPLICATE ? WCTColor::Expand5To8(component) : uint8_t(component << 3);
+}
+
+//
+// RGB555 to RGB triples
+//
+static void ToRGBScalar(const gbacolor_t *src, size_t count, Expand expand, uint8_t *dst)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        dst[i * 3 + 0] = Widen(WCTColor::R5(src[i]), expand);
+        dst[i * 3 + 1] = Widen(WCTColor::G5(src[i]), expand);
+        dst[i * 3 + 2] = Widen(WCTColor::B5(src[i]), expand);
+    }
+}
+
+//
+// RGB555 to opaque RGBA quads
+//
+static void ToRGBAScalar(const gbacolor_t *src, size_t count, Expand expand, uint8_t *dst)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        dst[i * 4 + 0] = Widen(WCTColor::R5(src[i]), expand);
+        dst[i * 4 + 1] = Widen(WCTColor::G5(src[i]), expand);
+        dst[i * 4 + 2] = Widen(WCTColor::B5(src[i]), expand);
+        dst[i * 4 + 3] = 0xFF;
+    }
+}
+
+//
+// RGB triples to RGB555
+//
+static void FromRGBScalar(const uint8_t *src, size_t count, gbacolor_t *dst)
+{
+    for(size_t i = 0; i < count; i++)
+        dst[i] = WCTColor::RGBToRGB555(src[i * 3 + 0], src[i * 3 + 1], src[i * 3 + 2]);
+}
+
+//
+// RGBA quads to RGB555
+//
+static void FromRGBAScalar(const uint8_t *src, size_t count, gbacolor_t *dst)
+{
+    for(size_t i = 0; i < count; i++)
+        dst[i] = WCTColor::RGBToRGB555(src[i * 4 + 0], src[i * 4 + 1], src[i * 4 + 2]);
+}
+
+//=============================================================================
+// Table lookup
+//
+// Every RGB555 color's RGBA expansion, for each way of widening, built the
+// first time it's needed. At 128K per table they stay in L2 while a batch
+// is being converted.
+//=============================================================================
+
+static constexpr size_t NUMCOLORS555 = 0x8000;
+
+using expandtable_t = std::array<uint32_t, NUMCOLORS555>;
+
+//
+// Get the table for one way of widening
+//
+static const expandtable_t &ExpandTable(Expand expand)
+{
+    static const std::unique_ptr<expandtable_t []> tables = [] {
+        std::unique_ptr<expandtable_t []> t { new expandtable_t [2] };
+        for(size_t e = 0; e < 2; e++)
+        {
+            for(uint32_t c = 0; c < NUMCOLORS555; c++)
+            {
+                const gbacolor_t color = gbacolor_t(c);
+                uint8_t rgba[4];
+                ToRGBAScalar(&color, 1, Expand(e), rgba);
+                std::memcpy(&t[e][c], rgba, sizeof(rgba));
+            }
+        }
+        return t;
+    }();
+    return tables[size_t(expand)];
+}
+
+//
+// RGB555 to RGB triples by table
+//
+static void ToRGBTable(const gbacolor_t *src, size_t count, Expand expand, uint8_t *dst)
+{
+    const expandtable_t &table = ExpandTable(expand);
+    if(count == 0)
+        return;
+
+    // store whole words, each overlapping the next color, until the last
+    for(size_t i = 0; i < count - 1; i++)
+        std::memcpy(dst + i * 3, &table[src[i] & 0x7FFF], sizeof(uint32_t));
+    std::memcpy(dst + (count - 1) * 3, &table[src[count - 1] & 0x7FFF], 3);
+}
+
+//
+// RGB555 to opaque RGBA quads by table
+//
+static void ToRGBATable(const gbacolor_t *src, size_t count, Expand expand, uint8_t *dst)
+{
+    const expandtable_t &table = ExpandTable(expand);
+    for(size_t i = 0; i < count; i++)
+        std::memcpy(dst + i * 4, &table[src[i] & 0x7FFF], sizeof(uint32_t));
+}
+
+#if WCT_X86_SIMD
+
+//=============================================================================
+// SSSE3
+//
+// Eight colors at a time. Each component is masked into place as a byte
+// value within its 16-bit lane, red and green are merged into one vector
+// and blue and alpha into another, and interleaving the two gives four RGBA
+// pixels per register. A shuffle squeezes out the alpha bytes for RGB.
+//
+// Going back, each 32-bit RGBA lane is shifted and masked into an RGB555
+// value and pairs of registers are packed down to eight colors. RGB input
+// is first shuffled out to RGBA lanes.
+//=============================================================================
+
+//
+// Expand eight colors to two registers of four RGBA pixels
+//
+WCT_TARGET("ssse3")
+static inline void Expand8SSSE3(const gbacolor_t *src, Expand expand, __m128i &lo, __m128i &hi)
+{
+    const __m128i c     = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    const __m128i mask  = _mm_set1_epi16(0xF8);
+    const __m128i alpha = _mm_set1_epi16(int16_t(0xFF00));
+
+    __m128i r = _mm_and_si128(_mm_slli_epi16(c, 3), mask);
+    __m128i g = _mm_and_si128(_mm_srli_epi16(c, 2), mask);
+    __m128i b = _mm_and_si128(_mm_srli_epi16(c, 7), mask);
+    if(expand == Expand::REPLICATE)
+    {
+        r = _mm_or_si128(r, _mm_srli_epi16(r, 5));
+        g = _mm_or_si128(g, _mm_srli_epi16(g, 5));
+        b = _mm_or_si128(b, _mm_srli_epi16(b, 5));
+    }
+
+    const __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+    const __m128i ba = _mm_or_si128(b, alpha);
+    lo = _mm_unpacklo_epi16(rg, ba);
+    hi = _mm_unpackhi_epi16(rg, ba);
+}
+
+//
+// RGB555 to RGB triples
+//
+WCT_TARGET("ssse3")
+static void ToRGBSSSE3(const gbacolor_t *src, size_t count, Expand expand, uint8_t *dst)
+{
+    const __m128i squeeze = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i lo, hi;
+        Expand8SSSE3(src + i, expand, lo, hi);
+        lo = _mm_shuffle_epi8(lo, squeeze); // 12 bytes
+        hi = _mm_shuffle_epi8(hi, squeeze);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 3), _mm_or_si128(lo, _mm_slli_si128(hi, 12)));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i * 3 + 16), _mm_srli_si128(hi, 4));
+    }
+    ToRGBScalar(src + i, count - i, expand, dst + i * 3);
+}
+
+//
+// RGB555 to opaque RGBA quads
+//
+WCT_TARGET("ssse3")
+static void ToRGBASSSE3(const gbacolor_t *src, size_t count, Expand expand, uint8_t *dst)
+{
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i lo, hi;
+        Expand8SSSE3(src + i, expand, lo, hi);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4 + 16), hi);
+    }
+    ToRGBAScalar(src + i, count - i, expand, dst + i * 4);
+}
+
+//
+// Reduce four RGBA lanes to RGB555 values in the low half of each lane
+//
+WCT_TARGET("ssse3")
+static inline __m128i Reduce4SSSE3(__m128i v)
+{
+    const __m128i r = _mm_and_si128(_mm_srli_epi32(v, 3), _mm_set1_epi32(0x001F));
+    const __m128i g = _mm_and_si128(_mm_srli_epi32(v, 6), _mm_set1_epi32(0x03E0));
+    const __m128i b = _mm_and_si128(_mm_srli_epi32(v, 9), _mm_set1_epi32(0x7C00));
+    return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+//
+// RGB triples to RGB555
+//
+WCT_TARGET("ssse3")
+static void FromRGBSSSE3(const uint8_t *src, size_t count, gbacolor_t *dst)
+{
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        // 24 bytes, loaded without reading past them
+        const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 3));
+        const __m128i v1 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i * 3 + 16));
+        const __m128i lo = Reduce4SSSE3(_mm_shuffle_epi8(v0, spread));
+        const __m128i hi = Reduce4SSSE3(_mm_shuffle_epi8(_mm_alignr_epi8(v1, v0, 12), spread));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packs_epi32(lo, hi));
+    }
+    FromRGBScalar(src + i * 3, count - i, dst + i);
+}
+
+//
+// RGBA quads to RGB555
+//
+WCT_TARGET("ssse3")
+static void FromRGBASSSE3(const uint8_t *src, size_t count, gbacolor_t *dst)
+{
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        const __m128i lo = Reduce4SSSE3(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4)));
+        const __m128i hi = Reduce4SSSE3(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4 + 16)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packs_epi32(lo, hi));
+    }
+    FromRGBAScalar(src + i * 4, count - i, dst + i);
+}
+
+#endif // WCT_X86_SIMD
+
+//=============================================================================
+// Dispatch
+//=============================================================================
+
+//
+// All expansion implementations the CPU can run, starting with the portable one
+//
+std::vector<WCTColorConvert::expandimpl_t> WCTColorConvert::ExpandImplementations()
+{
+    std::vector<expandimpl_t> impls;
+    impls.push_back({ "scalar", ToRGBScalar, ToRGBAScalar });
+    impls.push_back({ "table", ToRGBTable, ToRGBATable });
+#if WCT_X86_SIMD
+    if(WCTCPUFeatures::HasSSSE3())
+        impls.push_back({ "SSSE3", ToRGBSSSE3, ToRGBASSSE3 });
+#endif
+    return impls;
+}
+
+//
+// All reduction implementations the CPU can run, starting with the portable one
+//
+std::vector<WCTColorConvert::reduceimpl_t> WCTColorConvert::ReduceImplementations()
+{
+    std::vector<reduceimpl_t> impls;
+    impls.push_back({ "scalar", FromRGBScalar, FromRGBAScalar });
+#if WCT_X86_SIMD
+    if(WCTCPUFeatures::HasSSSE3())
+        impls.push_back({ "SSSE3", FromRGBSSSE3, FromRGBASSSE3 });
+#endif
+    return impls;
+}
+
+//
+// RGB555 to RGB triples with the fastest available implementation
+//
+void WCTColorConvert::ToRGB(const gbacolor_t *src, size_t count, Expand expand, uint8_t *dst)
+{
+    static const expandfn_t fn = ExpandImplementations().back().toRGB;
+    fn(src, count, expand, dst);
+}
+
+//
+// RGB555 to opaque RGBA quads with the fastest available implementation
+//
+void WCTColorConvert::ToRGBA(const gbacolor_t *src, size_t count, Expand expand, uint8_t *dst)
+{
+    static const expandfn_t fn = ExpandImplementations().back().toRGBA;
+    fn(src, count, expand, dst);
+}
+
+//
+// RGB triples to RGB555 with the fastest available implementation
+//
+void WCTColorConvert::FromRGB(const uint8_t *src, size_t count, gbacolor_t *dst)
+{
+    static const reducefn_t fn = ReduceImplementations().back().fromRGB;
+    fn(src, count, dst);
+}
+
+//
+// RGBA quads to RGB555 with the fastest available implementation
+//
+void WCTColorConvert::FromRGBA(const uint8_t *src, size_t count, gbacolor_t *dst)
+{
+    static const reducefn_t fn = ReduceImplementations().back().fromRGBA;
+    fn(src, count, dst);
+}
+
+// EOF
@@ -0,0 +1,76 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <vector>
+#include "../common/colors.h"
+
+//
+// Batch conversion between RGB555 colors and 8-bit RGB or RGBA, for whole
+// palettes or the whole card palette region at once. Results match the
+// single-color helpers in colors.h exactly; the unused top bit of an RGB555
+// color is ignored.
+//
+// Expansion has a portable version, a version that looks each color up in
+// a 32K-entry table, and a SIMD version; reduction has portable and SIMD
+// versions. The fastest one the CPU supports is picked at runtime.
+//
+namespace WCTColorConvert
+{
+    // How 5-bit components are widened to 8 bits
+    enum class Expand
+    {
+        SHIFT,    // shifted up with the low bits clear, as RGB555ToRGB8
+        REPLICATE // top bits copied into the low bits, as Expand5To8; the same as Resaturate of RGB555ToRGB8
+    };
+
+    // RGB555 to count RGB triples (3 bytes per color) or RGBA quads with
+    // opaque alpha (4 bytes per color)
+    using expandfn_t = void (*)(const WCTColor::gbacolor_t *src, size_t count, Expand expand, uint8_t *dst);
+
+    // count RGB triples or RGBA quads to RGB555, dropping the low bits of
+    // each component and any alpha
+    using reducefn_t = void (*)(const uint8_t *src, size_t count, WCTColor::gbacolor_t *dst);
+
+    struct expandimpl_t
+    {
+        const char *name;
+        expandfn_t  toRGB;
+        expandfn_t  toRGBA;
+    };
+
+    struct reduceimpl_t
+    {
+        const char *name;
+        reducefn_t  fromRGB;
+        reducefn_t  fromRGBA;
+    };
+
+    // Convert with the fastest available implementation
+    void ToRGB(const WCTColor::gbacolor_t *src, size_t count, Expand expand, uint8_t *dst);
+    void ToRGBA(const WCTColor::gbacolor_t *src, size_t count, Expand expand, uint8_t *dst);
+    void FromRGB(const uint8_t *src, size_t count, WCTColor::gbacolor_t *dst);
+    void FromRGBA(const uint8_t *src, size_t count, WCTColor::gbacolor_t *dst);
+
+    // All implementations the CPU can run, starting with the portable one
+    // which the others must match exactly
+    std::vector<expandimpl_t> ExpandImplementations();
+    std::vector<reduceimpl_t> ReduceImplementations();
+}
+
+// EOF
@@ -0,0 +1,279 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <thread>
+
+#include "elib/elib.h"
+#include "elib/qstring.h"
+#include "cardpic.h"
+#include "importpipeline.h"
+#include "manifest.h"
+#include "../common/boundedqueue.h"
+#include "../common/contenthash.h"
+#include "../common/parallel.h"
+
+using namespace WCTImportPipeline;
+using clock_type = std::chrono::steady_clock;
+
+static constexpr size_t WRITE_BATCH = 32;
+
+//
+// Manifest settings string; dithering changes the output for truecolor PNGs
+//
+static const char *ManifestSettings(const params_t &params)
+{
+    return params.dither == WCTQuantizer::Dither::ORDERED ? "generate dither" : "generate";
+}
+
+//
+// One PNG on its way through the pipeline
+//
+struct importitem_t
+{
+    enum State : uint8_t { FAILED, PACKED, UNCHANGED };
+
+    size_t                      index = 0; // position in the sorted file list
+    State                       state = FAILED;
+    WCTManifest::entry_t        entry {};
+    std::unique_ptr<WCTCardPic> upPic;
+    std::string                 warning;
+};
+
+//
+// Per-worker stage timings, kept apart so workers never share them
+//
+struct workertimes_t
+{
+    double read   = 0.0;
+    double decode = 0.0;
+    double pack   = 0.0;
+};
+
+static double SecondsSince(clock_type::time_point &start)
+{
+    const clock_type::time_point now = clock_type::now();
+    const double secs = std::chrono::duration<double>(now - start).count();
+    start = now;
+    return secs;
+}
+
+//
+// List the PNG files in a directory, sorted by name so runs are repeatable
+//
+bool WCTImportPipeline::ListPNGs(const char *dir, std::vector<std::filesystem::path> &files)
+{
+    using namespace std::filesystem;
+
+    std::error_code ec;
+    directory_iterator itr { path { dir }, ec };
+    if(ec)
+        return false;
+
+    for(const directory_entry &entry : itr)
+    {
+        if(entry.is_regular_file() == true &&
+           strcasecmp(entry.path().extension().string().c_str(), ".png") == 0)
+        {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return true;
+}
+
+//
+// Output file name base for a PNG, before the .pix/.pal extensions go on
+//
+static std::filesystem::path OutputBase(const char *outdir, const std::filesystem::path &png)
+{
+    return std::filesystem::path { outdir } / png.filename();
+}
+
+//
+// Worker stage: read, decode, and pack one PNG
+//
+static importitem_t ImportOne(
+    const params_t &params, const WCTManifest &manifest, const std::filesystem::path &file, size_t index,
+    std::vector<uint8_t> &pngdata, workertimes_t &times
+)
+{
+    importitem_t item;
+    item.index = index;
+
+    const std::string name = file.filename().string();
+
+    clock_type::time_point t = clock_type::now();
+    if(WCTCardPic::LoadPNGFile(file.string().c_str(), pngdata) == false)
+    {
+        item.warning = "failed to read PNG file '" + name + "'";
+        times.read += SecondsSince(t);
+        return item;
+    }
+    item.entry.source1 = WCTContentHash::Hash64(pngdata.data(), pngdata.size());
+
+    if(params.incremental && manifest.IsCurrent(name, item.entry.source1, item.entry.source2))
+    {
+        const std::filesystem::path base = OutputBase(params.outDir, file);
+        const WCTManifest::entry_t &prev = *manifest.Find(name);
+        if(WCTManifest::OutputSize({ std::filesystem::path { base }.replace_extension(".pix"),
+                                     std::filesystem::path { base }.replace_extension(".pal") }) == prev.outputSize)
+        {
+            item.entry = prev;
+            item.state = importitem_t::UNCHANGED;
+            times.read += SecondsSince(t);
+            return item;
+        }
+    }
+    times.read += SecondsSince(t);
+
+    item.upPic = std::make_unique<WCTCardPic>();
+    const bool decoded = item.upPic->DecodePNGData(pngdata.data(), pngdata.size(), params.dither);
+    times.decode += SecondsSince(t);
+    if(decoded == false)
+    {
+        item.warning = "failed to decode PNG file '" + name + "'";
+        item.upPic.reset();
+        return item;
+    }
+
+    item.upPic->PackPixels();
+    times.pack += SecondsSince(t);
+
+    item.state = importitem_t::PACKED;
+    return item;
+}
+
+//
+// Writer stage: write out one packed card and complete its manifest entry
+//
+static bool WriteOne(const params_t &params, const std::filesystem::path &file, importitem_t &item)
+{
+    const std::string outbase = OutputBase(params.outDir, file).string();
+    if(item.upPic->WriteGBAData(outbase.c_str()) == false)
+    {
+        item.warning = "failed to write GBA data for PNG file '" + file.filename().string() + "'";
+        return false;
+    }
+
+    const WCTCardPic::rawdata_t &raw = item.upPic->GetRawData();
+    const WCTCardPic::palette_t &pal = item.upPic->GetPalette();
+    item.entry.output     = WCTContentHash::Hash64(pal.data(), sizeof(pal), WCTContentHash::Hash64(raw.data(), raw.size()));
+    item.entry.outputSize = raw.size() + sizeof(pal);
+    return true;
+}
+
+//
+// Convert every PNG in the input directory
+//
+bool WCTImportPipeline::Run(const params_t &params, results_t &results)
+{
+    results = results_t {};
+    clock_type::time_point start = clock_type::now();
+    const clock_type::time_point runstart = start;
+
+    // stage 1: list the input files
+    std::vector<std::filesystem::path> files;
+    if(ListPNGs(params.inDir, files) == false)
+        return false;
+    results.listSecs = SecondsSince(start);
+
+    WCTManifest manifest { WCTManifest::GENERATE_FILENAME, ManifestSettings(params) };
+    if(params.incremental)
+        manifest.Load(params.outDir);
+
+    // stages 2 and 3: workers take files in order and read, decode, and pack them
+    const unsigned int numworkers = WCTParallel::ThreadsFor(files.size(), params.numThreads);
+    results.threads = numworkers;
+
+    WCTBoundedQueue<importitem_t> queue { params.queueDepth };
+    std::atomic<size_t>           nextfile { 0 };
+    std::atomic<unsigned int>     running { numworkers };
+    std::vector<workertimes_t>    times(numworkers);
+
+    std::vector<std::thread> workers;
+    workers.reserve(numworkers);
+    for(unsigned int w = 0; w < numworkers; w++)
+    {
+        workers.emplace_back([&, w] {
+            std::vector<uint8_t> pngdata;
+            for(size_t i = nextfile++; i < files.size(); i = nextfile++)
+                queue.Push(ImportOne(params, manifest, files[i], i, pngdata, times[w]));
+
+            // the last worker out tells the writer nothing more is coming
+            if(--running == 0)
+                queue.Close();
+        });
+    }
+
+    // stage 4: this thread writes out batches of packed cards as they arrive
+    WCTManifest written { WCTManifest::GENERATE_FILENAME, ManifestSettings(params) };
+    std::vector<std::pair<size_t, std::string>> warnings;
+    std::vector<importitem_t> batch;
+    while(queue.PopBatch(batch, WRITE_BATCH))
+    {
+        clock_type::time_point t = clock_type::now();
+        for(importitem_t &item : batch)
+        {
+            const std::filesystem::path &file = files[item.index];
+            if(item.state == importitem_t::PACKED && WriteOne(params, file, item) == false)
+                item.state = importitem_t::FAILED;
+
+            switch(item.state)
+            {
+            case importitem_t::PACKED:
+                ++results.packed;
+                written.Set(file.filename().string(), item.entry);
+                break;
+            case importitem_t::UNCHANGED:
+                ++results.unchanged;
+                written.Set(file.filename().string(), item.entry);
+                break;
+            default:
+                warnings.emplace_back(item.index, std::move(item.warning));
+                break;
+            }
+        }
+        results.writeSecs += SecondsSince(t);
+    }
+
+    for(std::thread &worker : workers)
+        worker.join();
+
+    if(params.incremental && written.Save(params.outDir) == false)
+        warnings.emplace_back(files.size(), "failed to write manifest");
+
+    // warnings come out in file order, however the work was interleaved
+    std::sort(warnings.begin(), warnings.end(), [] (const auto &a, const auto &b) { return a.first < b.first; });
+    for(auto &w : warnings)
+        results.warnings.push_back(std::move(w.second));
+
+    for(const workertimes_t &wt : times)
+    {
+        results.readSecs   += wt.read;
+        results.decodeSecs += wt.decode;
+        results.packSecs   += wt.pack;
+    }
+    results.totalSecs = std::chrono::duration<double>(clock_type::now() - runstart).count();
+    return true;
+}
+
+// EOF
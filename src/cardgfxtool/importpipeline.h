@@ -0,0 +1,70 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "quantizer.h"
+
+//
+// Conversion of a directory of PNG files to GBA .pix/.pal data, as a
+// pipeline: the directory is listed up front, a pool of workers reads,
+// decodes, and packs the PNGs, and the calling thread writes the results out
+// in batches as they arrive through a bounded queue.
+//
+namespace WCTImportPipeline
+{
+    struct params_t
+    {
+        const char          *inDir       = ".";
+        const char          *outDir      = ".";
+        bool                 incremental = false; // skip PNGs unchanged since the last run, as recorded in the manifest
+        WCTQuantizer::Dither dither      = WCTQuantizer::Dither::NONE; // for truecolor PNGs
+        unsigned int         numThreads  = 0;     // workers; 0 for one per core
+        size_t               queueDepth  = 64;    // packed cards allowed to wait for writing
+    };
+
+    struct results_t
+    {
+        uint32_t packed    = 0;
+        uint32_t unchanged = 0;
+        unsigned int threads = 0;
+
+        // messages about files that failed, in file name order
+        std::vector<std::string> warnings;
+
+        // time spent in each stage, summed over the threads doing it
+        double listSecs   = 0.0;
+        double readSecs   = 0.0;
+        double decodeSecs = 0.0;
+        double packSecs   = 0.0;
+        double writeSecs  = 0.0;
+        double totalSecs  = 0.0; // wall clock for the whole run
+    };
+
+    // List the PNG files in a directory, sorted by name. Returns false if the
+    // directory can't be listed.
+    bool ListPNGs(const char *dir, std::vector<std::filesystem::path> &files);
+
+    // Convert every PNG in params.inDir. Returns false if the input
+    // directory can't be listed.
+    bool Run(const params_t &params, results_t &results);
+}
+
+// EOF
@@ -0,0 +1,138 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+#include <cinttypes>
+#include <vector>
+
+#include "elib/elib.h"
+#include "elib/misc.h"
+#include "elib/qstring.h"
+#include "manifest.h"
+
+//
+// File format is a header line giving the settings, then one line per output:
+// four hex numbers (source1, source2, output hash, output size) separated by
+// spaces, then the output's name running to the end of the line.
+//
+static constexpr const char *HEADER = "cardgfxtool manifest v1: ";
+
+//
+// Load the manifest from a directory
+//
+void WCTManifest::Load(const char *dir)
+{
+    m_entries.clear();
+
+    qstring path;
+    path.printf("%s/%s", dir, m_filename);
+    const EAutoFile upFile { std::fopen(path.c_str(), "r") };
+    if(upFile == nullptr)
+        return;
+
+    // settings must match, or nothing recorded is of any use
+    const std::string expected = HEADER + m_settings + "\n";
+    char line[1024];
+    if(std::fgets(line, sizeof(line), upFile.get()) == nullptr || expected != line)
+        return;
+
+    while(std::fgets(line, sizeof(line), upFile.get()) != nullptr)
+    {
+        entry_t entry;
+        int namepos = 0;
+        if(std::sscanf(
+            line, "%" SCNx64 " %" SCNx64 " %" SCNx64 " %" SCNx64 " %n",
+            &entry.source1, &entry.source2, &entry.output, &entry.outputSize, &namepos
+        ) != 4 || namepos == 0)
+        {
+            continue;
+        }
+
+        std::string name { line + namepos };
+        while(name.empty() == false && (name.back() == '\n' || name.back() == '\r'))
+            name.pop_back();
+        if(name.empty() == false)
+            m_entries[name] = entry;
+    }
+}
+
+//
+// Write the manifest out to a directory
+//
+bool WCTManifest::Save(const char *dir) const
+{
+    qstring path;
+    path.printf("%s/%s", dir, m_filename);
+    const EAutoFile upFile { std::fopen(path.c_str(), "w") };
+    if(upFile == nullptr)
+        return false;
+
+    // sorted, so that the file diffs sensibly between runs
+    std::vector<const std::pair<const std::string, entry_t> *> sorted;
+    sorted.reserve(m_entries.size());
+    for(const auto &kv : m_entries)
+        sorted.push_back(&kv);
+    std::sort(sorted.begin(), sorted.end(), [] (const auto *a, const auto *b) { return a->first < b->first; });
+
+    bool res = std::fprintf(upFile.get(), "%s%s\n", HEADER, m_settings.c_str()) > 0;
+    for(const auto *kv : sorted)
+    {
+        const entry_t &e = kv->second;
+        res = std::fprintf(
+            upFile.get(), "%016" PRIx64 " %016" PRIx64 " %016" PRIx64 " %" PRIx64 " %s\n",
+            e.source1, e.source2, e.output, e.outputSize, kv->first.c_str()
+        ) > 0 && res;
+    }
+    return res;
+}
+
+//
+// Find the entry for an output by name
+//
+const WCTManifest::entry_t *WCTManifest::Find(const std::string &name) const
+{
+    const auto itr = m_entries.find(name);
+    return itr != m_entries.end() ? &itr->second : nullptr;
+}
+
+//
+// Check whether an output is up to date with the given source hashes
+//
+bool WCTManifest::IsCurrent(const std::string &name, uint64_t source1, uint64_t source2) const
+{
+    const entry_t *const e = Find(name);
+    return e != nullptr && e->source1 == source1 && e->source2 == source2;
+}
+
+//
+// Total size of a set of output files, or UINT64_MAX if any is missing
+//
+uint64_t WCTManifest::OutputSize(std::initializer_list<std::filesystem::path> paths)
+{
+    uint64_t total = 0;
+    for(const std::filesystem::path &p : paths)
+    {
+        std::error_code ec;
+        const uint64_t size = std::filesystem::file_size(p, ec);
+        if(ec)
+            return UINT64_MAX;
+        total += size;
+    }
+    return total;
+}
+
+// EOF
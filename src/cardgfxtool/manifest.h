@@ -0,0 +1,80 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <filesystem>
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+
+//
+// Record of what an incremental -dump or -generate run produced, kept in the
+// output directory. For each output it holds content hashes of the source
+// data it was made from and of what was written, so the next run can skip
+// anything whose source hasn't changed and whose output is still in place.
+//
+// The manifest also records the settings the outputs were made with; if
+// those change, every entry is out of date. Each mode keeps its own file, so
+// dumping into a directory and generating back out into it don't undo each
+// other's records.
+//
+class WCTManifest final
+{
+public:
+    static constexpr const char *DUMP_FILENAME     = "cardgfx-dump.manifest";
+    static constexpr const char *GENERATE_FILENAME = "cardgfx-generate.manifest";
+
+    struct entry_t
+    {
+        uint64_t source1;    // e.g. palette hash
+        uint64_t source2;    // e.g. pixel hash
+        uint64_t output;     // hash of all bytes written
+        uint64_t outputSize; // total size of all bytes written
+    };
+
+    WCTManifest(const char *filename, const char *settings) : m_filename(filename), m_settings(settings) {}
+
+    // Load the manifest from a directory. Missing, unreadable, or mismatched
+    // manifests just leave it empty, so that everything gets rebuilt.
+    void Load(const char *dir);
+
+    // Write the manifest out to a directory
+    bool Save(const char *dir) const;
+
+    // Find the entry for an output by name
+    const entry_t *Find(const std::string &name) const;
+
+    // Add or replace the entry for an output
+    void Set(const std::string &name, const entry_t &entry) { m_entries[name] = entry; }
+
+    // Drop the entry for an output, if there is one
+    void Remove(const std::string &name) { m_entries.erase(name); }
+
+    // Check whether an output is up to date with the given source hashes
+    bool IsCurrent(const std::string &name, uint64_t source1, uint64_t source2) const;
+
+    // Total size of a set of output files, or UINT64_MAX if any is missing
+    static uint64_t OutputSize(std::initializer_list<std::filesystem::path> paths);
+
+private:
+    const char                              *m_filename; // leaf name within the directory
+    std::string                              m_settings;
+    std::unordered_map<std::string, entry_t> m_entries;
+};
+
+// EOF
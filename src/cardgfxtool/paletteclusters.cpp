@@ -0,0 +1,261 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "elib/elib.h"
+#include "cardgallery.h"
+#include "paletteclusters.h"
+#include "../common/colors.h"
+#include "../common/contenthash.h"
+
+using namespace WCTConstants;
+
+static constexpr uint16_t COLOR_MASK = 0x7FFF;
+
+// component weights: red, green, blue
+static constexpr std::array<uint32_t, 3> WEIGHTS { 2, 4, 3 };
+
+//
+// A distinct set of colors, sorted, with the range each component spans
+//
+struct colorset_t
+{
+    std::vector<uint16_t>   colors;
+    std::array<uint8_t, 3>  lo;
+    std::array<uint8_t, 3>  hi;
+};
+
+//
+// A palette the clusters are built around and the pictures that would use it
+//
+struct cluster_t
+{
+    colorset_t            palette;
+    std::vector<uint32_t> picnums;
+};
+
+//
+// Weighted squared distance between two RGB555 colors
+//
+uint32_t WCTPaletteClusters::Distance(uint16_t a, uint16_t b)
+{
+    const int dr = int(WCTColor::R5(a)) - int(WCTColor::R5(b));
+    const int dg = int(WCTColor::G5(a)) - int(WCTColor::G5(b));
+    const int db = int(WCTColor::B5(a)) - int(WCTColor::B5(b));
+    return WEIGHTS[0] * uint32_t(dr * dr) + WEIGHTS[1] * uint32_t(dg * dg) + WEIGHTS[2] * uint32_t(db * db);
+}
+
+//
+// Sort and deduplicate colors into a set, and find its component ranges
+//
+static void MakeColorSet(std::vector<uint16_t> colors, colorset_t &set)
+{
+    std::sort(colors.begin(), colors.end());
+    colors.erase(std::unique(colors.begin(), colors.end()), colors.end());
+
+    set.lo = { 31, 31, 31 };
+    set.hi = { 0, 0, 0 };
+    for(uint16_t color : colors)
+    {
+        const std::array<uint8_t, 3> c { WCTColor::R5(color), WCTColor::G5(color), WCTColor::B5(color) };
+        for(size_t i = 0; i < c.size(); i++)
+        {
+            set.lo[i] = std::min(set.lo[i], c[i]);
+            set.hi[i] = std::max(set.hi[i], c[i]);
+        }
+    }
+    set.colors = std::move(colors);
+}
+
+//
+// Get the colors of the palette entries a picture's pixels use
+//
+static std::vector<uint16_t> UsedColors(const WCTCardGallery &gallery, uint32_t picnum)
+{
+    std::array<bool, CARDPALETTE_NUMENTRIES> used {};
+    const uint8_t *const pixels = gallery.GetPixels(picnum);
+    for(uint32_t i = 0; i < CARDGFX_PIXEL_COUNT; i++)
+        used[pixels[i] % CARDPALETTE_NUMENTRIES] = true;
+
+    const WCTCardGallery::palette_t &pal = gallery.GetPalette(picnum);
+    std::vector<uint16_t> colors;
+    for(size_t i = 0; i < used.size(); i++)
+    {
+        if(used[i])
+            colors.push_back(pal[i] & COLOR_MASK);
+    }
+    return colors;
+}
+
+//
+// Find how far the colors of a set have to move to each take their nearest
+// color in a palette. Gives up and returns UINT32_MAX as soon as any color
+// would have to move further than limit.
+//
+static uint32_t DistanceToPalette(const colorset_t &set, const colorset_t &palette, uint32_t limit)
+{
+    uint32_t worst = 0;
+    for(uint16_t color : set.colors)
+    {
+        uint32_t best = UINT32_MAX;
+        for(uint16_t pc : palette.colors)
+        {
+            best = std::min(best, WCTPaletteClusters::Distance(color, pc));
+            if(best <= worst)
+                break; // can't make this set any further away
+        }
+        if(best > limit)
+            return UINT32_MAX;
+        worst = std::max(worst, best);
+    }
+    return worst;
+}
+
+//
+// Check whether every color of a set lies within a palette's component
+// ranges widened by the margins; if not, some color of the set is further
+// than the tolerance from all of the palette's colors
+//
+static bool CouldFit(const colorset_t &set, const colorset_t &palette, const std::array<int, 3> &margins)
+{
+    for(size_t i = 0; i < margins.size(); i++)
+    {
+        if(int(set.lo[i]) < int(palette.lo[i]) - margins[i] || int(set.hi[i]) > int(palette.hi[i]) + margins[i])
+            return false;
+    }
+    return true;
+}
+
+//
+// Analyze every picture in the gallery
+//
+void WCTPaletteClusters::Analyze(const WCTCardGallery &gallery, const params_t &params, results_t &results)
+{
+    results = results_t {};
+    results.numCards = gallery.GetCount();
+    if(results.numCards == 0)
+        return;
+
+    // the used colors of each picture as a sorted set, and its hash
+    std::vector<colorset_t> sets(results.numCards);
+    std::vector<uint64_t>   hashes(results.numCards);
+    for(uint32_t i = 0; i < results.numCards; i++)
+    {
+        MakeColorSet(UsedColors(gallery, gallery.GetPicNum(i)), sets[i]);
+        hashes[i] = WCTContentHash::Hash64(sets[i].colors.data(), sets[i].colors.size() * sizeof(uint16_t));
+    }
+
+    // sort by hash so that pictures using the same colors end up side by
+    // side; contents are compared only when hashes tie
+    std::vector<uint32_t> order(results.numCards);
+    for(uint32_t i = 0; i < results.numCards; i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&] (uint32_t a, uint32_t b) {
+        if(hashes[a] != hashes[b])
+            return hashes[a] < hashes[b];
+        if(sets[a].colors != sets[b].colors)
+            return sets[a].colors < sets[b].colors;
+        return a < b;
+    });
+
+    // each run of equal sets is one distinct set
+    std::vector<std::vector<uint32_t>> runs;
+    for(size_t r = 0, end; r < order.size(); r = end)
+    {
+        for(end = r + 1; end < order.size() && hashes[order[end]] == hashes[order[r]] && sets[order[end]].colors == sets[order[r]].colors; end++)
+            ;
+        runs.emplace_back();
+        for(size_t i = r; i < end; i++)
+            runs.back().push_back(order[i]);
+    }
+    results.uniqueColorSets = uint32_t(runs.size());
+    for(const std::vector<uint32_t> &run : runs)
+    {
+        if(run.size() < 2)
+            continue;
+        results.colorSetGroups.emplace_back();
+        for(uint32_t i : run)
+            results.colorSetGroups.back().push_back(gallery.GetPicNum(i));
+    }
+
+    // cluster the sets with the most colors first, so that the palettes the
+    // clusters form around are the likeliest to cover the rest
+    std::stable_sort(runs.begin(), runs.end(), [&] (const auto &a, const auto &b) {
+        return sets[a.front()].colors.size() > sets[b.front()].colors.size();
+    });
+
+    // no color can be within the tolerance of a palette color if any of its
+    // components is further off than this
+    std::array<int, 3> margins;
+    for(size_t i = 0; i < margins.size(); i++)
+        margins[i] = int(std::sqrt(double(params.tolerance) / WEIGHTS[i]));
+
+    std::vector<cluster_t> clusters;
+    for(const std::vector<uint32_t> &run : runs)
+    {
+        const colorset_t &set = sets[run.front()];
+
+        // nearest palette so far within the tolerance
+        size_t   nearest  = clusters.size();
+        uint32_t bestdist = UINT32_MAX;
+        for(size_t c = 0; c < clusters.size() && bestdist != 0; c++)
+        {
+            if(CouldFit(set, clusters[c].palette, margins) == false)
+                continue;
+            const uint32_t limit = bestdist == UINT32_MAX ? params.tolerance : bestdist - 1;
+            if(const uint32_t dist = DistanceToPalette(set, clusters[c].palette, limit); dist != UINT32_MAX)
+            {
+                nearest  = c;
+                bestdist = dist;
+            }
+        }
+
+        if(nearest == clusters.size())
+        {
+            // a new cluster, around the whole palette of its first picture
+            clusters.emplace_back();
+            const WCTCardGallery::palette_t &pal = gallery.GetPalette(gallery.GetPicNum(run.front()));
+            std::vector<uint16_t> colors(pal.begin(), pal.end());
+            for(uint16_t &color : colors)
+                color &= COLOR_MASK;
+            MakeColorSet(std::move(colors), clusters.back().palette);
+        }
+        else
+        {
+            results.maxDistance = std::max(results.maxDistance, bestdist);
+        }
+
+        for(uint32_t i : run)
+            clusters[nearest].picnums.push_back(gallery.GetPicNum(i));
+    }
+    results.numClusters = uint32_t(clusters.size());
+
+    for(cluster_t &cluster : clusters)
+    {
+        if(cluster.picnums.size() > 1)
+            results.clusterGroups.push_back(std::move(cluster.picnums));
+    }
+
+    const auto largest = [] (const auto &a, const auto &b) { return a.size() > b.size(); };
+    std::stable_sort(results.colorSetGroups.begin(), results.colorSetGroups.end(), largest);
+    std::stable_sort(results.clusterGroups.begin(), results.clusterGroups.end(), largest);
+}
+
+// EOF
@@ -0,0 +1,69 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <vector>
+
+class WCTCardGallery;
+
+//
+// Palette sharing analysis over a gallery of card pictures, to size up how
+// many of the per-card palettes new card art could do without.
+//
+// Only the palette entries a card's pixels actually use are considered, and
+// the unused top bit of each entry is ignored. Cards whose used colors are
+// the same set, in any order, can share one palette exactly once their
+// pixels are renumbered. Beyond that, cards are clustered by perceptual
+// distance: a card can take on another card's palette when each color it
+// uses has a match in that palette within the tolerance.
+//
+// Distances are squared differences of the RGB555 components weighted
+// 2:4:3 for red, green and blue, a cheap stand-in for how much more the eye
+// notices a change in green than in red or blue.
+//
+namespace WCTPaletteClusters
+{
+    struct params_t
+    {
+        uint32_t tolerance = 9; // largest distance a color may move; 9 is one step in every component
+    };
+
+    struct results_t
+    {
+        uint32_t numCards        = 0;
+        uint32_t uniqueColorSets = 0; // distinct sets of used colors
+        uint32_t numClusters     = 0; // palettes left after clustering within the tolerance
+        uint32_t maxDistance     = 0; // furthest any clustered color moves
+
+        // sets of picture numbers using the same colors, largest sets first
+        std::vector<std::vector<uint32_t>> colorSetGroups;
+
+        // sets of picture numbers that could share a palette within the
+        // tolerance, largest sets first; the first picture in each set is
+        // the one whose palette they would share
+        std::vector<std::vector<uint32_t>> clusterGroups;
+    };
+
+    // Weighted squared distance between two RGB555 colors
+    uint32_t Distance(uint16_t a, uint16_t b);
+
+    // Analyze every picture in the gallery
+    void Analyze(const WCTCardGallery &gallery, const params_t &params, results_t &results);
+}
+
+// EOF
@@ -0,0 +1,426 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include "elib/elib.h"
+#include "../common/cpufeatures.h"
+#include "../common/romoffsets.h"
+#include "pixelcodec.h"
+
+#if WCT_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace WCTConstants;
+
+static constexpr uint32_t TILE_BYTES = CARDGFX_TILE_WIDTH_PX * CARDGFX_TILE_HEIGHT_PX * CARDGFX_BPP / 8; // 48
+static constexpr uint32_t TILEPITCH  = CARDGFX_TILE_HEIGHT_PX * CARDGFX_FULLWIDTH_PX;
+
+//=============================================================================
+// Portable implementation
+//=============================================================================
+
+//
+// Unpack 6bpp tiled data into a linear image
+//
+static void Unpack6bppScalar(const uint8_t *rawdata, uint8_t *base)
+{
+    const uint16_t *src = reinterpret_cast<const uint16_t *>(rawdata);
+
+    for(uint32_t ty = 0; ty < CARDGFX_TILEMAP_HEIGHT; ty++)
+    {
+        for(uint32_t tx = 0; tx < CARDGFX_TILEMAP_WIDTH; tx++)
+        {
+            uint8_t  *dst   = base + ty * TILEPITCH + tx * CARDGFX_TILE_WIDTH_PX;
+            uint32_t  count = CARDGFX_TILE_HEIGHT_PX;
+            do
+            {
+                const uint16_t data0 = *src++;
+                const uint16_t data1 = *src++;
+                const uint16_t data2 = *src++;
+
+                *(dst + 0) = uint8_t(data0 & 63);                          // 0:----|------|xxxxxx
+                *(dst + 1) = uint8_t((data0 & 0xFC0) >> 6);                // 0:----|xxxxxx|------
+                *(dst + 2) = uint8_t((data0 >> 12) | ((data1 & 3) << 4));  // 0:xxxx|------|------  + 1:--|------|------|xx
+                *(dst + 3) = uint8_t((data1 & 0xFC) >> 2);                 // 1:--|------|xxxxxx|--
+                *(dst + 4) = uint8_t((data1 >> 8) & 63);                   // 1:--|xxxxxx|------|--
+                *(dst + 5) = uint8_t((data1 >> 14) | ((data2 & 15) << 2)); // 1:xx|------|------|-- + 2:------|------|xxxx
+                *(dst + 6) = uint8_t((data2 >> 4) & 63);                   // 2:------|xxxxxx|----
+                *(dst + 7) = uint8_t((data2 & 0xFC00) >> 10);              // 2:xxxxxx|------|----
+
+                dst += CARDGFX_FULLWIDTH_PX;
+            }
+            while(--count != 0);
+        }
+    }
+}
+
+//
+// Pack linear 8-bit image into 6bpp tiled data
+//
+static void Pack6bppScalar(const uint8_t *base, uint8_t *rawdata)
+{
+    uint16_t *dst = reinterpret_cast<uint16_t *>(rawdata);
+
+    for(uint32_t ty = 0; ty < CARDGFX_TILEMAP_HEIGHT; ty++)
+    {
+        for(uint32_t tx = 0; tx < CARDGFX_TILEMAP_WIDTH; tx++)
+        {
+            const uint8_t *src   = base + ty * TILEPITCH + tx * CARDGFX_TILE_WIDTH_PX;
+            uint32_t       count = CARDGFX_TILE_HEIGHT_PX;
+            do
+            {
+                // pack 8 pixels into 3 words
+                *dst++ =  (src[0] & 63)       | (uint16_t(src[1] & 63) << 6) | (uint16_t(src[2] & 15) << 12);
+                *dst++ = ((src[2] & 48) >> 4) | (uint16_t(src[3] & 63) << 2) | (uint16_t(src[4] & 63) <<  8) | (uint16_t(src[5] & 3) << 14);
+                *dst++ = ((src[5] & 60) >> 2) | (uint16_t(src[6] & 63) << 4) | (uint16_t(src[7] & 63) << 10);
+
+                src += CARDGFX_FULLWIDTH_PX;
+            }
+            while(--count != 0);
+        }
+    }
+}
+
+#if WCT_X86_SIMD
+
+//=============================================================================
+// SSSE3 unpacking
+//
+// Every 3 bytes of source hold 4 pixels. A shuffle copies each 3-byte group
+// into its own 32-bit lane as [b0 b1 b1 b2], which puts two pixels in each
+// 16-bit half: the low half holds pixels 0 and 1 at bits 0 and 6, and the
+// high half holds pixels 2 and 3 at bits 4 and 10. Masking and multiplying
+// by a per-half power of two lines up pixels 0 and 2 at bit 4 and pixels 1
+// and 3 at bit 10, so one shift apiece drops them into the low and high byte
+// of each half, giving 16 unpacked pixels (two tile rows) per 12 bytes.
+//=============================================================================
+
+WCT_TARGET("ssse3")
+static inline __m128i Expand12SSSE3(__m128i v)
+{
+    const __m128i shuf   = _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+    const __m128i maskLo = _mm_set1_epi32(0x03F0003F); // pixels 0 and 2
+    const __m128i maskHi = _mm_set1_epi32(int(0xFC000FC0)); // pixels 1 and 3
+    const __m128i mul    = _mm_set1_epi32(0x00010010); // x16 for the low half, x1 for the high
+
+    const __m128i w  = _mm_shuffle_epi8(v, shuf);
+    const __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_and_si128(w, maskLo), mul), 4);
+    const __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_and_si128(w, maskHi), mul), 2);
+    return _mm_or_si128(lo, hi);
+}
+
+WCT_TARGET("ssse3")
+static inline void StoreRowPairSSSE3(uint8_t *dst, __m128i px)
+{
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), px);
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + CARDGFX_FULLWIDTH_PX), _mm_unpackhi_epi64(px, px));
+}
+
+//
+// Unpack one 48-byte tile. The three loads cover it exactly, and the four
+// 12-byte row pairs are pulled out of them with byte alignment.
+//
+WCT_TARGET("ssse3")
+static inline void UnpackTileSSSE3(const uint8_t *src, uint8_t *dst)
+{
+    const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+    const __m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32));
+
+    StoreRowPairSSSE3(dst,                            Expand12SSSE3(v0));
+    StoreRowPairSSSE3(dst + 2 * CARDGFX_FULLWIDTH_PX, Expand12SSSE3(_mm_alignr_epi8(v1, v0, 12)));
+    StoreRowPairSSSE3(dst + 4 * CARDGFX_FULLWIDTH_PX, Expand12SSSE3(_mm_alignr_epi8(v2, v1, 8)));
+    StoreRowPairSSSE3(dst + 6 * CARDGFX_FULLWIDTH_PX, Expand12SSSE3(_mm_srli_si128(v2, 4)));
+}
+
+WCT_TARGET("ssse3")
+static void Unpack6bppSSSE3(const uint8_t *src, uint8_t *base)
+{
+    for(uint32_t ty = 0; ty < CARDGFX_TILEMAP_HEIGHT; ty++)
+    {
+        uint8_t *dst = base + ty * TILEPITCH;
+        for(uint32_t tx = 0; tx < CARDGFX_TILEMAP_WIDTH; tx++)
+        {
+            UnpackTileSSSE3(src, dst);
+            src += TILE_BYTES;
+            dst += CARDGFX_TILE_WIDTH_PX;
+        }
+    }
+}
+
+//=============================================================================
+// AVX2 unpacking
+//
+// The same steps as SSSE3, done on two horizontally adjacent tiles at once,
+// one per 128-bit lane. Their row pairs are then interleaved so that each
+// image row gets a single 16-byte store.
+//=============================================================================
+
+WCT_TARGET("avx2")
+static inline __m256i Expand12AVX2(__m256i v)
+{
+    const __m256i shuf = _mm256_setr_epi8(
+        0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11,
+        0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11
+    );
+    const __m256i maskLo = _mm256_set1_epi32(0x03F0003F);
+    const __m256i maskHi = _mm256_set1_epi32(int(0xFC000FC0));
+    const __m256i mul    = _mm256_set1_epi32(0x00010010);
+
+    const __m256i w  = _mm256_shuffle_epi8(v, shuf);
+    const __m256i lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_and_si256(w, maskLo), mul), 4);
+    const __m256i hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_and_si256(w, maskHi), mul), 2);
+    return _mm256_or_si256(lo, hi);
+}
+
+WCT_TARGET("avx2")
+static inline void StoreRowPairAVX2(uint8_t *dst, __m256i px)
+{
+    // [A row, A next row | B row, B next row] -> [A row, B row | A next row, B next row]
+    const __m256i rows = _mm256_permute4x64_epi64(px, 0xD8);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm256_castsi256_si128(rows));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + CARDGFX_FULLWIDTH_PX), _mm256_extracti128_si256(rows, 1));
+}
+
+WCT_TARGET("avx2")
+static inline __m256i LoadTilePairAVX2(const uint8_t *src, uint32_t offset)
+{
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + offset));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + TILE_BYTES + offset));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(a), b, 1);
+}
+
+WCT_TARGET("avx2")
+static void Unpack6bppAVX2(const uint8_t *src, uint8_t *base)
+{
+    for(uint32_t ty = 0; ty < CARDGFX_TILEMAP_HEIGHT; ty++)
+    {
+        uint8_t *dst = base + ty * TILEPITCH;
+        uint32_t tx  = 0;
+        for(; tx + 2 <= CARDGFX_TILEMAP_WIDTH; tx += 2)
+        {
+            const __m256i v0 = LoadTilePairAVX2(src, 0);
+            const __m256i v1 = LoadTilePairAVX2(src, 16);
+            const __m256i v2 = LoadTilePairAVX2(src, 32);
+
+            StoreRowPairAVX2(dst,                            Expand12AVX2(v0));
+            StoreRowPairAVX2(dst + 2 * CARDGFX_FULLWIDTH_PX, Expand12AVX2(_mm256_alignr_epi8(v1, v0, 12)));
+            StoreRowPairAVX2(dst + 4 * CARDGFX_FULLWIDTH_PX, Expand12AVX2(_mm256_alignr_epi8(v2, v1, 8)));
+            StoreRowPairAVX2(dst + 6 * CARDGFX_FULLWIDTH_PX, Expand12AVX2(_mm256_srli_si256(v2, 4)));
+
+            src += 2 * TILE_BYTES;
+            dst += 2 * CARDGFX_TILE_WIDTH_PX;
+        }
+
+        // odd tile out at the end of the row
+        for(; tx < CARDGFX_TILEMAP_WIDTH; tx++)
+        {
+            UnpackTileSSSE3(src, dst);
+            src += TILE_BYTES;
+            dst += CARDGFX_TILE_WIDTH_PX;
+        }
+    }
+}
+
+//=============================================================================
+// SSSE3 packing
+//
+// The reverse of unpacking: with the pixels masked to 6 bits, a multiply-add
+// of byte pairs by [1, 64] gives p0 | p1 << 6 in each 16-bit half, another of
+// word pairs by [1, 4096] joins the halves into the 24-bit group in each
+// dword, and a shuffle squeezes out every fourth byte. Four row pairs give
+// four 12-byte runs, which are spliced into the tile's three 16-byte stores.
+//=============================================================================
+
+WCT_TARGET("ssse3")
+static inline __m128i Compact16SSSE3(__m128i px)
+{
+    const __m128i mask   = _mm_set1_epi8(63);
+    const __m128i mulPx  = _mm_set1_epi16(0x4001);     // bytes [1, 64]
+    const __m128i mulGrp = _mm_set1_epi32(0x10000001); // words [1, 4096]
+    const __m128i shuf   = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    const __m128i pairs  = _mm_maddubs_epi16(_mm_and_si128(px, mask), mulPx);
+    const __m128i groups = _mm_madd_epi16(pairs, mulGrp);
+    return _mm_shuffle_epi8(groups, shuf);
+}
+
+WCT_TARGET("ssse3")
+static inline __m128i LoadRowPairSSSE3(const uint8_t *src)
+{
+    const __m128i r0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src));
+    const __m128i r1 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + CARDGFX_FULLWIDTH_PX));
+    return _mm_unpacklo_epi64(r0, r1);
+}
+
+WCT_TARGET("ssse3")
+static inline void PackTileSSSE3(const uint8_t *src, uint8_t *dst)
+{
+    const __m128i c0 = Compact16SSSE3(LoadRowPairSSSE3(src));
+    const __m128i c1 = Compact16SSSE3(LoadRowPairSSSE3(src + 2 * CARDGFX_FULLWIDTH_PX));
+    const __m128i c2 = Compact16SSSE3(LoadRowPairSSSE3(src + 4 * CARDGFX_FULLWIDTH_PX));
+    const __m128i c3 = Compact16SSSE3(LoadRowPairSSSE3(src + 6 * CARDGFX_FULLWIDTH_PX));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),      _mm_or_si128(c0, _mm_slli_si128(c1, 12)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), _mm_or_si128(_mm_srli_si128(c1, 4), _mm_slli_si128(c2, 8)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 32), _mm_or_si128(_mm_srli_si128(c2, 8), _mm_slli_si128(c3, 4)));
+}
+
+WCT_TARGET("ssse3")
+static void Pack6bppSSSE3(const uint8_t *base, uint8_t *dst)
+{
+    for(uint32_t ty = 0; ty < CARDGFX_TILEMAP_HEIGHT; ty++)
+    {
+        const uint8_t *src = base + ty * TILEPITCH;
+        for(uint32_t tx = 0; tx < CARDGFX_TILEMAP_WIDTH; tx++)
+        {
+            PackTileSSSE3(src, dst);
+            src += CARDGFX_TILE_WIDTH_PX;
+            dst += TILE_BYTES;
+        }
+    }
+}
+
+//=============================================================================
+// AVX2 packing
+//
+// Two adjacent tiles at once: each image row supplies 16 bytes covering both,
+// which are regrouped so each 128-bit lane holds one tile's row pair, and the
+// lanes are stored to consecutive tiles.
+//=============================================================================
+
+WCT_TARGET("avx2")
+static inline __m256i Compact16AVX2(__m256i px)
+{
+    const __m256i mask   = _mm256_set1_epi8(63);
+    const __m256i mulPx  = _mm256_set1_epi16(0x4001);
+    const __m256i mulGrp = _mm256_set1_epi32(0x10000001);
+    const __m256i shuf   = _mm256_setr_epi8(
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1
+    );
+
+    const __m256i pairs  = _mm256_maddubs_epi16(_mm256_and_si256(px, mask), mulPx);
+    const __m256i groups = _mm256_madd_epi16(pairs, mulGrp);
+    return _mm256_shuffle_epi8(groups, shuf);
+}
+
+WCT_TARGET("avx2")
+static inline __m256i LoadRowPairAVX2(const uint8_t *src)
+{
+    // [A row, B row | A next row, B next row] -> [A row, A next row | B row, B next row]
+    const __m128i r0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    const __m128i r1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + CARDGFX_FULLWIDTH_PX));
+    return _mm256_permute4x64_epi64(_mm256_inserti128_si256(_mm256_castsi128_si256(r0), r1, 1), 0xD8);
+}
+
+WCT_TARGET("avx2")
+static inline void StoreTilePairAVX2(uint8_t *dst, uint32_t offset, __m256i v)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + offset),              _mm256_castsi256_si128(v));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + TILE_BYTES + offset), _mm256_extracti128_si256(v, 1));
+}
+
+WCT_TARGET("avx2")
+static void Pack6bppAVX2(const uint8_t *base, uint8_t *dst)
+{
+    for(uint32_t ty = 0; ty < CARDGFX_TILEMAP_HEIGHT; ty++)
+    {
+        const uint8_t *src = base + ty * TILEPITCH;
+        uint32_t       tx  = 0;
+        for(; tx + 2 <= CARDGFX_TILEMAP_WIDTH; tx += 2)
+        {
+            const __m256i c0 = Compact16AVX2(LoadRowPairAVX2(src));
+            const __m256i c1 = Compact16AVX2(LoadRowPairAVX2(src + 2 * CARDGFX_FULLWIDTH_PX));
+            const __m256i c2 = Compact16AVX2(LoadRowPairAVX2(src + 4 * CARDGFX_FULLWIDTH_PX));
+            const __m256i c3 = Compact16AVX2(LoadRowPairAVX2(src + 6 * CARDGFX_FULLWIDTH_PX));
+
+            StoreTilePairAVX2(dst,  0, _mm256_or_si256(c0, _mm256_slli_si256(c1, 12)));
+            StoreTilePairAVX2(dst, 16, _mm256_or_si256(_mm256_srli_si256(c1, 4), _mm256_slli_si256(c2, 8)));
+            StoreTilePairAVX2(dst, 32, _mm256_or_si256(_mm256_srli_si256(c2, 8), _mm256_slli_si256(c3, 4)));
+
+            src += 2 * CARDGFX_TILE_WIDTH_PX;
+            dst += 2 * TILE_BYTES;
+        }
+
+        // odd tile out at the end of the row
+        for(; tx < CARDGFX_TILEMAP_WIDTH; tx++)
+        {
+            PackTileSSSE3(src, dst);
+            src += CARDGFX_TILE_WIDTH_PX;
+            dst += TILE_BYTES;
+        }
+    }
+}
+
+#endif // WCT_X86_SIMD
+
+//=============================================================================
+// Dispatch
+//=============================================================================
+
+//
+// All implementations the CPU can run, starting with the portable one
+//
+std::vector<WCTPixelCodec::unpackimpl_t> WCTPixelCodec::UnpackImplementations()
+{
+    std::vector<unpackimpl_t> impls;
+    impls.push_back({ "scalar", Unpack6bppScalar });
+#if WCT_X86_SIMD
+    if(WCTCPUFeatures::HasSSSE3())
+        impls.push_back({ "SSSE3", Unpack6bppSSSE3 });
+    if(WCTCPUFeatures::HasAVX2())
+        impls.push_back({ "AVX2", Unpack6bppAVX2 });
+#endif
+    return impls;
+}
+
+//
+// Unpack one card graphic with the fastest available implementation
+//
+void WCTPixelCodec::Unpack6bpp(const uint8_t *src, uint8_t *dst)
+{
+    static const unpackfn_t fn = UnpackImplementations().back().fn;
+    fn(src, dst);
+}
+
+//
+// All packing implementations the CPU can run, starting with the portable one
+//
+std::vector<WCTPixelCodec::packimpl_t> WCTPixelCodec::PackImplementations()
+{
+    std::vector<packimpl_t> impls;
+    impls.push_back({ "scalar", Pack6bppScalar });
+#if WCT_X86_SIMD
+    if(WCTCPUFeatures::HasSSSE3())
+        impls.push_back({ "SSSE3", Pack6bppSSSE3 });
+    if(WCTCPUFeatures::HasAVX2())
+        impls.push_back({ "AVX2", Pack6bppAVX2 });
+#endif
+    return impls;
+}
+
+//
+// Pack one card graphic with the fastest available implementation
+//
+void WCTPixelCodec::Pack6bpp(const uint8_t *src, uint8_t *dst)
+{
+    static const packfn_t fn = PackImplementations().back().fn;
+    fn(src, dst);
+}
+
+// EOF
@@ -0,0 +1,60 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <vector>
+
+//
+// Conversion between the ROM's packed 6bpp tiled card graphics and linear
+// 8-bit images. There is a portable implementation plus SIMD versions, and
+// the fastest one the CPU supports is picked at runtime.
+//
+namespace WCTPixelCodec
+{
+    // src is CARDGFX_READ_SIZEOF bytes of tile data; dst is CARDGFX_PIXEL_COUNT pixels
+    using unpackfn_t = void (*)(const uint8_t *src, uint8_t *dst);
+
+    struct unpackimpl_t
+    {
+        const char *name;
+        unpackfn_t  fn;
+    };
+
+    // src is CARDGFX_PIXEL_COUNT pixels, of which only the low 6 bits are
+    // kept; dst is CARDGFX_READ_SIZEOF bytes of tile data
+    using packfn_t = void (*)(const uint8_t *src, uint8_t *dst);
+
+    struct packimpl_t
+    {
+        const char *name;
+        packfn_t    fn;
+    };
+
+    // Unpack one card graphic
+    void Unpack6bpp(const uint8_t *src, uint8_t *dst);
+
+    // Pack one card graphic
+    void Pack6bpp(const uint8_t *src, uint8_t *dst);
+
+    // All implementations the CPU can run, starting with the portable one
+    // which the others must match exactly
+    std::vector<unpackimpl_t> UnpackImplementations();
+    std::vector<packimpl_t>   PackImplementations();
+}
+
+// EOF
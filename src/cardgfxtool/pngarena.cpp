@@ -0,0 +1,136 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <cstdlib>
+
+#include "elib/elib.h"
+#include "pngarena.h"
+
+//
+// The calling thread's arena
+//
+WCTPNGArena &WCTPNGArena::ForThisThread()
+{
+    thread_local WCTPNGArena arena;
+    return arena;
+}
+
+WCTPNGArena::~WCTPNGArena()
+{
+    std::free(m_block);
+    std::free(m_scratch);
+}
+
+//
+// Start allocating from the beginning of the block again, first growing it
+// to hold everything the last round needed if that didn't fit. Only safe
+// when nothing allocated from it is still alive.
+//
+void WCTPNGArena::Rewind()
+{
+    if(m_live != 0)
+        return; // keep going from where we are; the heap will take up any slack
+
+    if(m_spilledBytes != 0)
+    {
+        const size_t newsize = m_used + m_spilledBytes;
+        if(uint8_t *const block = static_cast<uint8_t *>(std::malloc(newsize)); block != nullptr)
+        {
+            std::free(m_block);
+            m_block     = block;
+            m_blockSize = newsize;
+        }
+        m_spilledBytes = 0;
+    }
+    m_used = 0;
+}
+
+//
+// Create a libpng read struct allocating from this arena
+//
+png_structp WCTPNGArena::CreateReadStruct()
+{
+    Rewind();
+    return png_create_read_struct_2(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr, this, Malloc, Free);
+}
+
+//
+// Create a libpng write struct allocating from this arena
+//
+png_structp WCTPNGArena::CreateWriteStruct()
+{
+    Rewind();
+    return png_create_write_struct_2(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr, this, Malloc, Free);
+}
+
+//
+// A buffer of at least size bytes, kept from one call to the next
+//
+uint8_t *WCTPNGArena::Scratch(size_t size)
+{
+    if(size > m_scratchSize)
+    {
+        std::free(m_scratch);
+        m_scratch     = static_cast<uint8_t *>(std::malloc(size));
+        m_scratchSize = m_scratch != nullptr ? size : 0;
+    }
+    return m_scratch;
+}
+
+//
+// libpng allocation callback
+//
+png_voidp PNGCBAPI WCTPNGArena::Malloc(png_structp pngptr, png_alloc_size_t size)
+{
+    WCTPNGArena *const arena = static_cast<WCTPNGArena *>(png_get_mem_ptr(pngptr));
+    const size_t rounded = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    if(rounded <= arena->m_blockSize - arena->m_used)
+    {
+        void *const p = arena->m_block + arena->m_used;
+        arena->m_used += rounded;
+        ++arena->m_live;
+        return p;
+    }
+
+    void *const p = std::malloc(size);
+    if(p != nullptr)
+    {
+        arena->m_spilledBytes += rounded;
+        ++arena->m_spills;
+        ++arena->m_live;
+    }
+    return p;
+}
+
+//
+// libpng free callback
+//
+void PNGCBAPI WCTPNGArena::Free(png_structp pngptr, png_voidp ptr)
+{
+    if(ptr == nullptr)
+        return;
+
+    WCTPNGArena *const arena = static_cast<WCTPNGArena *>(png_get_mem_ptr(pngptr));
+    --arena->m_live;
+
+    const uint8_t *const p = static_cast<const uint8_t *>(ptr);
+    if(p < arena->m_block || p >= arena->m_block + arena->m_blockSize)
+        std::free(ptr);
+}
+
+// EOF
@@ -0,0 +1,77 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include "png.h"
+
+//
+// Per-thread memory for PNG coding, so that encoding or decoding thousands
+// of card pictures on a thread doesn't go back to the heap for every one.
+//
+// libpng structs created through an arena take all of their memory, zlib's
+// included, from one block owned by the arena. Frees are ignored, and the
+// block is rewound when the next struct is created. Anything that doesn't
+// fit comes from the heap instead, and the block is grown at the next rewind
+// so that it fits from then on.
+//
+// The arena also holds a scratch buffer for rows that can't be decoded
+// straight into their destination.
+//
+class WCTPNGArena final
+{
+public:
+    // The calling thread's arena
+    static WCTPNGArena &ForThisThread();
+
+    ~WCTPNGArena();
+
+    // Create a libpng struct allocating from this arena. Release it with
+    // WCTPNGAutoRelease as usual. Only one struct may be alive at a time.
+    png_structp CreateReadStruct();
+    png_structp CreateWriteStruct();
+
+    // A buffer of at least size bytes, kept from one call to the next
+    uint8_t *Scratch(size_t size);
+
+    // Number of allocations that have had to go to the heap so far
+    size_t GetSpills() const { return m_spills; }
+
+private:
+    WCTPNGArena() = default;
+    WCTPNGArena(const WCTPNGArena &) = delete;
+    WCTPNGArena &operator = (const WCTPNGArena &) = delete;
+
+    static constexpr size_t ALIGNMENT = 16;
+
+    uint8_t *m_block        = nullptr;
+    size_t   m_blockSize    = 0;
+    size_t   m_used         = 0;
+    size_t   m_live         = 0; // allocations not yet freed
+    size_t   m_spilledBytes = 0; // heap bytes since the last rewind
+    size_t   m_spills       = 0;
+
+    uint8_t *m_scratch     = nullptr;
+    size_t   m_scratchSize = 0;
+
+    void Rewind();
+
+    static png_voidp PNGCBAPI Malloc(png_structp pngptr, png_alloc_size_t size);
+    static void PNGCBAPI Free(png_structp pngptr, png_voidp ptr);
+};
+
+// EOF
@@ -0,0 +1,52 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include "png.h"
+
+//
+// Automatically releases libpng resources at scope exit
+//
+class WCTPNGAutoRelease final
+{
+public:
+    enum class Mode
+    {
+        WRITE,
+        READ
+    };
+
+    explicit WCTPNGAutoRelease(png_structp p, Mode mode = Mode::WRITE) : m_pngptr(p), m_mode(mode) {}
+
+    ~WCTPNGAutoRelease()
+    {
+        if(m_mode == Mode::READ)
+            png_destroy_read_struct(&m_pngptr, &m_infoptr, nullptr);
+        else
+            png_destroy_write_struct(&m_pngptr, &m_infoptr);
+    }
+
+    void SetInfoPtr(png_infop info) { m_infoptr = info; }
+
+private:
+    png_structp m_pngptr  = nullptr;
+    png_infop   m_infoptr = nullptr;
+    Mode        m_mode    = Mode::WRITE;
+};
+
+// EOF
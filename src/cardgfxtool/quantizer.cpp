@@ -0,0 +1,419 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <memory>
+
+#include "elib/elib.h"
+#include "../common/cpufeatures.h"
+#include "colorconvert.h"
+#include "quantizer.h"
+
+#if WCT_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace WCTConstants;
+using WCTColor::gbacolor_t;
+
+static constexpr uint32_t NUMCOLORS555 = 0x8000;
+
+// rounds of k-means refinement after the median cut
+static constexpr int KMEANS_ITERATIONS = 6;
+
+// ordered dither spread, in 8-bit component units; one RGB555 step is 8
+static constexpr int DITHER_AMPLITUDE = 16;
+
+static constexpr uint8_t BAYER4[4][4] =
+{
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 }
+};
+
+//
+// A distinct RGB555 color and how many pixels have it
+//
+struct colorcount_t
+{
+    gbacolor_t color;
+    uint32_t   count;
+};
+
+static inline int Component(gbacolor_t color, int axis)
+{
+    return (color >> (axis * 5)) & 0x1F;
+}
+
+//=============================================================================
+// Portable implementation
+//=============================================================================
+
+//
+// Find the nearest palette entry to each color by squared RGB555 distance
+//
+static void NearestScalar(const gbacolor_t *colors, size_t count, const WCTQuantizer::palette_t &palette, uint32_t numentries, uint8_t *indices)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        const int r = WCTColor::R5(colors[i]);
+        const int g = WCTColor::G5(colors[i]);
+        const int b = WCTColor::B5(colors[i]);
+
+        int     bestdist = INT_MAX;
+        uint8_t best     = 0;
+        for(uint32_t p = 0; p < numentries; p++)
+        {
+            const int dr = r - WCTColor::R5(palette[p]);
+            const int dg = g - WCTColor::G5(palette[p]);
+            const int db = b - WCTColor::B5(palette[p]);
+            const int dist = dr * dr + dg * dg + db * db;
+            if(dist < bestdist)
+            {
+                bestdist = dist;
+                best     = uint8_t(p);
+            }
+        }
+        indices[i] = best;
+    }
+}
+
+#if WCT_X86_SIMD
+
+//=============================================================================
+// SSE4.1 implementation
+//
+// The palette is split into planes of 16-bit red, green, and blue values,
+// eight entries to a vector. Distances fit in 16 bits (at most 3 * 31^2),
+// so phminposuw finds the closest of each eight entries and its position in
+// one instruction. Unused entries are padded with a component value far
+// enough away that they never win.
+//=============================================================================
+
+static constexpr int16_t NEAREST_PAD = 100; // 3 * 100^2 is still under 65536
+
+WCT_TARGET("sse4.1")
+static void NearestSSE41(const gbacolor_t *colors, size_t count, const WCTQuantizer::palette_t &palette, uint32_t numentries, uint8_t *indices)
+{
+    constexpr uint32_t LANES = 8;
+    constexpr uint32_t GROUPS = CARDPALETTE_NUMENTRIES / LANES;
+
+    alignas(16) int16_t planes[3][CARDPALETTE_NUMENTRIES];
+    for(uint32_t p = 0; p < CARDPALETTE_NUMENTRIES; p++)
+    {
+        const bool used = p < numentries;
+        planes[0][p] = used ? int16_t(WCTColor::R5(palette[p])) : NEAREST_PAD;
+        planes[1][p] = used ? int16_t(WCTColor::G5(palette[p])) : NEAREST_PAD;
+        planes[2][p] = used ? int16_t(WCTColor::B5(palette[p])) : NEAREST_PAD;
+    }
+    const uint32_t numgroups = std::max(1u, std::min(GROUPS, (numentries + LANES - 1) / LANES));
+
+    __m128i pr[GROUPS], pg[GROUPS], pb[GROUPS];
+    for(uint32_t n = 0; n < numgroups; n++)
+    {
+        pr[n] = _mm_load_si128(reinterpret_cast<const __m128i *>(&planes[0][n * LANES]));
+        pg[n] = _mm_load_si128(reinterpret_cast<const __m128i *>(&planes[1][n * LANES]));
+        pb[n] = _mm_load_si128(reinterpret_cast<const __m128i *>(&planes[2][n * LANES]));
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        const __m128i r = _mm_set1_epi16(short(WCTColor::R5(colors[i])));
+        const __m128i g = _mm_set1_epi16(short(WCTColor::G5(colors[i])));
+        const __m128i b = _mm_set1_epi16(short(WCTColor::B5(colors[i])));
+
+        uint32_t bestdist = UINT32_MAX;
+        uint32_t best     = 0;
+        for(uint32_t n = 0; n < numgroups; n++)
+        {
+            const __m128i dr = _mm_sub_epi16(r, pr[n]);
+            const __m128i dg = _mm_sub_epi16(g, pg[n]);
+            const __m128i db = _mm_sub_epi16(b, pb[n]);
+            const __m128i dist = _mm_add_epi16(
+                _mm_add_epi16(_mm_mullo_epi16(dr, dr), _mm_mullo_epi16(dg, dg)),
+                _mm_mullo_epi16(db, db)
+            );
+
+            // low word is the minimum, the next word its lane
+            const uint32_t minpos = uint32_t(_mm_cvtsi128_si32(_mm_minpos_epu16(dist)));
+            if((minpos & 0xFFFF) < bestdist)
+            {
+                bestdist = minpos & 0xFFFF;
+                best     = n * LANES + (minpos >> 16);
+            }
+        }
+        indices[i] = uint8_t(best);
+    }
+}
+
+#endif // WCT_X86_SIMD
+
+//=============================================================================
+// Quantization
+//=============================================================================
+
+//
+// Turn a list of RGB555 colors into the sorted distinct colors with counts
+//
+static void CountColors(std::vector<gbacolor_t> &keys, std::vector<colorcount_t> &counts)
+{
+    std::sort(keys.begin(), keys.end());
+    counts.clear();
+    for(gbacolor_t key : keys)
+    {
+        if(counts.empty() == false && counts.back().color == key)
+            ++counts.back().count;
+        else
+            counts.push_back({ key, 1 });
+    }
+}
+
+//
+// Weighted mean color of a run of color counts
+//
+static gbacolor_t MeanColor(const colorcount_t *begin, const colorcount_t *end)
+{
+    uint64_t sum[3] = {}, total = 0;
+    for(const colorcount_t *cc = begin; cc != end; ++cc)
+    {
+        for(int axis = 0; axis < 3; axis++)
+            sum[axis] += uint64_t(Component(cc->color, axis)) * cc->count;
+        total += cc->count;
+    }
+
+    gbacolor_t color = 0;
+    for(int axis = 0; axis < 3; axis++)
+        color |= gbacolor_t((sum[axis] + total / 2) / total) << (axis * 5);
+    return color;
+}
+
+//
+// Median cut: repeatedly split the box with the longest side at the weighted
+// median along that side, until there is one box per palette entry
+//
+static uint32_t MedianCut(std::vector<colorcount_t> &counts, WCTQuantizer::palette_t &palette)
+{
+    struct box_t
+    {
+        size_t   begin, end;
+        int      axis;  // longest side
+        int      range; // its length
+        uint32_t count; // pixels inside
+    };
+
+    const auto makebox = [&counts] (size_t begin, size_t end) {
+        box_t box { begin, end, 0, -1, 0 };
+        for(int axis = 0; axis < 3; axis++)
+        {
+            int lo = 31, hi = 0;
+            for(size_t i = begin; i < end; i++)
+            {
+                lo = std::min(lo, Component(counts[i].color, axis));
+                hi = std::max(hi, Component(counts[i].color, axis));
+            }
+            if(hi - lo > box.range)
+            {
+                box.axis  = axis;
+                box.range = hi - lo;
+            }
+        }
+        for(size_t i = begin; i < end; i++)
+            box.count += counts[i].count;
+        return box;
+    };
+
+    std::vector<box_t> boxes;
+    boxes.reserve(palette.size());
+    boxes.push_back(makebox(0, counts.size()));
+
+    while(boxes.size() < palette.size())
+    {
+        // biggest spread of color, weighted by how much of the image it covers
+        box_t *pick = nullptr;
+        uint64_t pickscore = 0;
+        for(box_t &box : boxes)
+        {
+            const uint64_t score = uint64_t(box.range) * box.range * box.count;
+            if(box.end - box.begin > 1 && score > pickscore)
+            {
+                pick      = &box;
+                pickscore = score;
+            }
+        }
+        if(pick == nullptr)
+            break;
+
+        const int axis = pick->axis;
+        std::sort(counts.begin() + pick->begin, counts.begin() + pick->end, [axis] (const colorcount_t &a, const colorcount_t &b) {
+            return Component(a.color, axis) < Component(b.color, axis);
+        });
+
+        // split after the color that takes the running count past half way,
+        // leaving at least one color on each side
+        size_t   split = pick->begin + 1;
+        uint32_t run   = counts[pick->begin].count;
+        while(split < pick->end - 1 && run + counts[split].count <= pick->count / 2)
+            run += counts[split++].count;
+
+        const size_t begin = pick->begin, end = pick->end;
+        *pick = makebox(begin, split);
+        boxes.push_back(makebox(split, end));
+    }
+
+    for(size_t i = 0; i < boxes.size(); i++)
+        palette[i] = MeanColor(counts.data() + boxes[i].begin, counts.data() + boxes[i].end);
+    return uint32_t(boxes.size());
+}
+
+//
+// Move each palette entry to the weighted mean of the colors nearest it,
+// until nothing changes or the iteration limit is reached
+//
+static void RefineKMeans(
+    const std::vector<colorcount_t> &counts, WCTQuantizer::palette_t &palette, uint32_t numentries,
+    WCTQuantizer::nearestfn_t nearest
+)
+{
+    std::vector<gbacolor_t> colors(counts.size());
+    for(size_t i = 0; i < counts.size(); i++)
+        colors[i] = counts[i].color;
+    std::vector<uint8_t> assign(counts.size());
+
+    for(int iter = 0; iter < KMEANS_ITERATIONS; iter++)
+    {
+        nearest(colors.data(), colors.size(), palette, numentries, assign.data());
+
+        uint64_t sum[CARDPALETTE_NUMENTRIES][3] = {};
+        uint64_t total[CARDPALETTE_NUMENTRIES]  = {};
+        for(size_t i = 0; i < counts.size(); i++)
+        {
+            for(int axis = 0; axis < 3; axis++)
+                sum[assign[i]][axis] += uint64_t(Component(counts[i].color, axis)) * counts[i].count;
+            total[assign[i]] += counts[i].count;
+        }
+
+        bool changed = false;
+        for(uint32_t p = 0; p < numentries; p++)
+        {
+            if(total[p] == 0)
+                continue; // nothing nearby; leave it where it is
+            gbacolor_t color = 0;
+            for(int axis = 0; axis < 3; axis++)
+                color |= gbacolor_t((sum[p][axis] + total[p] / 2) / total[p]) << (axis * 5);
+            changed = changed || color != palette[p];
+            palette[p] = color;
+        }
+        if(changed == false)
+            break;
+    }
+}
+
+//
+// Truncate a pixel to RGB555, after adding a dither offset
+//
+static inline gbacolor_t ToRGB555(const uint8_t *px, int offset)
+{
+    const auto c5 = [offset] (int c) { return gbacolor_t(std::clamp(c + offset, 0, 255) >> 3); };
+    return gbacolor_t(c5(px[0]) | (c5(px[1]) << 5) | (c5(px[2]) << 10));
+}
+
+//
+// Quantize an image of 8-bit RGB triples
+//
+void WCTQuantizer::Quantize(const uint8_t *rgb, uint32_t width, uint32_t height, Dither dither, palette_t &palette, uint8_t *indices)
+{
+    static const nearestfn_t nearest = NearestImplementations().back().fn;
+
+    const size_t numpixels = size_t(width) * height;
+    palette.fill(0);
+    if(numpixels == 0)
+        return;
+
+    std::vector<gbacolor_t> keys(numpixels);
+    WCTColorConvert::FromRGB(rgb, numpixels, keys.data());
+
+    std::vector<gbacolor_t>   sorted = keys;
+    std::vector<colorcount_t> counts;
+    CountColors(sorted, counts);
+
+    uint32_t numentries;
+    if(counts.size() <= palette.size())
+    {
+        // few enough colors to keep them all exactly, so there is nothing to dither
+        numentries = uint32_t(counts.size());
+        for(uint32_t p = 0; p < numentries; p++)
+            palette[p] = counts[p].color;
+        dither = Dither::NONE;
+    }
+    else
+    {
+        numentries = MedianCut(counts, palette);
+        RefineKMeans(counts, palette, numentries, nearest);
+    }
+
+    if(dither == Dither::ORDERED)
+    {
+        for(uint32_t y = 0; y < height; y++)
+        {
+            for(uint32_t x = 0; x < width; x++)
+            {
+                const int offset = (BAYER4[y & 3][x & 3] * 2 - 15) * DITHER_AMPLITUDE / 32;
+                const size_t i = size_t(y) * width + x;
+                keys[i] = ToRGB555(rgb + i * 3, offset);
+            }
+        }
+        sorted = keys;
+        CountColors(sorted, counts);
+    }
+
+    // look up each distinct color once, then map the pixels through a table
+    std::vector<gbacolor_t> colors(counts.size());
+    for(size_t i = 0; i < counts.size(); i++)
+        colors[i] = counts[i].color;
+    std::vector<uint8_t> assign(colors.size());
+    nearest(colors.data(), colors.size(), palette, numentries, assign.data());
+
+    std::unique_ptr<uint8_t []> upTable { new uint8_t [NUMCOLORS555] };
+    for(size_t i = 0; i < colors.size(); i++)
+        upTable[colors[i]] = assign[i];
+    for(size_t i = 0; i < numpixels; i++)
+        indices[i] = upTable[keys[i]];
+}
+
+//=============================================================================
+// Dispatch
+//=============================================================================
+
+//
+// All nearest-color implementations the CPU can run, starting with the
+// portable one
+//
+std::vector<WCTQuantizer::nearestimpl_t> WCTQuantizer::NearestImplementations()
+{
+    std::vector<nearestimpl_t> impls;
+    impls.push_back({ "scalar", NearestScalar });
+#if WCT_X86_SIMD
+    if(WCTCPUFeatures::HasSSE41())
+        impls.push_back({ "SSE4.1", NearestSSE41 });
+#endif
+    return impls;
+}
+
+// EOF
@@ -0,0 +1,65 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include "../common/colors.h"
+#include "../common/romoffsets.h"
+
+//
+// Reduction of truecolor card art to a palette the GBA can use: at most
+// CARDPALETTE_NUMENTRIES RGB555 colors. Pixels are first truncated to RGB555,
+// and if that leaves few enough colors they are used exactly. Otherwise a
+// median cut over the RGB555 color histogram picks a starting palette which
+// a few rounds of k-means then refine.
+//
+// Finding the nearest palette entry is the inner loop of both k-means and
+// the final remapping, so it has a SIMD version picked at runtime.
+//
+namespace WCTQuantizer
+{
+    using palette_t = std::array<WCTColor::gbacolor_t, WCTConstants::CARDPALETTE_NUMENTRIES>;
+
+    enum class Dither
+    {
+        NONE,
+        ORDERED // 4x4 Bayer pattern applied when pixels are mapped to the palette
+    };
+
+    // For each of count RGB555 colors, find the index of the closest of the
+    // first numentries palette colors; ties go to the lowest index
+    using nearestfn_t = void (*)(const WCTColor::gbacolor_t *colors, size_t count, const palette_t &palette, uint32_t numentries, uint8_t *indices);
+
+    struct nearestimpl_t
+    {
+        const char *name;
+        nearestfn_t fn;
+    };
+
+    // Quantize an image of 8-bit RGB triples, stored in rows of width pixels,
+    // into a palette and one palette index per pixel. Unused palette entries
+    // are set to black.
+    void Quantize(const uint8_t *rgb, uint32_t width, uint32_t height, Dither dither, palette_t &palette, uint8_t *indices);
+
+    // All nearest-color implementations the CPU can run, starting with the
+    // portable one which the others must match exactly
+    std::vector<nearestimpl_t> NearestImplementations();
+}
+
+// EOF
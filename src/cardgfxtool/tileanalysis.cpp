@@ -0,0 +1,202 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+#include <array>
+
+#include "elib/elib.h"
+#include "cardgallery.h"
+#include "tileanalysis.h"
+#include "../common/contenthash.h"
+
+using namespace WCTConstants;
+
+static constexpr uint32_t TILES_PER_CARD = CARDGFX_TILEMAP_WIDTH * CARDGFX_TILEMAP_HEIGHT;
+static constexpr uint32_t TILE_BYTES     = CARDGFX_TILE_WIDTH_PX * CARDGFX_TILE_HEIGHT_PX * CARDGFX_BPP / 8; // 48
+static constexpr size_t   TOP_TILES      = 8;
+
+static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+// one row of eight 8-bit pixels per word
+using tile_t = std::array<uint64_t, CARDGFX_TILE_HEIGHT_PX>;
+static_assert(CARDGFX_TILE_WIDTH_PX == sizeof(uint64_t));
+
+//
+// Mirror a row of eight pixels
+//
+static inline uint64_t ReverseBytes(uint64_t v)
+{
+    v = ((v & 0x00FF00FF00FF00FFull) << 8)  | ((v >> 8)  & 0x00FF00FF00FF00FFull);
+    v = ((v & 0x0000FFFF0000FFFFull) << 16) | ((v >> 16) & 0x0000FFFF0000FFFFull);
+    return (v << 32) | (v >> 32);
+}
+
+//
+// Pick the same one of a tile's four flips whichever flip it starts as, so
+// that tiles which are flips of each other compare equal
+//
+static tile_t CanonicalTile(const tile_t &tile)
+{
+    tile_t hflip, vflip, hvflip;
+    for(size_t y = 0; y < tile.size(); y++)
+    {
+        const size_t yy = tile.size() - 1 - y;
+        hflip[y]   = ReverseBytes(tile[y]);
+        vflip[yy]  = tile[y];
+        hvflip[yy] = hflip[y];
+    }
+    return std::min({ tile, hflip, vflip, hvflip });
+}
+
+//
+// Find identical blocks among count blocks of size bytes laid back to back.
+// Blocks go into an open-addressed table of indices sized to at most half
+// full, keyed by their hash, with the contents compared only when hashes
+// match. Each block's entry in reps is set to the index of the first block
+// like it, and the number of distinct blocks is returned.
+//
+static uint32_t GroupBlocks(const uint8_t *base, size_t size, size_t count, std::vector<uint32_t> &reps)
+{
+    size_t numslots = 16;
+    while(numslots < count * 2)
+        numslots *= 2;
+    const size_t mask = numslots - 1;
+
+    std::vector<uint32_t> slots(numslots, EMPTY_SLOT);
+    std::vector<uint64_t> hashes(count);
+    reps.resize(count);
+
+    uint32_t distinct = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        const uint8_t *const block = base + i * size;
+        const uint64_t hash = WCTContentHash::Hash64(block, size);
+        hashes[i] = hash;
+
+        for(size_t s = size_t(hash) & mask; ; s = (s + 1) & mask)
+        {
+            const uint32_t j = slots[s];
+            if(j == EMPTY_SLOT)
+            {
+                slots[s] = uint32_t(i);
+                reps[i]  = uint32_t(i);
+                ++distinct;
+                break;
+            }
+            if(hashes[j] == hash && std::memcmp(base + j * size, block, size) == 0)
+            {
+                reps[i] = j;
+                break;
+            }
+        }
+    }
+    return distinct;
+}
+
+//
+// Collect the sets of more than one member from a GroupBlocks result, as
+// picture numbers, largest first
+//
+static std::vector<std::vector<uint32_t>> CollectGroups(const std::vector<uint32_t> &reps, uint32_t first)
+{
+    std::vector<uint32_t> sizes(reps.size());
+    for(uint32_t rep : reps)
+        ++sizes[rep];
+
+    std::vector<std::vector<uint32_t>> groups;
+    std::vector<int32_t> groupfor(reps.size(), -1);
+    for(size_t i = 0; i < reps.size(); i++)
+    {
+        const uint32_t rep = reps[i];
+        if(sizes[rep] < 2)
+            continue;
+        if(groupfor[rep] < 0)
+        {
+            groupfor[rep] = int32_t(groups.size());
+            groups.emplace_back();
+        }
+        groups[groupfor[rep]].push_back(first + uint32_t(i));
+    }
+
+    std::stable_sort(groups.begin(), groups.end(), [] (const auto &a, const auto &b) { return a.size() > b.size(); });
+    return groups;
+}
+
+//
+// Analyze every picture in the gallery
+//
+void WCTTileAnalysis::Analyze(const WCTCardGallery &gallery, results_t &results)
+{
+    results = results_t {};
+    results.numCards = gallery.GetCount();
+    results.numTiles = results.numCards * TILES_PER_CARD;
+    if(results.numCards == 0)
+        return;
+
+    std::vector<uint32_t> reps;
+
+    // exact tiles, straight from the packed data, where they are already
+    // stored one after another
+    static_assert(CARDGFX_READ_SIZEOF == TILES_PER_CARD * TILE_BYTES);
+    results.uniqueTiles = GroupBlocks(gallery.GetAllRawData(), TILE_BYTES, results.numTiles, reps);
+
+    // tiles up to flipping, from the decoded pixels
+    std::vector<tile_t> tiles(results.numTiles);
+    const uint8_t *const pixels = gallery.GetAllPixels();
+    for(uint32_t c = 0; c < results.numCards; c++)
+    {
+        for(uint32_t t = 0; t < TILES_PER_CARD; t++)
+        {
+            const uint32_t tx = t % CARDGFX_TILEMAP_WIDTH;
+            const uint32_t ty = t / CARDGFX_TILEMAP_WIDTH;
+            const uint8_t *src = pixels + size_t(c) * CARDGFX_PIXEL_COUNT +
+                                 ty * CARDGFX_TILE_HEIGHT_PX * CARDGFX_FULLWIDTH_PX + tx * CARDGFX_TILE_WIDTH_PX;
+
+            tile_t tile;
+            for(size_t y = 0; y < tile.size(); y++)
+                std::memcpy(&tile[y], src + y * CARDGFX_FULLWIDTH_PX, sizeof(uint64_t));
+            tiles[size_t(c) * TILES_PER_CARD + t] = CanonicalTile(tile);
+        }
+    }
+    results.uniqueTilesFlipped = GroupBlocks(reinterpret_cast<const uint8_t *>(tiles.data()), sizeof(tile_t), tiles.size(), reps);
+
+    std::vector<uint32_t> uses(reps.size());
+    for(uint32_t rep : reps)
+        ++uses[rep];
+    std::sort(uses.begin(), uses.end(), std::greater<uint32_t>());
+    for(size_t i = 0; i < TOP_TILES && i < uses.size() && uses[i] > 1; i++)
+        results.topTileCounts.push_back(uses[i]);
+
+    // whole graphics
+    results.uniqueGraphics = GroupBlocks(gallery.GetAllRawData(), CARDGFX_READ_SIZEOF, results.numCards, reps);
+    results.graphicGroups  = CollectGroups(reps, gallery.GetFirst());
+
+    // palettes
+    const std::vector<WCTCardGallery::palette_t> &palettes = gallery.GetAllPalettes();
+    std::vector<uint32_t> palreps;
+    results.uniquePalettes = GroupBlocks(reinterpret_cast<const uint8_t *>(palettes.data()), sizeof(WCTCardGallery::palette_t), palettes.size(), palreps);
+    results.paletteGroups  = CollectGroups(palreps, gallery.GetFirst());
+
+    // graphic and palette pairs: cards sharing both
+    std::vector<uint64_t> pairs(results.numCards);
+    for(uint32_t c = 0; c < results.numCards; c++)
+        pairs[c] = (uint64_t(reps[c]) << 32) | palreps[c];
+    std::sort(pairs.begin(), pairs.end());
+    results.uniqueCardPics = uint32_t(std::unique(pairs.begin(), pairs.end()) - pairs.begin());
+}
+
+// EOF
@@ -0,0 +1,58 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <vector>
+
+class WCTCardGallery;
+
+//
+// Duplication analysis over a gallery of card pictures, to size up how much
+// ROM space sharing graphics data between cards could free: 8x8 tiles that
+// repeat, either exactly or as a horizontal and/or vertical flip of another,
+// whole card graphics that repeat, and palettes that repeat.
+//
+// Tiles are compared by their palette indices alone, so two tiles count as
+// the same even when the cards using them have different palettes.
+//
+namespace WCTTileAnalysis
+{
+    struct results_t
+    {
+        uint32_t numCards = 0;
+        uint32_t numTiles = 0;
+
+        uint32_t uniqueTiles        = 0; // distinct tiles, exact matches only
+        uint32_t uniqueTilesFlipped = 0; // distinct tiles when flips also count as matches
+        uint32_t uniqueGraphics     = 0; // distinct card graphics
+        uint32_t uniqueCardPics     = 0; // distinct graphic and palette pairs
+        uint32_t uniquePalettes     = 0; // distinct palettes
+
+        // how often the most used tiles occur, most used first, when flips count
+        std::vector<uint32_t> topTileCounts;
+
+        // sets of picture numbers sharing a graphic or a palette, largest sets first
+        std::vector<std::vector<uint32_t>> graphicGroups;
+        std::vector<std::vector<uint32_t>> paletteGroups;
+    };
+
+    // Analyze every picture in the gallery
+    void Analyze(const WCTCardGallery &gallery, results_t &results);
+}
+
+// EOF
@@ -0,0 +1,460 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+
+#include "elib/elib.h"
+#include "../common/cpufeatures.h"
+#include "upscale.h"
+
+#if WCT_X86_SIMD
+#include <immintrin.h>
+#endif
+
+//
+// Filter names, for the command line
+//
+static const char *const filterNames[size_t(WCTUpscale::Filter::NUMFILTERS)] =
+{
+    "nearest",
+    "scalex"
+};
+static_assert(std::size(filterNames) == size_t(WCTUpscale::Filter::NUMFILTERS));
+
+//
+// Get the name of a filter
+//
+const char *WCTUpscale::FilterName(Filter filter)
+{
+    return size_t(filter) < std::size(filterNames) ? filterNames[size_t(filter)] : "unknown";
+}
+
+//
+// Look up a filter by name
+//
+bool WCTUpscale::FilterForName(const char *name, Filter &filter)
+{
+    for(size_t i = 0; i < std::size(filterNames); i++)
+    {
+        if(strcasecmp(name, filterNames[i]) == 0)
+        {
+            filter = Filter(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+//=============================================================================
+// Portable implementation
+//
+// Scale2x and Scale3x as given at scale2x.it, where each source pixel E is
+// replaced by a block worked out from its neighbors:
+//
+//    A B C
+//    D E F
+//    G H I
+//
+// Pixels past the left and right edges repeat the edge pixel.
+//=============================================================================
+
+//
+// Repeat each pixel factor times
+//
+static void NearestRowScalar(const uint8_t *src, uint32_t width, uint32_t factor, uint8_t *dst)
+{
+    for(uint32_t x = 0; x < width; x++)
+    {
+        for(uint32_t f = 0; f < factor; f++)
+            *dst++ = src[x];
+    }
+}
+
+//
+// Scale2x for pixels [begin, end) of a row
+//
+static void Scale2xSpan(
+    const uint8_t *above, const uint8_t *row, const uint8_t *below, uint32_t width, uint32_t begin, uint32_t end,
+    uint8_t *dst0, uint8_t *dst1
+)
+{
+    for(uint32_t x = begin; x < end; x++)
+    {
+        const uint32_t xl = x > 0 ? x - 1 : x;
+        const uint32_t xr = x + 1 < width ? x + 1 : x;
+        const uint8_t  B = above[x], D = row[xl], E = row[x], F = row[xr], H = below[x];
+
+        uint8_t E0 = E, E1 = E, E2 = E, E3 = E;
+        if(B != H && D != F)
+        {
+            E0 = D == B ? D : E;
+            E1 = B == F ? F : E;
+            E2 = D == H ? D : E;
+            E3 = H == F ? F : E;
+        }
+        dst0[x * 2] = E0;
+        dst0[x * 2 + 1] = E1;
+        dst1[x * 2] = E2;
+        dst1[x * 2 + 1] = E3;
+    }
+}
+
+static void Scale2xRowScalar(const uint8_t *above, const uint8_t *row, const uint8_t *below, uint32_t width, uint8_t *dst0, uint8_t *dst1)
+{
+    Scale2xSpan(above, row, below, width, 0, width, dst0, dst1);
+}
+
+//
+// Scale3x for pixels [begin, end) of a row
+//
+static void Scale3xSpan(
+    const uint8_t *above, const uint8_t *row, const uint8_t *below, uint32_t width, uint32_t begin, uint32_t end,
+    uint8_t *dst0, uint8_t *dst1, uint8_t *dst2
+)
+{
+    for(uint32_t x = begin; x < end; x++)
+    {
+        const uint32_t xl = x > 0 ? x - 1 : x;
+        const uint32_t xr = x + 1 < width ? x + 1 : x;
+        const uint8_t  A = above[xl], B = above[x], C = above[xr];
+        const uint8_t  D = row[xl],   E = row[x],   F = row[xr];
+        const uint8_t  G = below[xl], H = below[x], I = below[xr];
+
+        uint8_t E0 = E, E1 = E, E2 = E, E3 = E, E5 = E, E6 = E, E7 = E, E8 = E;
+        if(B != H && D != F)
+        {
+            E0 = D == B ? D : E;
+            E1 = (D == B && E != C) || (B == F && E != A) ? B : E;
+            E2 = B == F ? F : E;
+            E3 = (D == B && E != G) || (D == H && E != A) ? D : E;
+            E5 = (B == F && E != I) || (H == F && E != C) ? F : E;
+            E6 = D == H ? D : E;
+            E7 = (D == H && E != I) || (H == F && E != G) ? H : E;
+            E8 = H == F ? F : E;
+        }
+        dst0[x * 3] = E0;
+        dst0[x * 3 + 1] = E1;
+        dst0[x * 3 + 2] = E2;
+        dst1[x * 3] = E3;
+        dst1[x * 3 + 1] = E;
+        dst1[x * 3 + 2] = E5;
+        dst2[x * 3] = E6;
+        dst2[x * 3 + 1] = E7;
+        dst2[x * 3 + 2] = E8;
+    }
+}
+
+static void Scale3xRowScalar(
+    const uint8_t *above, const uint8_t *row, const uint8_t *below, uint32_t width, uint8_t *dst0, uint8_t *dst1, uint8_t *dst2
+)
+{
+    Scale3xSpan(above, row, below, width, 0, width, dst0, dst1, dst2);
+}
+
+#if WCT_X86_SIMD
+
+//=============================================================================
+// SSSE3
+//
+// Sixteen source pixels at a time. Neighbors come from unaligned loads one
+// pixel either side, so the first pixel and any that would need a load past
+// the end of the row are left to the portable code. Each rule becomes a
+// byte mask from comparisons, used to select between the candidate pixel
+// and E, and the resulting blocks are interleaved back into output rows by
+// unpacking (2x) or shuffling (3x and nearest).
+//=============================================================================
+
+//
+// Pick a where mask is set, otherwise b
+//
+WCT_TARGET("ssse3")
+static inline __m128i Select(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+WCT_TARGET("ssse3")
+static inline __m128i Load(const uint8_t *p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+WCT_TARGET("ssse3")
+static inline void Store(uint8_t *p, __m128i v)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+}
+
+//
+// Shuffle masks spreading 16 bytes out factor times over factor registers
+//
+struct spreadmasks_t
+{
+    alignas(16) int8_t masks[WCTUpscale::MAX_FACTOR + 1][WCTUpscale::MAX_FACTOR][16];
+
+    spreadmasks_t()
+    {
+        for(uint32_t factor = 1; factor <= WCTUpscale::MAX_FACTOR; factor++)
+        {
+            for(uint32_t k = 0; k < factor; k++)
+            {
+                for(uint32_t j = 0; j < 16; j++)
+                    masks[factor][k][j] = int8_t((k * 16 + j) / factor);
+            }
+        }
+    }
+};
+static const spreadmasks_t spreadMasks;
+
+//
+// Shuffle masks interleaving three registers. Output byte j of chunk k comes
+// from register (k * 16 + j) % 3 at byte (k * 16 + j) / 3, and the other two
+// registers are shuffled to zero there.
+//
+struct interleavemasks_t
+{
+    alignas(16) int8_t masks[3][3][16]; // [chunk][source register][byte]
+
+    interleavemasks_t()
+    {
+        for(int k = 0; k < 3; k++)
+        {
+            for(int r = 0; r < 3; r++)
+            {
+                for(int j = 0; j < 16; j++)
+                    masks[k][r][j] = (k * 16 + j) % 3 == r ? int8_t((k * 16 + j) / 3) : int8_t(-1);
+            }
+        }
+    }
+};
+static const interleavemasks_t interleaveMasks;
+
+//
+// Repeat each pixel factor times
+//
+WCT_TARGET("ssse3")
+static void NearestRowSSSE3(const uint8_t *src, uint32_t width, uint32_t factor, uint8_t *dst)
+{
+    if(factor < 2 || factor > WCTUpscale::MAX_FACTOR)
+    {
+        NearestRowScalar(src, width, factor, dst);
+        return;
+    }
+
+    uint32_t x = 0;
+    for(; x + 16 <= width; x += 16)
+    {
+        const __m128i v = Load(src + x);
+        for(uint32_t k = 0; k < factor; k++)
+        {
+            const __m128i mask = _mm_load_si128(reinterpret_cast<const __m128i *>(spreadMasks.masks[factor][k]));
+            Store(dst + x * factor + k * 16, _mm_shuffle_epi8(v, mask));
+        }
+    }
+    NearestRowScalar(src + x, width - x, factor, dst + x * factor);
+}
+
+//
+// Scale2x a row
+//
+WCT_TARGET("ssse3")
+static void Scale2xRowSSSE3(const uint8_t *above, const uint8_t *row, const uint8_t *below, uint32_t width, uint8_t *dst0, uint8_t *dst1)
+{
+    const __m128i ones = _mm_set1_epi8(-1);
+
+    uint32_t x = 1;
+    for(; x + 17 <= width; x += 16)
+    {
+        const __m128i B = Load(above + x);
+        const __m128i D = Load(row + x - 1);
+        const __m128i E = Load(row + x);
+        const __m128i F = Load(row + x + 1);
+        const __m128i H = Load(below + x);
+
+        // B != H && D != F
+        const __m128i apply = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(B, H), _mm_cmpeq_epi8(D, F)), ones);
+
+        const __m128i E0 = Select(_mm_and_si128(apply, _mm_cmpeq_epi8(D, B)), D, E);
+        const __m128i E1 = Select(_mm_and_si128(apply, _mm_cmpeq_epi8(B, F)), F, E);
+        const __m128i E2 = Select(_mm_and_si128(apply, _mm_cmpeq_epi8(D, H)), D, E);
+        const __m128i E3 = Select(_mm_and_si128(apply, _mm_cmpeq_epi8(H, F)), F, E);
+
+        Store(dst0 + x * 2,      _mm_unpacklo_epi8(E0, E1));
+        Store(dst0 + x * 2 + 16, _mm_unpackhi_epi8(E0, E1));
+        Store(dst1 + x * 2,      _mm_unpacklo_epi8(E2, E3));
+        Store(dst1 + x * 2 + 16, _mm_unpackhi_epi8(E2, E3));
+    }
+    Scale2xSpan(above, row, below, width, 0, std::min(width, 1u), dst0, dst1);
+    Scale2xSpan(above, row, below, width, x, width, dst0, dst1);
+}
+
+//
+// Interleave three registers into 48 bytes: a0 b0 c0 a1 b1 c1 ...
+//
+WCT_TARGET("ssse3")
+static inline void Store3(uint8_t *dst, __m128i a, __m128i b, __m128i c)
+{
+    for(int k = 0; k < 3; k++)
+    {
+        const __m128i ma = _mm_load_si128(reinterpret_cast<const __m128i *>(interleaveMasks.masks[k][0]));
+        const __m128i mb = _mm_load_si128(reinterpret_cast<const __m128i *>(interleaveMasks.masks[k][1]));
+        const __m128i mc = _mm_load_si128(reinterpret_cast<const __m128i *>(interleaveMasks.masks[k][2]));
+        const __m128i v  = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, ma), _mm_shuffle_epi8(b, mb)), _mm_shuffle_epi8(c, mc));
+        Store(dst + k * 16, v);
+    }
+}
+
+//
+// Scale3x a row
+//
+WCT_TARGET("ssse3")
+static void Scale3xRowSSSE3(
+    const uint8_t *above, const uint8_t *row, const uint8_t *below, uint32_t width, uint8_t *dst0, uint8_t *dst1, uint8_t *dst2
+)
+{
+    const __m128i ones = _mm_set1_epi8(-1);
+
+    uint32_t x = 1;
+    for(; x + 17 <= width; x += 16)
+    {
+        const __m128i A = Load(above + x - 1), B = Load(above + x), C = Load(above + x + 1);
+        const __m128i D = Load(row + x - 1),   E = Load(row + x),   F = Load(row + x + 1);
+        const __m128i G = Load(below + x - 1), H = Load(below + x), I = Load(below + x + 1);
+
+        // B != H && D != F
+        const __m128i apply = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi8(B, H), _mm_cmpeq_epi8(D, F)), ones);
+
+        const __m128i DB = _mm_and_si128(apply, _mm_cmpeq_epi8(D, B));
+        const __m128i BF = _mm_and_si128(apply, _mm_cmpeq_epi8(B, F));
+        const __m128i DH = _mm_and_si128(apply, _mm_cmpeq_epi8(D, H));
+        const __m128i HF = _mm_and_si128(apply, _mm_cmpeq_epi8(H, F));
+
+        // E != corner
+        const __m128i nA = _mm_andnot_si128(_mm_cmpeq_epi8(E, A), ones);
+        const __m128i nC = _mm_andnot_si128(_mm_cmpeq_epi8(E, C), ones);
+        const __m128i nG = _mm_andnot_si128(_mm_cmpeq_epi8(E, G), ones);
+        const __m128i nI = _mm_andnot_si128(_mm_cmpeq_epi8(E, I), ones);
+
+        const __m128i E0 = Select(DB, D, E);
+        const __m128i E1 = Select(_mm_or_si128(_mm_and_si128(DB, nC), _mm_and_si128(BF, nA)), B, E);
+        const __m128i E2 = Select(BF, F, E);
+        const __m128i E3 = Select(_mm_or_si128(_mm_and_si128(DB, nG), _mm_and_si128(DH, nA)), D, E);
+        const __m128i E5 = Select(_mm_or_si128(_mm_and_si128(BF, nI), _mm_and_si128(HF, nC)), F, E);
+        const __m128i E6 = Select(DH, D, E);
+        const __m128i E7 = Select(_mm_or_si128(_mm_and_si128(DH, nI), _mm_and_si128(HF, nG)), H, E);
+        const __m128i E8 = Select(HF, F, E);
+
+        Store3(dst0 + x * 3, E0, E1, E2);
+        Store3(dst1 + x * 3, E3, E,  E5);
+        Store3(dst2 + x * 3, E6, E7, E8);
+    }
+    Scale3xSpan(above, row, below, width, 0, std::min(width, 1u), dst0, dst1, dst2);
+    Scale3xSpan(above, row, below, width, x, width, dst0, dst1, dst2);
+}
+
+#endif // WCT_X86_SIMD
+
+//=============================================================================
+// Dispatch
+//=============================================================================
+
+//
+// All implementations the CPU can run, starting with the portable one
+//
+std::vector<WCTUpscale::impl_t> WCTUpscale::Implementations()
+{
+    std::vector<impl_t> impls;
+    impls.push_back({ "scalar", NearestRowScalar, Scale2xRowScalar, Scale3xRowScalar });
+#if WCT_X86_SIMD
+    if(WCTCPUFeatures::HasSSSE3())
+        impls.push_back({ "SSSE3", NearestRowSSSE3, Scale2xRowSSSE3, Scale3xRowSSSE3 });
+#endif
+    return impls;
+}
+
+//
+// Scale2x a whole image
+//
+static void Scale2xImage(const WCTUpscale::impl_t &impl, const uint8_t *src, uint32_t width, uint32_t height, uint8_t *dst)
+{
+    const size_t pitch = size_t(width) * 2;
+    for(uint32_t y = 0; y < height; y++)
+    {
+        const uint8_t *row   = src + size_t(y) * width;
+        const uint8_t *above = y > 0 ? row - width : row;
+        const uint8_t *below = y + 1 < height ? row + width : row;
+        uint8_t *const out   = dst + size_t(y) * 2 * pitch;
+        impl.scale2x(above, row, below, width, out, out + pitch);
+    }
+}
+
+//
+// Upscale an 8bpp image
+//
+bool WCTUpscale::Upscale(const uint8_t *src, uint32_t width, uint32_t height, const params_t &params, uint8_t *dst)
+{
+    static const impl_t impl = Implementations().back();
+
+    const uint32_t factor = params.factor;
+    if(factor < MIN_FACTOR || factor > MAX_FACTOR)
+        return false;
+
+    const size_t pitch = size_t(width) * factor;
+    switch(params.filter)
+    {
+    case Filter::NEAREST:
+        for(uint32_t y = 0; y < height; y++)
+        {
+            uint8_t *const out = dst + size_t(y) * factor * pitch;
+            impl.nearest(src + size_t(y) * width, width, factor, out);
+            for(uint32_t f = 1; f < factor; f++)
+                std::memcpy(out + f * pitch, out, pitch);
+        }
+        return true;
+
+    case Filter::SCALEX:
+        if(factor == 2)
+        {
+            Scale2xImage(impl, src, width, height, dst);
+        }
+        else if(factor == 3)
+        {
+            for(uint32_t y = 0; y < height; y++)
+            {
+                const uint8_t *row   = src + size_t(y) * width;
+                const uint8_t *above = y > 0 ? row - width : row;
+                const uint8_t *below = y + 1 < height ? row + width : row;
+                uint8_t *const out   = dst + size_t(y) * 3 * pitch;
+                impl.scale3x(above, row, below, width, out, out + pitch, out + pitch * 2);
+            }
+        }
+        else
+        {
+            // Scale2x twice, through a buffer kept per thread
+            thread_local std::vector<uint8_t> half;
+            half.resize(size_t(width) * height * 4);
+            Scale2xImage(impl, src, width, height, half.data());
+            Scale2xImage(impl, half.data(), width * 2, height * 2, dst);
+        }
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+// EOF
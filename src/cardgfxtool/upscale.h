@@ -0,0 +1,81 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <vector>
+
+//
+// Enlarged previews of card graphics, made from the 8bpp palette indices
+// before the palette is applied. Both filters only ever copy existing
+// pixels, so the result still fits the card's palette:
+//
+// - nearest repeats each pixel in a factor x factor block;
+// - scalex is the Scale2x/Scale3x edge-smoothing family, which rounds off
+//   diagonal steps by copying neighbors into corners where their edges
+//   continue. 4x is Scale2x applied twice.
+//
+// Both work a source row at a time, and each has a SIMD version picked at
+// runtime.
+//
+namespace WCTUpscale
+{
+    enum class Filter
+    {
+        NEAREST,
+        SCALEX,
+        NUMFILTERS
+    };
+
+    static constexpr uint32_t MIN_FACTOR = 2;
+    static constexpr uint32_t MAX_FACTOR = 4;
+
+    struct params_t
+    {
+        uint32_t factor = 1; // 1 for no upscaling, otherwise MIN_FACTOR to MAX_FACTOR
+        Filter   filter = Filter::NEAREST;
+    };
+
+    const char *FilterName(Filter filter);
+    bool FilterForName(const char *name, Filter &filter);
+
+    // Upscale an 8bpp image into dst, which takes width * factor by
+    // height * factor pixels. Returns false for an unsupported factor.
+    bool Upscale(const uint8_t *src, uint32_t width, uint32_t height, const params_t &params, uint8_t *dst);
+
+    // Repeat each of width pixels factor times
+    using nearestrowfn_t = void (*)(const uint8_t *src, uint32_t width, uint32_t factor, uint8_t *dst);
+
+    // Scale one row of width pixels, given the rows above and below it (the
+    // row itself at the image's edges), into factor output rows
+    using scale2xrowfn_t = void (*)(const uint8_t *above, const uint8_t *row, const uint8_t *below, uint32_t width, uint8_t *dst0, uint8_t *dst1);
+    using scale3xrowfn_t = void (*)(const uint8_t *above, const uint8_t *row, const uint8_t *below, uint32_t width, uint8_t *dst0, uint8_t *dst1, uint8_t *dst2);
+
+    struct impl_t
+    {
+        const char    *name;
+        nearestrowfn_t nearest;
+        scale2xrowfn_t scale2x;
+        scale3xrowfn_t scale3x;
+    };
+
+    // All implementations the CPU can run, starting with the portable one
+    // which the others must match exactly
+    std::vector<impl_t> Implementations();
+}
+
+// EOF
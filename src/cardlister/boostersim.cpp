@@ -0,0 +1,251 @@
+/*
+  Copyright (C) 2023 James Haley
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+#include "elib/elib.h"
+
+#include "../common/ctrrng.h"
+#include "../common/parallel.h"
+#include "boostersim.h"
+
+using namespace WCTBoosterSim;
+
+// RNG streams used for the two halves of the simulation
+enum simstream_e : uint64_t
+{
+    STREAM_ODDS,
+    STREAM_COMPLETE
+};
+
+//
+// A pack reduced to what's needed to open it: both card lists rewritten as
+// indices into the pack's table of distinct cards.
+//
+struct packmodel_t
+{
+    std::vector<uint16_t> rares;
+    std::vector<uint16_t> commons;
+    uint64_t              rareThreshold;
+    unsigned int          cardsPerPack;
+    size_t                numCards;
+};
+
+//
+// Open one pack, drawing its random numbers from counter onward, and call
+// fn(cardindex) for each card pulled.
+//
+template<typename F>
+static void OpenPack(const packmodel_t &model, uint64_t key, uint64_t counter, F fn)
+{
+    for(unsigned int slot = 0; slot < model.cardsPerPack; slot++)
+    {
+        // low half decides the list, high half picks from it
+        const uint64_t r = WCTCounterRNG::At(key, counter + slot);
+        const std::vector<uint16_t> &list = (r & 0xFFFFFFFFu) < model.rareThreshold ? model.rares : model.commons;
+        fn(list[WCTCounterRNG::Range(uint32_t(r >> 32), uint32_t(list.size()))]);
+    }
+}
+
+//
+// Check that a rare chance leaves both lists reachable once it is rounded to
+// a threshold on 32 random bits
+//
+bool WCTBoosterSim::RareChanceUsable(double chance)
+{
+    const uint64_t threshold = WCTCounterRNG::Threshold(chance);
+    return threshold != 0 && threshold < (uint64_t(1) << 32);
+}
+
+//
+// Build the simulation model for a pack and fill in the distinct card entries
+//
+static bool BuildModel(const WCTBoosterPack &pack, const params_t &params, packmodel_t &model, results_t &results)
+{
+    const WCTBoosterPack::cardlist_t &rares   = pack.GetRares();
+    const WCTBoosterPack::cardlist_t &commons = pack.GetCommons();
+
+    if(rares.empty() && commons.empty())
+        return false; // contents are determined by pack index
+
+    double rareChance = params.rareChance;
+    if(commons.empty())
+        rareChance = 1.0;
+    else if(rares.empty())
+        rareChance = 0.0;
+    else if(RareChanceUsable(rareChance) == false)
+        return false; // one list could never be drawn from
+
+    model.rareThreshold = WCTCounterRNG::Threshold(rareChance);
+    model.cardsPerPack  = params.cardsPerPack;
+
+    // a card can be listed more than once, or in both lists; it gets one entry
+    // in the results but its extra listings weight its odds accordingly
+    std::unordered_map<WCTBoosterPack::cardid_t, uint16_t> indexForID;
+    auto addList = [&] (const WCTBoosterPack::cardlist_t &list, std::vector<uint16_t> &out, bool rare) {
+        out.reserve(list.size());
+        for(WCTBoosterPack::cardid_t id : list)
+        {
+            auto [itr, added] = indexForID.try_emplace(id, uint16_t(results.cards.size()));
+            if(added == true)
+                results.cards.push_back({ id, false, false, 0.0, 0.0 });
+
+            cardodds_t &odds = results.cards[itr->second];
+            (rare ? odds.rare : odds.common) = true;
+            out.push_back(itr->second);
+        }
+    };
+    addList(rares,   model.rares,   true);
+    addList(commons, model.commons, false);
+
+    model.numCards = results.cards.size();
+    return true;
+}
+
+//
+// Open numPacks packs and measure how often each card turns up
+//
+static void SimulateOdds(const packmodel_t &model, const params_t &params, results_t &results)
+{
+    const uint64_t key = WCTCounterRNG::StreamKey(params.seed, STREAM_ODDS);
+
+    // per-thread counters, merged once all threads are finished
+    struct oddscounts_t
+    {
+        std::vector<uint64_t> copies;
+        std::vector<uint64_t> packsWith;
+        std::vector<uint64_t> lastPack;
+    };
+    const unsigned int numthreads = WCTParallel::ThreadsFor(size_t(params.numPacks), params.numThreads);
+    std::vector<oddscounts_t> counts(numthreads);
+
+    WCTParallel::ForRanges(size_t(params.numPacks), numthreads, [&] (unsigned int t, size_t begin, size_t end) {
+        oddscounts_t &c = counts[t];
+        c.copies.assign(model.numCards, 0);
+        c.packsWith.assign(model.numCards, 0);
+        c.lastPack.assign(model.numCards, UINT64_MAX);
+
+        for(uint64_t p = begin; p < end; p++)
+        {
+            OpenPack(model, key, p * model.cardsPerPack, [&c, p] (uint16_t card) {
+                ++c.copies[card];
+                if(c.lastPack[card] != p)
+                {
+                    c.lastPack[card] = p;
+                    ++c.packsWith[card];
+                }
+            });
+        }
+    });
+
+    for(size_t i = 0; i < model.numCards; i++)
+    {
+        uint64_t copies = 0, packsWith = 0;
+        for(const oddscounts_t &c : counts)
+        {
+            copies    += c.copies[i];
+            packsWith += c.packsWith[i];
+        }
+        results.cards[i].perPack    = double(copies)    / double(params.numPacks);
+        results.cards[i].pullChance = double(packsWith) / double(params.numPacks);
+    }
+}
+
+//
+// Collect numTrials full sets and measure how many packs each one took
+//
+static void SimulateCompletion(const packmodel_t &model, const params_t &params, results_t &results)
+{
+    const uint64_t key = WCTCounterRNG::StreamKey(params.seed, STREAM_COMPLETE);
+
+    // each trial owns a 2^32-long stretch of the stream, and gives up at the
+    // trial limit or rather than open a pack that would run past its stretch
+    const uint64_t maxpacks = std::min(params.trialLimit, (uint64_t(1) << 32) / model.cardsPerPack);
+    results.packLimit = maxpacks;
+
+    std::vector<uint64_t> packsNeeded(params.numTrials);
+    std::vector<uint32_t> unfinished(WCTParallel::ThreadsFor(params.numTrials, params.numThreads));
+
+    WCTParallel::ForRanges(params.numTrials, unsigned(unfinished.size()), [&] (unsigned int t, size_t begin, size_t end) {
+        std::vector<uint64_t> seenInTrial(model.numCards, UINT64_MAX);
+
+        for(uint64_t trial = begin; trial < end; trial++)
+        {
+            const uint64_t base    = trial << 32;
+            size_t         missing = model.numCards;
+            uint64_t       opened  = 0;
+
+            while(missing != 0 && opened < maxpacks)
+            {
+                OpenPack(model, key, base + opened * model.cardsPerPack, [&] (uint16_t card) {
+                    if(seenInTrial[card] != trial)
+                    {
+                        seenInTrial[card] = trial;
+                        --missing;
+                    }
+                });
+                ++opened;
+            }
+            if(missing != 0)
+                ++unfinished[t];
+            packsNeeded[trial] = opened;
+        }
+    });
+
+    for(uint32_t n : unfinished)
+        results.unfinishedTrials += n;
+
+    uint64_t total = 0;
+    for(uint64_t n : packsNeeded)
+        total += n;
+    results.meanPacks = double(total) / double(params.numTrials);
+
+    std::sort(packsNeeded.begin(), packsNeeded.end());
+    auto percentile = [&packsNeeded] (size_t pct) {
+        return packsNeeded[std::min(packsNeeded.size() - 1, packsNeeded.size() * pct / 100)];
+    };
+    results.medianPacks = percentile(50);
+    results.p90Packs    = percentile(90);
+    results.p99Packs    = percentile(99);
+    results.maxPacks    = packsNeeded.back();
+}
+
+//
+// Run the simulation for one pack
+//
+bool WCTBoosterSim::Simulate(const WCTBoosterPack &pack, const params_t &params, results_t &results)
+{
+    results = results_t();
+
+    packmodel_t model;
+    if(params.cardsPerPack == 0 || BuildModel(pack, params, model, results) == false)
+        return false;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    if(params.numPacks != 0)
+        SimulateOdds(model, params, results);
+    if(params.numTrials != 0)
+        SimulateCompletion(model, params, results);
+
+    results.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+// EOF
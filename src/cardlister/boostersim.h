@@ -0,0 +1,85 @@
+/*
+  Copyright (C) 2023 James Haley
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <vector>
+#include "../common/boosters.h"
+
+//
+// Monte Carlo simulation of opening booster packs.
+//
+// The game's own pack-opening routine has not been reverse engineered yet, so
+// the shape of a pack is a model with adjustable parameters: each pack holds
+// a fixed number of cards, and each card independently comes from the rare
+// list with a fixed chance, otherwise from the commons, picked uniformly from
+// whichever list it comes from. A pack with only one list always draws from
+// that list. Packs whose contents are determined by index alone have no lists
+// to draw from and can't be simulated.
+//
+namespace WCTBoosterSim
+{
+    struct params_t
+    {
+        unsigned int cardsPerPack = 5;
+        double       rareChance   = 0.125;    // per card, when the pack has both lists
+        uint64_t     numPacks     = 10000000; // packs opened to measure pull odds
+        uint32_t     numTrials    = 10000;    // full sets collected to measure packs-to-complete
+        uint64_t     trialLimit   = 100000;   // packs a collection may take before it's given up on
+        uint64_t     seed         = 1;
+        unsigned int numThreads   = 0;        // 0 to use all hardware threads
+    };
+
+    struct cardodds_t
+    {
+        WCTBoosterPack::cardid_t id;
+        bool   rare;       // appears in the rare list
+        bool   common;     // appears in the commons list
+        double pullChance; // chance that one pack contains at least one copy
+        double perPack;    // mean number of copies per pack
+    };
+
+    struct results_t
+    {
+        std::vector<cardodds_t> cards; // one per distinct card, in list order
+
+        // distribution of the number of packs needed to own every card at least once
+        double   meanPacks   = 0.0;
+        uint64_t medianPacks = 0;
+        uint64_t p90Packs    = 0;
+        uint64_t p99Packs    = 0;
+        uint64_t maxPacks    = 0;
+
+        // trials stopped at packLimit packs without every card, which is
+        // trialLimit unless the RNG stream runs out first; they count as
+        // taking packLimit packs, so the figures above are lower bounds
+        uint32_t unfinishedTrials = 0;
+        uint64_t packLimit        = 0;
+
+        double seconds = 0.0; // wall time spent, for both parts together
+    };
+
+    // Check that a rare chance leaves both lists reachable once it is rounded
+    // to the precision the simulation draws with
+    bool RareChanceUsable(double chance);
+
+    // Run the simulation for one pack. Returns false if the pack has no card
+    // lists, or if the rare chance makes one of its lists unreachable.
+    bool Simulate(const WCTBoosterPack &pack, const params_t &params, results_t &results);
+}
+
+// EOF
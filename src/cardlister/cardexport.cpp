@@ -0,0 +1,366 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <iterator>
+#include <vector>
+
+#include "elib/elib.h"
+#include "../common/outbuffer.h"
+#include "cardexport.h"
+#include "listerdata.h"
+
+using namespace WCTConstants;
+
+// Short codes for each language, in the game's internal order
+static const char *const langCodes[] = { "ja", "en", "de", "fr", "it", "es" };
+static_assert(std::size(langCodes) == size_t(Languages::NUMLANGUAGES));
+
+// Card membership is tracked in 32-bit masks
+static_assert(NUMBOOSTERPACKS <= 32);
+static_assert(NUMOPPDECKS     <= 32);
+
+//
+// Everything which refers to a card from elsewhere in the ROM
+//
+struct cardlinks_t
+{
+    enum : uint8_t
+    {
+        FUSION_RESULT   = 0x01,
+        FUSION_MATERIAL = 0x02,
+        RITUAL_MONSTER  = 0x04,
+        RITUAL_SPELL    = 0x08
+    };
+
+    uint32_t rarePacks   = 0; // bit n set if in booster pack n's rare list
+    uint32_t commonPacks = 0; // bit n set if in booster pack n's common list
+    uint32_t decks       = 0; // bit n set if in opponent deck n
+    uint8_t  flags       = 0;
+};
+
+using cardlinks_vec_t = std::vector<cardlinks_t>;
+
+//
+// Resolve all cross-references to cards in a single pass over each table
+//
+static cardlinks_vec_t BuildCardLinks(const WCTListerData &data)
+{
+    cardlinks_vec_t links(data.cardnames.GetNumCards());
+
+    const auto linkFor = [&] (uint16_t id) -> cardlinks_t * {
+        const size_t num = data.cardids.CardNumForID(id);
+        return (num != WCTCardIDs::npos && num < links.size()) ? &links[num] : nullptr;
+    };
+    const auto setFlag = [&] (uint16_t id, uint8_t flag) {
+        if(cardlinks_t *const cl = linkFor(id); cl != nullptr)
+            cl->flags |= flag;
+    };
+
+    // booster packs
+    const WCTBoosterRefs::boosters_t &packs = data.boosterrefs.GetBoosters();
+    for(size_t i = 0; i < packs.size(); i++)
+    {
+        for(uint16_t id : packs[i].GetRares())
+        {
+            if(cardlinks_t *const cl = linkFor(id); cl != nullptr)
+                cl->rarePacks |= 1u << i;
+        }
+        for(uint16_t id : packs[i].GetCommons())
+        {
+            if(cardlinks_t *const cl = linkFor(id); cl != nullptr)
+                cl->commonPacks |= 1u << i;
+        }
+    }
+
+    // opponent decks
+    const WCTOpponentDecks::decks_t &decks = data.decks.GetDecks();
+    for(size_t i = 0; i < decks.size(); i++)
+    {
+        for(uint16_t id : decks[i].GetDeckList())
+        {
+            if(cardlinks_t *const cl = linkFor(id); cl != nullptr)
+                cl->decks |= 1u << i;
+        }
+    }
+
+    // fusions
+    for(const WCTFusionData::fusionentry_t &ent : data.fusiondata.GetFusion2Mats())
+    {
+        setFlag(ent.fusion_id,    cardlinks_t::FUSION_RESULT);
+        setFlag(ent.material1_id, cardlinks_t::FUSION_MATERIAL);
+        setFlag(ent.material2_id, cardlinks_t::FUSION_MATERIAL);
+    }
+    for(const WCTFusionData::fusionentry_t &ent : data.fusiondata.GetFusion3Mats())
+    {
+        setFlag(ent.fusion_id,    cardlinks_t::FUSION_RESULT);
+        setFlag(ent.material1_id, cardlinks_t::FUSION_MATERIAL);
+        setFlag(ent.material2_id, cardlinks_t::FUSION_MATERIAL);
+        setFlag(ent.material3_id, cardlinks_t::FUSION_MATERIAL);
+    }
+
+    // rituals
+    for(uint32_t rd : data.ritualdata.GetData())
+    {
+        setFlag(uint16_t(GetRitualMonster(rd)), cardlinks_t::RITUAL_MONSTER);
+        setFlag(uint16_t(GetRitualSpell(rd)),   cardlinks_t::RITUAL_SPELL);
+    }
+
+    return links;
+}
+
+//
+// Write out the indices of the bits set in a mask, with the given separator
+//
+static void PutMaskIndices(WCTOutBuffer &out, uint32_t mask, char sep)
+{
+    bool first = true;
+    for(uint32_t i = 0; mask != 0; i++, mask >>= 1)
+    {
+        if((mask & 1) == 0)
+            continue;
+        if(first == false)
+            out.Put(sep);
+        out.PutUint(i);
+        first = false;
+    }
+}
+
+//=============================================================================
+//
+// JSON and NDJSON
+//
+//=============================================================================
+
+//
+// Write a "key": prefix
+//
+static void PutJSONKey(WCTOutBuffer &out, const char *key)
+{
+    out.Put(',');
+    out.Put('"');
+    out.Puts(key);
+    out.Put('"');
+    out.Put(':');
+}
+
+static void PutJSONBool(WCTOutBuffer &out, const char *key, bool value)
+{
+    PutJSONKey(out, key);
+    out.Puts(value ? "true" : "false");
+}
+
+static void PutJSONMask(WCTOutBuffer &out, const char *key, uint32_t mask)
+{
+    PutJSONKey(out, key);
+    out.Put('[');
+    PutMaskIndices(out, mask, ',');
+    out.Put(']');
+}
+
+//
+// Write one card as a single-line JSON object
+//
+static void PutCardJSON(WCTOutBuffer &out, const WCTListerData &data, uint32_t num, const cardlinks_t &cl)
+{
+    out.Puts("{\"num\":");
+    out.PutUint(num);
+    PutJSONKey(out, "id");
+    out.PutUint(data.cardids.IDForCardNum(num));
+
+    PutJSONKey(out, "names");
+    for(size_t lang = 0; lang < size_t(Languages::NUMLANGUAGES); lang++)
+    {
+        out.Put(lang == 0 ? '{' : ',');
+        out.Put('"');
+        out.Puts(langCodes[lang]);
+        out.Put('"');
+        out.Put(':');
+        out.PutJSONString(data.cardnames.GetName(Languages(lang), num));
+    }
+    out.Put('}');
+
+    const uint32_t cd = data.carddata.DataForCardNum(num);
+    const CardType ct = GetCardType(cd);
+    if(ct == CardType::Spell || ct == CardType::Trap)
+    {
+        PutJSONKey(out, "kind");
+        out.Puts(ct == CardType::Spell ? "\"Spell\"" : "\"Trap\"");
+        PutJSONKey(out, "subtype");
+        out.PutJSONString(SafeSpellTrapTypeName(GetSpellTrapType(cd)));
+    }
+    else
+    {
+        PutJSONKey(out, "kind");
+        out.Puts("\"Monster\"");
+        PutJSONKey(out, "monstertype");
+        out.PutJSONString(SafeMonsterCardTypeName(GetMonsterType(cd)));
+        PutJSONKey(out, "level");
+        out.PutUint(GetCardLevel(cd));
+        PutJSONKey(out, "type");
+        out.PutJSONString(SafeCardTypeName(ct));
+        PutJSONKey(out, "attribute");
+        out.PutJSONString(SafeAttributeName(GetCardAttribute(cd)));
+        PutJSONKey(out, "atk");
+        out.PutUint(GetMonsterATK(cd));
+        PutJSONKey(out, "def");
+        out.PutUint(GetMonsterDEF(cd));
+    }
+
+    PutJSONBool(out, "fusion_result",   (cl.flags & cardlinks_t::FUSION_RESULT)   != 0);
+    PutJSONBool(out, "fusion_material", (cl.flags & cardlinks_t::FUSION_MATERIAL) != 0);
+    PutJSONBool(out, "ritual_monster",  (cl.flags & cardlinks_t::RITUAL_MONSTER)  != 0);
+    PutJSONBool(out, "ritual_spell",    (cl.flags & cardlinks_t::RITUAL_SPELL)    != 0);
+    PutJSONMask(out, "rare_packs",   cl.rarePacks);
+    PutJSONMask(out, "common_packs", cl.commonPacks);
+    PutJSONMask(out, "decks",        cl.decks);
+    out.Put('}');
+}
+
+//=============================================================================
+//
+// CSV
+//
+//=============================================================================
+
+static const char csvHeader[] =
+    "num,id,name_ja,name_en,name_de,name_fr,name_it,name_es,kind,subtype,"
+    "monstertype,level,type,attribute,atk,def,fusion_result,fusion_material,"
+    "ritual_monster,ritual_spell,rare_packs,common_packs,decks\n";
+
+//
+// Write one card as a CSV row; lists of packs and decks are semicolon-separated
+//
+static void PutCardCSV(WCTOutBuffer &out, const WCTListerData &data, uint32_t num, const cardlinks_t &cl)
+{
+    out.PutUint(num);
+    out.Put(',');
+    out.PutUint(data.cardids.IDForCardNum(num));
+    for(size_t lang = 0; lang < size_t(Languages::NUMLANGUAGES); lang++)
+    {
+        out.Put(',');
+        out.PutCSVString(data.cardnames.GetName(Languages(lang), num));
+    }
+
+    const uint32_t cd = data.carddata.DataForCardNum(num);
+    const CardType ct = GetCardType(cd);
+    if(ct == CardType::Spell || ct == CardType::Trap)
+    {
+        out.Puts(ct == CardType::Spell ? ",Spell," : ",Trap,");
+        out.Puts(SafeSpellTrapTypeName(GetSpellTrapType(cd)));
+        out.Puts(",,,,,,");
+    }
+    else
+    {
+        out.Puts(",Monster,,");
+        out.Puts(SafeMonsterCardTypeName(GetMonsterType(cd)));
+        out.Put(',');
+        out.PutUint(GetCardLevel(cd));
+        out.Put(',');
+        out.Puts(SafeCardTypeName(ct));
+        out.Put(',');
+        out.Puts(SafeAttributeName(GetCardAttribute(cd)));
+        out.Put(',');
+        out.PutUint(GetMonsterATK(cd));
+        out.Put(',');
+        out.PutUint(GetMonsterDEF(cd));
+    }
+
+    out.Puts((cl.flags & cardlinks_t::FUSION_RESULT)   ? ",1" : ",0");
+    out.Puts((cl.flags & cardlinks_t::FUSION_MATERIAL) ? ",1" : ",0");
+    out.Puts((cl.flags & cardlinks_t::RITUAL_MONSTER)  ? ",1" : ",0");
+    out.Puts((cl.flags & cardlinks_t::RITUAL_SPELL)    ? ",1" : ",0");
+    out.Put(',');
+    PutMaskIndices(out, cl.rarePacks, ';');
+    out.Put(',');
+    PutMaskIndices(out, cl.commonPacks, ';');
+    out.Put(',');
+    PutMaskIndices(out, cl.decks, ';');
+    out.Put('\n');
+}
+
+//=============================================================================
+//
+// Interface
+//
+//=============================================================================
+
+//
+// Look up a format by name
+//
+bool WCTCardExport::FormatForName(const char *name, Format &fmt)
+{
+    static const struct
+    {
+        const char *name;
+        Format      fmt;
+    } formats[] =
+    {
+        { "json",   Format::JSON   },
+        { "ndjson", Format::NDJSON },
+        { "csv",    Format::CSV    },
+    };
+
+    for(const auto &f : formats)
+    {
+        if(strcasecmp(name, f.name) == 0)
+        {
+            fmt = f.fmt;
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// Write out every card in the given format
+//
+bool WCTCardExport::ExportCards(const WCTListerData &data, FILE *out, Format fmt)
+{
+    const cardlinks_vec_t links    = BuildCardLinks(data);
+    const uint32_t        numcards = data.cardnames.GetNumCards();
+
+    WCTOutBuffer buf { out };
+
+    switch(fmt)
+    {
+    case Format::JSON:
+        buf.Put('[');
+        for(uint32_t i = 1; i < numcards; i++)
+        {
+            buf.Puts(i == 1 ? "\n" : ",\n");
+            PutCardJSON(buf, data, i, links[i]);
+        }
+        buf.Puts("\n]\n");
+        break;
+    case Format::NDJSON:
+        for(uint32_t i = 1; i < numcards; i++)
+        {
+            PutCardJSON(buf, data, i, links[i]);
+            buf.Put('\n');
+        }
+        break;
+    case Format::CSV:
+        buf.Puts(csvHeader);
+        for(uint32_t i = 1; i < numcards; i++)
+            PutCardCSV(buf, data, i, links[i]);
+        break;
+    }
+
+    return buf.Flush();
+}
+
+// EOF
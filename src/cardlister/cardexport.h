@@ -0,0 +1,44 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+class WCTListerData;
+
+//
+// Export of the full card database for use by other tools
+//
+namespace WCTCardExport
+{
+    enum class Format
+    {
+        JSON,   // one array containing an object per card
+        NDJSON, // one object per line
+        CSV     // header row plus one row per card
+    };
+
+    // Look up a format by name ("json", "ndjson", or "csv"). Returns false if
+    // the name is not recognized.
+    bool FormatForName(const char *name, Format &fmt);
+
+    // Write out every card with its names, stats, fusion and ritual membership,
+    // and the booster packs and opponent decks which contain it. Output is
+    // formatted directly into a buffer as it goes. Returns false on write error.
+    bool ExportCards(const WCTListerData &data, FILE *out, Format fmt);
+}
+
+// EOF
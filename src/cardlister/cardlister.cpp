@@ -16,19 +16,22 @@
 */
 
 #include <algorithm>
+#include <chrono>
+#include <thread>
 
 #include "elib/elib.h"
 #include "elib/m_argv.h"
 #include "elib/misc.h"
 #include "elib/qstring.h"
 #include "hal/hal_init.h"
-#include "../common/boosters.h"
-#include "../common/cardnames.h"
-#include "../common/carddata.h"
-#include "../common/cardids.h"
-#include "../common/iddb.h"
-#include "../common/oppdeck.h"
+#include "../common/outbuffer.h"
 #include "../common/romfile.h"
+#include "boostersim.h"
+#include "cardexport.h"
+#include "cardstats.h"
+#include "deckfill.h"
+#include "listerdata.h"
+#include "queryserver.h"
 
 static bool s_waitForInput = false;
 
@@ -41,6 +44,16 @@ static void MaybeWait()
         std::getchar();
 }
 
+//
+// Buffered standard output for listings. Anything written here must be flushed
+// before prompting for input or mixing in direct stdio output.
+//
+static WCTOutBuffer &ListOut()
+{
+    static WCTOutBuffer buf { stdout };
+    return buf;
+}
+
 //
 // Dump a numbered list of the English card names
 //
@@ -50,12 +63,18 @@ static void DumpCardNames(FILE *romfile)
     WCTCardNames cardnames;
     if(cardnames.ReadCardNames(romfile) == true)
     {
+        WCTOutBuffer &out = ListOut();
+
         const uint32_t numcards = cardnames.GetNumCards();
         for(uint32_t i = 0; i < numcards; i++)
         {
             const char *const name = cardnames.GetName(WCTConstants::Languages::ENGLISH, i);
-            std::printf("%04d: %s\n", i, name);
+            out.PutUint(i, 4);
+            out.Put(": ", 2);
+            out.Puts(name);
+            out.Put('\n');
         }
+        out.Flush();
         MaybeWait();
     }
     else
@@ -67,18 +86,10 @@ static void DumpCardNames(FILE *romfile)
 //
 // Interactive mode: object holding data to pass between routines
 //
-class WCTInteractiveData final
+class WCTInteractiveData final : public WCTListerData
 {
 public:
-    qstring          input;
-    WCTCardNames     cardnames;
-    WCTCardData      carddata;
-    WCTRitualData    ritualdata;
-    WCTFusionData    fusiondata;
-    WCTCardIDs       cardids;
-    WCTBoosterRefs   boosterrefs;
-    WCTOpponentDecks decks;
-    WCTIDDatabase    db;
+    qstring input;
 };
 
 //
@@ -91,6 +102,8 @@ static void SearchByCardName(const WCTInteractiveData &data)
     // Search by name
     if(const size_t pos = data.input.findFirstOf(' '); pos != qstring::npos)
     {
+        WCTOutBuffer &out = ListOut();
+
         const char *const searchterm = &(data.input[pos]) + 1;
         const uint32_t numcards = data.cardnames.GetNumCards();
         bool found = false;
@@ -99,12 +112,15 @@ static void SearchByCardName(const WCTInteractiveData &data)
             const char *const name = data.cardnames.GetName(Languages::ENGLISH, i);
             if(M_StrCaseStr(name, searchterm) != nullptr)
             {
-                std::printf("\n%04u: %s", i, name);
+                out.Put('\n');
+                out.PutUint(i, 4);
+                out.Put(": ", 2);
+                out.Puts(name);
                 found = true;
             }
         }
         if(found == false)
-            std::puts("\nNo game results were found.");
+            out.Puts("\nNo game results were found.\n");
 
         // also check user database
         const WCTIDDatabase::map_t &dbmap = data.db.GetMap();
@@ -115,17 +131,24 @@ static void SearchByCardName(const WCTInteractiveData &data)
             {
                 if(firstdb == true)
                 {
-                    std::printf("\n%sResults from user database:", found ? "\n" : "");
+                    out.Puts(found ? "\n\nResults from user database:" : "\nResults from user database:");
                     firstdb = false;
                 }
-                std::printf("\n%04hX (%hu): %s", pair.first, pair.first, pair.second.c_str());
+                out.Put('\n');
+                out.PutHex(pair.first, 4);
+                out.Put(" (", 2);
+                out.PutUint(pair.first);
+                out.Put("): ", 3);
+                out.Puts(pair.second.c_str());
                 found = true;
             }
         }
         if(found == false)
-            std::puts("\nNo database results were found.");
+            out.Puts("\nNo database results were found.\n");
         else
-            std::puts(" ");
+            out.Puts(" \n");
+
+        out.Flush();
     }
 }
 
@@ -257,27 +280,39 @@ static void ShowCardInfo(const WCTInteractiveData &data)
 //
 // Interactive mode: View a list of cards in a booster pack or deck
 //
-static void ViewCardList(const WCTInteractiveData &data, const std::vector<uint16_t> &list)
+static void ViewCardList(const WCTListerData &data, const std::vector<uint16_t> &list)
 {
+    WCTOutBuffer &out = ListOut();
+
     if(list.size() == 0)
     {
-        std::printf("Card list is empty.\n");
+        out.Puts("Card list is empty.\n");
+        out.Flush();
         return;
     }
 
     for(WCTBoosterPack::cardid_t id : list)
     {
         const size_t cardnum = data.cardids.CardNumForID(id);
+        out.Put("0x", 2);
+        out.PutHex(id, 4);
         if(cardnum != 0  && cardnum != WCTCardIDs::npos)
         {
             const char *const cardname = data.cardnames.GetName(WCTConstants::Languages::ENGLISH, cardnum);
-            std::printf("0x%04hX: %04u %s\n", id, cardnum, cardname);
+            out.Put(": ", 2);
+            out.PutUint(uint32_t(cardnum), 4);
+            out.Put(' ');
+            out.Puts(cardname);
+            out.Put('\n');
         }
         else
         {
-            std::printf("0x%04hX: Invalid entry in card list (%04u)\n", id, cardnum);
+            out.Puts(": Invalid entry in card list (");
+            out.PutUint(uint32_t(cardnum), 4);
+            out.Puts(")\n");
         }
     }
+    out.Flush();
 }
 
 //
@@ -375,10 +410,16 @@ static void ViewDeck(const WCTInteractiveData &data)
             const WCTOppDeckData  &rawdeck = rawdecks[decknum];
             const WCTOpponentDeck &deck    = decks[decknum];
 
-            std::printf(
-                "\nOpponent Deck %zu - %hu cards | AI Flags: %04hX\n"
-                "---------------------------------------------------\n",
-                decknum, rawdeck.len, rawdeck.flags
+            WCTOutBuffer &out = ListOut();
+            out.Puts("\nOpponent Deck ");
+            out.PutUint(uint32_t(decknum));
+            out.Puts(" - ");
+            out.PutUint(rawdeck.len);
+            out.Puts(" cards | AI Flags: ");
+            out.PutHex(rawdeck.flags, 4);
+            out.Puts(
+                "\n"
+                "---------------------------------------------------\n"
             );
             ViewCardList(data, deck.GetDeckList());
         }
@@ -520,6 +561,23 @@ static frcinfo_t GetFusionRitualCardInfo(const WCTInteractiveData &data, uint16_
     return ret;
 }
 
+//
+// Write one line describing a fusion or ritual card reference, in the form
+// "<label>XXXX (NNNN): NNNN <name>"
+//
+static void PutCardRef(WCTOutBuffer &out, const char *label, uint16_t id, const frcinfo_t &info)
+{
+    out.Puts(label);
+    out.PutHex(id, 4);
+    out.Put(" (", 2);
+    out.PutUint(id, 4);
+    out.Put("): ", 3);
+    out.PutUint(uint32_t(info.num), 4);
+    out.Put(' ');
+    out.Put(info.name.c_str(), info.name.length());
+    out.Put('\n');
+}
+
 //
 // Interactive mode: View ritual summons data
 //
@@ -527,7 +585,8 @@ static void ViewRitualSummons(const WCTInteractiveData &data)
 {
     const WCTRitualData::ritualdata_t &rds = data.ritualdata.GetData();
 
-    std::printf(
+    WCTOutBuffer &out = ListOut();
+    out.Puts(
         "\nRitual Summons Data\n"
         "---------------------------------------------------\n"
     );
@@ -542,17 +601,16 @@ static void ViewRitualSummons(const WCTInteractiveData &data)
         const frcinfo_t monInfo   = GetFusionRitualCardInfo(data, monsterid);
         const frcinfo_t spellInfo = GetFusionRitualCardInfo(data, spellid);
 
-        std::printf(
-            "Ritual entry %u:\n"
-            "Monster: %04hX (%04hu): %04zu %s\n"
-            "Spell:   %04hX (%04hu): %04zu %s\n"
-            "Levels:  %u\n\n",
-            entry++,
-            monsterid, monsterid, monInfo.num,   monInfo.name.c_str(),
-            spellid,   spellid,   spellInfo.num, spellInfo.name.c_str(),
-            levels
-        );
+        out.Puts("Ritual entry ");
+        out.PutUint(entry++);
+        out.Put(":\n", 2);
+        PutCardRef(out, "Monster: ", uint16_t(monsterid), monInfo);
+        PutCardRef(out, "Spell:   ", uint16_t(spellid),   spellInfo);
+        out.Puts("Levels:  ");
+        out.PutUint(levels);
+        out.Put("\n\n", 2);
     }
+    out.Flush();
 }
 
 //
@@ -563,7 +621,8 @@ static void ViewFusionSummons(const WCTInteractiveData &data)
     const WCTFusionData::fusiontable_t &twomats   = data.fusiondata.GetFusion2Mats();
     const WCTFusionData::fusiontable_t &threemats = data.fusiondata.GetFusion3Mats();
 
-    std::printf(
+    WCTOutBuffer &out = ListOut();
+    out.Puts(
         "\nFusion Summons Data\n"
         "---------------------------------------------------\n"
     );
@@ -575,15 +634,12 @@ static void ViewFusionSummons(const WCTInteractiveData &data)
         const frcinfo_t mat1Info = GetFusionRitualCardInfo(data, ent.material1_id);
         const frcinfo_t mat2Info = GetFusionRitualCardInfo(data, ent.material2_id);
 
-        std::printf(
-            "2-Mat %02u  : %04hX (%04hu): %04zu %s\n"
-            "Material 1: %04hX (%04hu): %04zu %s\n"
-            "Material 2: %04hX (%04hu): %04zu %s\n\n",
-            entry++,
-            ent.fusion_id,    ent.fusion_id,    monInfo.num,  monInfo.name.c_str(),
-            ent.material1_id, ent.material1_id, mat1Info.num, mat1Info.name.c_str(),
-            ent.material2_id, ent.material2_id, mat2Info.num, mat2Info.name.c_str()
-        );
+        out.Puts("2-Mat ");
+        out.PutUint(entry++, 2);
+        PutCardRef(out, "  : ",        ent.fusion_id,    monInfo);
+        PutCardRef(out, "Material 1: ", ent.material1_id, mat1Info);
+        PutCardRef(out, "Material 2: ", ent.material2_id, mat2Info);
+        out.Put('\n');
     }
 
     entry = 0;
@@ -594,18 +650,15 @@ static void ViewFusionSummons(const WCTInteractiveData &data)
         const frcinfo_t mat2Info = GetFusionRitualCardInfo(data, ent.material2_id);
         const frcinfo_t mat3Info = GetFusionRitualCardInfo(data, ent.material3_id);
 
-        std::printf(
-            "3-Mat %02u  : %04hX (%04hu): %04zu %s\n"
-            "Material 1: %04hX (%04hu): %04zu %s\n"
-            "Material 2: %04hX (%04hu): %04zu %s\n"
-            "Material 3: %04hX (%04hu): %04zu %s\n\n",
-            entry++,
-            ent.fusion_id,    ent.fusion_id,    monInfo.num,  monInfo.name.c_str(),
-            ent.material1_id, ent.material1_id, mat1Info.num, mat1Info.name.c_str(),
-            ent.material2_id, ent.material2_id, mat2Info.num, mat2Info.name.c_str(),
-            ent.material3_id, ent.material3_id, mat3Info.num, mat3Info.name.c_str()
-        );
+        out.Puts("3-Mat ");
+        out.PutUint(entry++, 2);
+        PutCardRef(out, "  : ",        ent.fusion_id,    monInfo);
+        PutCardRef(out, "Material 1: ", ent.material1_id, mat1Info);
+        PutCardRef(out, "Material 2: ", ent.material2_id, mat2Info);
+        PutCardRef(out, "Material 3: ", ent.material3_id, mat3Info);
+        out.Put('\n');
     }
+    out.Flush();
 }
 
 //
@@ -698,7 +751,8 @@ static void ViewJunkCards(const WCTInteractiveData &data)
         }
     });
 
-    std::printf(
+    WCTOutBuffer &out = ListOut();
+    out.Puts(
         "\nBasement-Level Trash Cards Ranking\n"
         "---------------------------------------------------\n"
     );
@@ -707,17 +761,27 @@ static void ViewJunkCards(const WCTInteractiveData &data)
     euint counter = 0;
     for(const badcard_t &bc : badcards)
     {
-        std::printf("\n%u. %04u: %s | ID 0x%04hX (%hu)\n", counter + 1, bc.num, bc.name, bc.id, bc.id);
-        std::printf(
-            "Level %u\n"
-            "ATK %u/DEF %u\n",
-            bc.lv, 
-            bc.atk, bc.def
-        );
+        out.Put('\n');
+        out.PutUint(counter + 1);
+        out.Put(". ", 2);
+        out.PutUint(uint32_t(bc.num), 4);
+        out.Put(": ", 2);
+        out.Puts(bc.name);
+        out.Puts(" | ID 0x");
+        out.PutHex(bc.id, 4);
+        out.Put(" (", 2);
+        out.PutUint(bc.id);
+        out.Puts(")\nLevel ");
+        out.PutUint(bc.lv);
+        out.Puts("\nATK ");
+        out.PutUint(bc.atk);
+        out.Puts("/DEF ");
+        out.PutUint(bc.def);
+        out.Put('\n');
         if(++counter % 10 == 0)
         {
-            std::puts("Show more bad cards? (Y/N)");
-            std::fflush(stdout);
+            out.Puts("Show more bad cards? (Y/N)\n");
+            out.Flush();
             char resp[2];
             if(const char *const inl = gets_s(resp, sizeof(resp)); inl != nullptr)
             {
@@ -726,6 +790,7 @@ static void ViewJunkCards(const WCTInteractiveData &data)
             }
         }
     }
+    out.Flush();
 }
 
 //
@@ -755,45 +820,9 @@ static void InteractiveMode(FILE *romfile)
         }
     }
 
-    if(data.cardnames.ReadCardNames(romfile) == false)
-    {
-        std::puts("Failed to read in card names from ROM\n");
-        return; // oink.
-    }
-    
-    if(data.carddata.ReadCardData(romfile) == false)
-    {
-        std::puts("Failed to read in card data from ROM\n");
-        return; // bahh.
-    }
-
-    if(data.cardids.ReadCardIDs(romfile) == false)
-    {
-        std::puts("Failed to read card IDs from ROM\n");
-        return; // whinny!
-    }
-
-    if(data.boosterrefs.ReadBoosterRefs(romfile) == false)
+    if(data.ReadFromROM(romfile) == false)
     {
-        std::puts("Failed to read booster packs from ROM\n");
-        return;
-    }
-
-    if(data.decks.ReadDecks(romfile) == false)
-    {
-        std::puts("Failed to read opponent decks from ROM\n");
-        return;
-    }
-
-    if(data.fusiondata.ReadFusionTables(romfile) == false)
-    {
-        std::puts("Failed to read fusion summons data from ROM\n");
-        return;
-    }
-
-    if(data.ritualdata.ReadRitualData(romfile) == false)
-    {
-        std::puts("Failed to read ritual data from ROM\n");
+        std::printf("%s\n\n", data.GetError());
         return;
     }
 
@@ -866,6 +895,472 @@ static void InteractiveMode(FILE *romfile)
     }
 }
 
+//
+// Query server mode: load everything once, then answer requests over a socket
+//
+static void ServeMode(FILE *romfile, const char *sockpath)
+{
+    const EArgManager &args = EArgManager::GetGlobalArgs();
+    const char *const *argv = args.getArgv();
+
+    WCTListerData data;
+
+    // init the ID database
+    if(data.db.LoadFromFile("cardids.json") == false)
+    {
+        std::printf("Warning: could not load cardid db:\n %s\n", data.db.GetErrors().c_str());
+    }
+
+    if(WCTROMFile::VerifyROM(romfile) == false)
+    {
+        std::puts("File does not look like a YWCT2K4 ROM\n");
+        return;
+    }
+
+    if(data.ReadFromROM(romfile) == false)
+    {
+        std::printf("%s\n\n", data.GetError());
+        return;
+    }
+
+    // number of worker threads
+    unsigned int numworkers = std::thread::hardware_concurrency();
+    if(const int p = args.getArgParameters("-workers", 1); p != 0)
+        numworkers = unsigned(std::strtoul(argv[p], nullptr, 10));
+
+    WCTQueryServer::Run(data, sockpath, numworkers);
+}
+
+//
+// Export mode: write the full card database out to a file
+//
+static void ExportMode(FILE *romfile, const char *outfn)
+{
+    const EArgManager &args = EArgManager::GetGlobalArgs();
+    const char *const *argv = args.getArgv();
+
+    // format may be given explicitly, otherwise go by the file extension
+    WCTCardExport::Format fmt = WCTCardExport::Format::JSON;
+    if(const int p = args.getArgParameters("-format", 1); p != 0)
+    {
+        if(WCTCardExport::FormatForName(argv[p], fmt) == false)
+        {
+            std::printf("Unknown export format '%s' (json, ndjson, or csv)\n", argv[p]);
+            return;
+        }
+    }
+    else if(const char *const ext = std::strrchr(outfn, '.'); ext != nullptr)
+    {
+        if(WCTCardExport::FormatForName(ext + 1, fmt) == false && strcasecmp(ext, ".jsonl") == 0)
+            fmt = WCTCardExport::Format::NDJSON;
+    }
+
+    if(WCTROMFile::VerifyROM(romfile) == false)
+    {
+        std::puts("File does not look like a YWCT2K4 ROM\n");
+        return;
+    }
+
+    WCTListerData data;
+    if(data.ReadFromROM(romfile) == false)
+    {
+        std::printf("%s\n\n", data.GetError());
+        return;
+    }
+
+    // "-" means standard output, for piping into other tools
+    const bool  tostdout = (std::strcmp(outfn, "-") == 0);
+    EAutoFile   upFile { tostdout ? nullptr : std::fopen(outfn, "wb") };
+    FILE *const out = tostdout ? stdout : upFile.get();
+    if(out == nullptr)
+    {
+        std::printf("Could not open output file '%s'\n", outfn);
+        return;
+    }
+
+    if(WCTCardExport::ExportCards(data, out, fmt) == false)
+        std::printf("Error writing to '%s'\n", outfn);
+}
+
+//
+// Print the results of simulating one booster pack
+//
+static void PrintSimResults(const WCTListerData &data, size_t packnum, const WCTBoosterSim::params_t &params,
+                            const WCTBoosterSim::results_t &results)
+{
+    const WCTBoosterPack &pack = data.boosterrefs.GetBoosters()[packnum];
+
+    std::printf(
+        "\nBooster Pack %zu | ID: %u | %zu rares, %zu commons\n"
+        "---------------------------------------------------\n",
+        packnum, data.boosterrefs.GetRefs()[packnum].id, pack.GetRares().size(), pack.GetCommons().size()
+    );
+
+    if(params.numPacks != 0)
+    {
+        std::printf("Card                                         List  Pull %%     1 in  Per pack\n");
+        for(const WCTBoosterSim::cardodds_t &odds : results.cards)
+        {
+            const size_t      cardnum = data.cardids.CardNumForID(odds.id);
+            const char *const name    =
+                (cardnum != 0 && cardnum != WCTCardIDs::npos) ? data.cardnames.GetName(WCTConstants::Languages::ENGLISH, cardnum) : "Invalid entry";
+            std::printf(
+                "0x%04hX: %04zu %-32.32s %-4s %7.3f%% %8.1f  %8.5f\n",
+                odds.id, cardnum != WCTCardIDs::npos ? cardnum : 0, name,
+                odds.rare ? (odds.common ? "R+C" : "R") : "C",
+                odds.pullChance * 100.0, odds.pullChance > 0.0 ? 1.0 / odds.pullChance : 0.0, odds.perPack
+            );
+        }
+    }
+
+    if(params.numTrials != 0)
+    {
+        std::printf(
+            "Packs to complete (%u trials): mean %.1f, median %llu, 90%% %llu, 99%% %llu, worst %llu\n",
+            params.numTrials, results.meanPacks,
+            (unsigned long long)results.medianPacks, (unsigned long long)results.p90Packs,
+            (unsigned long long)results.p99Packs,    (unsigned long long)results.maxPacks
+        );
+        if(results.unfinishedTrials != 0)
+        {
+            std::printf(
+                "  %u trials stopped at %llu packs without completing (see -triallimit); the figures above are lower bounds\n",
+                results.unfinishedTrials, (unsigned long long)results.packLimit
+            );
+        }
+    }
+
+    std::printf(
+        "Simulated %llu packs and %u collections in %.2f s\n",
+        (unsigned long long)params.numPacks, params.numTrials, results.seconds
+    );
+}
+
+//
+// Simulation mode: estimate card pull odds for one or all booster packs
+//
+static void SimulateMode(FILE *romfile, const char *packarg)
+{
+    const EArgManager &args = EArgManager::GetGlobalArgs();
+    const char *const *argv = args.getArgv();
+
+    WCTBoosterSim::params_t params;
+    if(const int p = args.getArgParameters("-packs", 1); p != 0)
+        params.numPacks = std::strtoull(argv[p], nullptr, 10);
+    if(const int p = args.getArgParameters("-trials", 1); p != 0)
+        params.numTrials = uint32_t(std::strtoul(argv[p], nullptr, 10));
+    if(const int p = args.getArgParameters("-triallimit", 1); p != 0)
+        params.trialLimit = std::strtoull(argv[p], nullptr, 10);
+    if(const int p = args.getArgParameters("-packsize", 1); p != 0)
+        params.cardsPerPack = unsigned(std::strtoul(argv[p], nullptr, 10));
+    if(const int p = args.getArgParameters("-rarechance", 1); p != 0)
+        params.rareChance = std::strtod(argv[p], nullptr);
+    if(const int p = args.getArgParameters("-seed", 1); p != 0)
+        params.seed = std::strtoull(argv[p], nullptr, 10);
+    if(const int p = args.getArgParameters("-workers", 1); p != 0)
+        params.numThreads = unsigned(std::strtoul(argv[p], nullptr, 10));
+
+    if(params.trialLimit == 0)
+    {
+        std::puts("Trial limit must be at least 1 pack\n");
+        return;
+    }
+    if(params.cardsPerPack == 0 || WCTBoosterSim::RareChanceUsable(params.rareChance) == false)
+    {
+        std::puts("Pack size must be at least 1 and rare chance must be between 0 and 1, and not too close to either\n");
+        return;
+    }
+
+    if(WCTROMFile::VerifyROM(romfile) == false)
+    {
+        std::puts("File does not look like a YWCT2K4 ROM\n");
+        return;
+    }
+
+    WCTListerData data;
+    if(data.ReadFromROM(romfile) == false)
+    {
+        std::printf("%s\n\n", data.GetError());
+        return;
+    }
+
+    // either a single pack number, or "all"
+    const size_t numpacks = data.boosterrefs.GetRefs().size();
+    size_t first = 0, last = numpacks - 1;
+    if(strcasecmp(packarg, "all") != 0)
+    {
+        first = last = size_t(std::strtoull(packarg, nullptr, 10));
+        if(first >= numpacks)
+        {
+            std::printf("Pack number must be between 0 and %zu, or 'all'\n", numpacks - 1);
+            return;
+        }
+    }
+
+    std::printf(
+        "Model: %u cards per pack, %.2f%% chance per card of a rare when the pack has both lists\n",
+        params.cardsPerPack, params.rareChance * 100.0
+    );
+
+    for(size_t i = first; i <= last; i++)
+    {
+        WCTBoosterSim::results_t results;
+        if(WCTBoosterSim::Simulate(data.boosterrefs.GetBoosters()[i], params, results) == false)
+        {
+            std::printf("\nBooster Pack %zu: contents are determined by pack index; cannot simulate\n", i);
+            continue;
+        }
+        PrintSimResults(data, i, params, results);
+    }
+}
+
+//
+// Print the summary of a batch of generated decks for one opponent
+//
+static void PrintDeckStats(const WCTListerData &data, const WCTDeckFill::fillpool_t &pool, size_t decknum,
+                           const WCTDeckFill::deckstats_t &stats)
+{
+    using namespace WCTConstants;
+
+    const double decks = double(stats.numDecks);
+
+    std::printf(
+        "\nOpponent Deck %zu, modeled fill - %zu fixed cards | AI Flags: %04hX | %llu decks\n"
+        "---------------------------------------------------\n"
+        "Filler cards per deck: %.2f\n",
+        decknum, data.decks.GetDecks()[decknum].GetDeckList().size(), WCTDeckFill::EffectiveFlags(data, decknum),
+        (unsigned long long)stats.numDecks, double(stats.filler) / decks
+    );
+
+    std::printf("\nCard types (per deck):\n");
+    for(size_t i = 0; i < stats.types.size(); i++)
+    {
+        if(stats.types[i] != 0)
+            std::printf("  %-14s %6.2f\n", SafeCardTypeName(CardType(i)), double(stats.types[i]) / decks);
+    }
+
+    std::printf("\nMonster attributes (per deck):\n");
+    for(size_t i = 0; i < stats.attributes.size(); i++)
+    {
+        if(stats.attributes[i] != 0)
+            std::printf("  %-14s %6.2f\n", SafeAttributeName(Attribute(i)), double(stats.attributes[i]) / decks);
+    }
+
+    if(stats.monsters != 0)
+    {
+        std::printf("\nMonster ATK (mean %.0f):\n", double(stats.atkTotal) / double(stats.monsters));
+        for(size_t i = 0; i < stats.atk.size(); i++)
+        {
+            const uint32_t lo = uint32_t(i) * WCTDeckFill::ATK_BUCKET;
+            if(i + 1 < stats.atk.size())
+                std::printf("  %4u-%-4u %6.2f%%\n", lo, lo + WCTDeckFill::ATK_BUCKET - 1, 100.0 * double(stats.atk[i]) / double(stats.monsters));
+            else
+                std::printf("  %4u+     %6.2f%%\n", lo, 100.0 * double(stats.atk[i]) / double(stats.monsters));
+        }
+    }
+
+    // most common filler picks
+    std::vector<size_t> order(pool.ids.size());
+    for(size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    const size_t numtop = std::min<size_t>(10, order.size());
+    std::partial_sort(order.begin(), order.begin() + numtop, order.end(), [&stats] (size_t a, size_t b) {
+        return stats.fillerCounts[a] > stats.fillerCounts[b];
+    });
+
+    std::printf("\nMost frequent filler (copies per deck):\n");
+    for(size_t i = 0; i < numtop && stats.fillerCounts[order[i]] != 0; i++)
+    {
+        const uint16_t id      = pool.ids[order[i]];
+        const size_t   cardnum = data.cardids.CardNumForID(id);
+        std::printf(
+            "  0x%04hX: %04zu %-32.32s %5.3f\n",
+            id, cardnum, data.cardnames.GetName(Languages::ENGLISH, cardnum), double(stats.fillerCounts[order[i]]) / decks
+        );
+    }
+}
+
+//
+// Deck fill mode: fill opponent decks out to 40 cards with the WCTDeckFill
+// model of the game's filler. The game's own routine hasn't been traced, so
+// these are plausible decks rather than the ones opponents actually play.
+//
+static void FillDeckMode(FILE *romfile, const char *deckarg)
+{
+    const EArgManager &args = EArgManager::GetGlobalArgs();
+    const char *const *argv = args.getArgv();
+
+    uint64_t     seed       = 1;
+    uint64_t     numsamples = 0; // 0 to print the single deck for the seed
+    unsigned int numthreads = 0;
+    if(const int p = args.getArgParameters("-seed", 1); p != 0)
+        seed = std::strtoull(argv[p], nullptr, 10);
+    if(const int p = args.getArgParameters("-samples", 1); p != 0)
+        numsamples = std::strtoull(argv[p], nullptr, 10);
+    if(const int p = args.getArgParameters("-workers", 1); p != 0)
+        numthreads = unsigned(std::strtoul(argv[p], nullptr, 10));
+
+    if(WCTROMFile::VerifyROM(romfile) == false)
+    {
+        std::puts("File does not look like a YWCT2K4 ROM\n");
+        return;
+    }
+
+    WCTListerData data;
+    if(data.ReadFromROM(romfile) == false)
+    {
+        std::printf("%s\n\n", data.GetError());
+        return;
+    }
+
+    // either a single deck number, or "all"
+    const size_t numdecks = data.decks.GetDecks().size();
+    size_t first = 0, last = numdecks - 1;
+    if(strcasecmp(deckarg, "all") != 0)
+    {
+        first = last = size_t(std::strtoull(deckarg, nullptr, 10));
+        if(first >= numdecks)
+        {
+            std::printf("Deck number must be between 0 and %zu, or 'all'\n", numdecks - 1);
+            return;
+        }
+    }
+
+    WCTDeckFill::fillpool_t pool;
+    WCTDeckFill::BuildPool(data, pool);
+
+    std::printf(
+        "Model: filler drawn uniformly from %zu Normal monsters, at most %u copies of a card, "
+        "higher-ATK of two draws for decks with FLAG_HARDER\n",
+        pool.ids.size(), WCTDeckFill::MAX_COPIES
+    );
+
+    for(size_t i = first; i <= last; i++)
+    {
+        if(numsamples == 0)
+        {
+            WCTDeckFill::decklist_t deck;
+            if(WCTDeckFill::FillDeck(data, pool, i, seed, deck) == false)
+            {
+                std::printf("\nOpponent Deck %zu: too few filler cards to complete the deck\n", i);
+                continue;
+            }
+
+            std::printf(
+                "\nOpponent Deck %zu, modeled fill - seed %llu | AI Flags: %04hX\n"
+                "---------------------------------------------------\n",
+                i, (unsigned long long)seed, WCTDeckFill::EffectiveFlags(data, i)
+            );
+            ViewCardList(data, deck);
+        }
+        else
+        {
+            WCTDeckFill::deckstats_t stats;
+            if(WCTDeckFill::Summarize(data, pool, i, seed, numsamples, numthreads, stats) == false)
+            {
+                std::printf("\nOpponent Deck %zu: too few filler cards to complete the deck\n", i);
+                continue;
+            }
+            PrintDeckStats(data, pool, i, stats);
+        }
+    }
+}
+
+//
+// Print one line of a stat's spread
+//
+static void PrintSpread(const char *label, const WCTListStats::spread_t &sp)
+{
+    std::printf(
+        "  %s mean %7.1f | min %4hu p25 %4hu med %4hu p75 %4hu p90 %4hu max %4hu\n",
+        label, sp.mean, sp.min, sp.p25, sp.p50, sp.p75, sp.p90, sp.max
+    );
+}
+
+//
+// Stats mode: report aggregate statistics for every opponent deck and booster
+// pack. Output depends only on the ROM, so it can be diffed between builds.
+//
+static void StatsMode(FILE *romfile)
+{
+    using namespace WCTConstants;
+    using WCTListStats::liststats_t;
+
+    const EArgManager &args = EArgManager::GetGlobalArgs();
+
+    if(WCTROMFile::VerifyROM(romfile) == false)
+    {
+        std::puts("File does not look like a YWCT2K4 ROM\n");
+        return;
+    }
+
+    WCTListerData data;
+    if(data.ReadFromROM(romfile) == false)
+    {
+        std::printf("%s\n\n", data.GetError());
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    WCTCardColumns columns;
+    columns.Build(data);
+    const auto built = std::chrono::steady_clock::now();
+
+    std::vector<liststats_t> stats;
+    WCTListStats::ComputeAll(data, columns, stats);
+    const auto done = std::chrono::steady_clock::now();
+
+    for(const liststats_t &ls : stats)
+    {
+        std::printf(
+            "\n%s %02zu | %u cards: %u monsters, %u spells, %u traps, %u unknown | %u fusion materials (%.1f%%)\n",
+            ls.source == liststats_t::DECK ? "Deck" : "Pack", ls.index, ls.cards, ls.monsters, ls.spells, ls.traps,
+            ls.unknown, ls.materials, ls.cards != 0 ? 100.0 * ls.materials / ls.cards : 0.0
+        );
+        if(ls.cards == 0)
+            continue;
+
+        if(ls.monsters != 0)
+        {
+            PrintSpread("ATK", ls.atk);
+            PrintSpread("DEF", ls.def);
+
+            std::printf("  Attributes:");
+            for(size_t i = 0; i < ls.attributes.size(); i++)
+            {
+                if(ls.attributes[i] != 0)
+                    std::printf(" %s %u", SafeAttributeName(Attribute(i)), ls.attributes[i]);
+            }
+            std::printf("\n  Levels:");
+            for(size_t i = 0; i < ls.levels.size(); i++)
+            {
+                if(ls.levels[i] != 0)
+                    std::printf(" %zu:%u", i, ls.levels[i]);
+            }
+            std::printf("\n");
+        }
+
+        std::printf("  Types:");
+        for(size_t i = 0; i < ls.types.size(); i++)
+        {
+            if(ls.types[i] != 0)
+                std::printf(" %s %u", SafeCardTypeName(CardType(i)), ls.types[i]);
+        }
+        std::printf("\n");
+    }
+
+    // timings vary from run to run, so they're only shown on request
+    if(args.findArgument("-timing") == true)
+    {
+        using usec = std::chrono::duration<double, std::micro>;
+        std::printf(
+            "\nColumns built in %.1f us; %zu lists computed in %.1f us\n",
+            usec(built - start).count(), stats.size(), usec(done - built).count()
+        );
+    }
+}
+
 // 
 // Main routine
 //
@@ -907,6 +1402,31 @@ void cardlister_main()
         // dump names only
         DumpCardNames(romfile);
     }
+    else if(const int p = args.getArgParameters("-export", 1); p != 0)
+    {
+        // full database export
+        ExportMode(romfile, argv[p]);
+    }
+    else if(const int p = args.getArgParameters("-serve", 1); p != 0)
+    {
+        // query server mode
+        ServeMode(romfile, argv[p]);
+    }
+    else if(const int p = args.getArgParameters("-simpack", 1); p != 0)
+    {
+        // booster pack odds simulation
+        SimulateMode(romfile, argv[p]);
+    }
+    else if(args.findArgument("-stats") == true)
+    {
+        // deck and booster statistics report
+        StatsMode(romfile);
+    }
+    else if(const int p = args.getArgParameters("-filldeck", 1); p != 0)
+    {
+        // opponent deck filler simulation
+        FillDeckMode(romfile, argv[p]);
+    }
     else
     {
         // interactive mode
@@ -0,0 +1,239 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+
+#include "elib/elib.h"
+
+#include "cardstats.h"
+#include "listerdata.h"
+
+using namespace WCTListStats;
+
+//=============================================================================
+// Card columns
+//=============================================================================
+
+//
+// Unpack every card's data into the per-field arrays
+//
+void WCTCardColumns::Build(const WCTListerData &data)
+{
+    using namespace WCTConstants;
+
+    m_kind.reset(new uint8_t [NUMIDS] {});
+    m_attribute.reset(new uint8_t [NUMIDS] {});
+    m_type.reset(new uint8_t [NUMIDS] {});
+    m_level.reset(new uint8_t [NUMIDS] {});
+    m_material.reset(new uint8_t [NUMIDS] {});
+    m_atk.reset(new uint16_t [NUMIDS] {});
+    m_def.reset(new uint16_t [NUMIDS] {});
+
+    const WCTCardData::carddata_t &carddata = data.carddata.GetData();
+    for(size_t i = 1; i < carddata.size(); i++)
+    {
+        const uint16_t id = data.cardids.IDForCardNum(i);
+        if(id == WCTCardIDs::INVALID_ID)
+            continue;
+
+        const uint32_t cd = carddata[i];
+        const CardType ct = GetCardType(cd);
+
+        m_kind[id]      = ct == CardType::Spell ? KIND_SPELL : ct == CardType::Trap ? KIND_TRAP : KIND_MONSTER;
+        m_attribute[id] = uint8_t(GetCardAttribute(cd));
+        m_type[id]      = uint8_t(ct);
+        m_level[id]     = uint8_t(GetCardLevel(cd));
+        m_atk[id]       = uint16_t(GetMonsterATK(cd));
+        m_def[id]       = uint16_t(GetMonsterDEF(cd));
+    }
+
+    // mark materials with one walk over the fusion tables, rather than
+    // searching them for every card
+    for(const WCTFusionData::fusionentry_t &ent : data.fusiondata.GetFusion2Mats())
+    {
+        m_material[ent.material1_id] = 1;
+        m_material[ent.material2_id] = 1;
+    }
+    for(const WCTFusionData::fusionentry_t &ent : data.fusiondata.GetFusion3Mats())
+    {
+        m_material[ent.material1_id] = 1;
+        m_material[ent.material2_id] = 1;
+        m_material[ent.material3_id] = 1;
+    }
+    m_material[WCTCardIDs::INVALID_ID] = 0;
+}
+
+//=============================================================================
+// List statistics
+//=============================================================================
+
+//
+// Columns for one card list, gathered into contiguous scratch arrays so each
+// statistic is a simple reduction over them. Reused between lists.
+//
+struct gathered_t
+{
+    std::vector<uint8_t>  kind;
+    std::vector<uint8_t>  attribute;
+    std::vector<uint8_t>  type;
+    std::vector<uint8_t>  level;
+    std::vector<uint8_t>  material;
+    std::vector<uint16_t> atk; // monsters only
+    std::vector<uint16_t> def; // monsters only
+
+    void Gather(const WCTCardColumns &columns, const std::vector<uint16_t> &ids);
+};
+
+void gathered_t::Gather(const WCTCardColumns &columns, const std::vector<uint16_t> &ids)
+{
+    const size_t n = ids.size();
+    kind.resize(n);
+    attribute.resize(n);
+    type.resize(n);
+    level.resize(n);
+    material.resize(n);
+
+    // one field at a time keeps each loop to a single table
+    const uint8_t *const kinds = columns.Kinds();
+    for(size_t i = 0; i < n; i++)
+        kind[i] = kinds[ids[i]];
+    const uint8_t *const attributes = columns.Attributes();
+    for(size_t i = 0; i < n; i++)
+        attribute[i] = attributes[ids[i]];
+    const uint8_t *const types = columns.Types();
+    for(size_t i = 0; i < n; i++)
+        type[i] = types[ids[i]];
+    const uint8_t *const levels = columns.Levels();
+    for(size_t i = 0; i < n; i++)
+        level[i] = levels[ids[i]];
+    const uint8_t *const materials = columns.Materials();
+    for(size_t i = 0; i < n; i++)
+        material[i] = materials[ids[i]];
+
+    // ATK and DEF only count for monsters
+    atk.clear();
+    def.clear();
+    const uint16_t *const atks = columns.ATKs();
+    const uint16_t *const defs = columns.DEFs();
+    for(size_t i = 0; i < n; i++)
+    {
+        if(kind[i] == WCTCardColumns::KIND_MONSTER)
+        {
+            atk.push_back(atks[ids[i]]);
+            def.push_back(defs[ids[i]]);
+        }
+    }
+}
+
+//
+// Sort a stat's values and find their mean and percentiles
+//
+static void ComputeSpread(std::vector<uint16_t> &values, spread_t &spread)
+{
+    if(values.empty())
+        return;
+
+    uint32_t total = 0;
+    for(uint16_t v : values)
+        total += v;
+    spread.mean = double(total) / double(values.size());
+
+    std::sort(values.begin(), values.end());
+    auto percentile = [&values] (size_t pct) { return values[(values.size() - 1) * pct / 100]; };
+    spread.min = values.front();
+    spread.p25 = percentile(25);
+    spread.p50 = percentile(50);
+    spread.p75 = percentile(75);
+    spread.p90 = percentile(90);
+    spread.max = values.back();
+}
+
+//
+// Reduce a gathered list down to its statistics
+//
+static void ComputeList(gathered_t &g, liststats_t &ls)
+{
+    const size_t n = g.kind.size();
+    ls.cards = uint32_t(n);
+
+    std::array<uint32_t, 4> kinds {};
+    for(size_t i = 0; i < n; i++)
+        ++kinds[g.kind[i] & 3];
+    ls.unknown  = kinds[WCTCardColumns::KIND_NONE];
+    ls.monsters = kinds[WCTCardColumns::KIND_MONSTER];
+    ls.spells   = kinds[WCTCardColumns::KIND_SPELL];
+    ls.traps    = kinds[WCTCardColumns::KIND_TRAP];
+
+    uint32_t materials = 0;
+    for(size_t i = 0; i < n; i++)
+        materials += g.material[i];
+    ls.materials = materials;
+
+    for(size_t i = 0; i < n; i++)
+    {
+        ++ls.types[g.type[i] % ls.types.size()];
+        if(g.kind[i] == WCTCardColumns::KIND_MONSTER)
+        {
+            ++ls.attributes[g.attribute[i] % ls.attributes.size()];
+            ++ls.levels[g.level[i] % NUMLEVELS];
+        }
+    }
+    ls.types[0] -= ls.unknown; // unknown IDs have all-zero columns
+
+    ComputeSpread(g.atk, ls.atk);
+    ComputeSpread(g.def, ls.def);
+}
+
+//
+// Compute statistics for every deck and pack
+//
+void WCTListStats::ComputeAll(const WCTListerData &data, const WCTCardColumns &columns, std::vector<liststats_t> &stats)
+{
+    const WCTOpponentDecks::decks_t  &decks = data.decks.GetDecks();
+    const WCTBoosterRefs::boosters_t &packs = data.boosterrefs.GetBoosters();
+
+    stats.clear();
+    stats.reserve(decks.size() + packs.size());
+
+    gathered_t g;
+
+    for(size_t i = 0; i < decks.size(); i++)
+    {
+        liststats_t &ls = stats.emplace_back();
+        ls.source = liststats_t::DECK;
+        ls.index  = i;
+        g.Gather(columns, decks[i].GetDeckList());
+        ComputeList(g, ls);
+    }
+
+    std::vector<uint16_t> packlist;
+    for(size_t i = 0; i < packs.size(); i++)
+    {
+        const WCTBoosterPack::cardlist_t &rares   = packs[i].GetRares();
+        const WCTBoosterPack::cardlist_t &commons = packs[i].GetCommons();
+        packlist.assign(rares.begin(), rares.end());
+        packlist.insert(packlist.end(), commons.begin(), commons.end());
+
+        liststats_t &ls = stats.emplace_back();
+        ls.source = liststats_t::PACK;
+        ls.index  = i;
+        g.Gather(columns, packlist);
+        ComputeList(g, ls);
+    }
+}
+
+// EOF
@@ -0,0 +1,111 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+#include "../common/carddata.h"
+
+class WCTListerData;
+
+//
+// Card data unpacked into one array per field, each indexed directly by card
+// ID, so that statistics over a card list are a straight gather from a few
+// small arrays rather than an ID lookup and bitfield decode per card.
+//
+class WCTCardColumns final
+{
+public:
+    static constexpr size_t NUMIDS = 0x10000;
+
+    enum kind_e : uint8_t
+    {
+        KIND_NONE,    // not a card in the game
+        KIND_MONSTER,
+        KIND_SPELL,
+        KIND_TRAP
+    };
+
+    void Build(const WCTListerData &data);
+
+    const uint8_t  *Kinds()      const { return m_kind.get();      }
+    const uint8_t  *Attributes() const { return m_attribute.get(); }
+    const uint8_t  *Types()      const { return m_type.get();      }
+    const uint8_t  *Levels()     const { return m_level.get();     }
+    const uint8_t  *Materials()  const { return m_material.get();  } // 1 if a fusion material
+    const uint16_t *ATKs()       const { return m_atk.get();       }
+    const uint16_t *DEFs()       const { return m_def.get();       }
+
+private:
+    std::unique_ptr<uint8_t  []> m_kind;
+    std::unique_ptr<uint8_t  []> m_attribute;
+    std::unique_ptr<uint8_t  []> m_type;
+    std::unique_ptr<uint8_t  []> m_level;
+    std::unique_ptr<uint8_t  []> m_material;
+    std::unique_ptr<uint16_t []> m_atk;
+    std::unique_ptr<uint16_t []> m_def;
+};
+
+//
+// Aggregate statistics over the opponent decks and booster packs
+//
+namespace WCTListStats
+{
+    static constexpr size_t NUMLEVELS = 16; // the level field is four bits
+
+    // Spread of a stat over the monsters in a list
+    struct spread_t
+    {
+        double   mean = 0.0;
+        uint16_t min  = 0;
+        uint16_t p25  = 0;
+        uint16_t p50  = 0;
+        uint16_t p75  = 0;
+        uint16_t p90  = 0;
+        uint16_t max  = 0;
+    };
+
+    struct liststats_t
+    {
+        enum source_e { DECK, PACK };
+
+        source_e source;
+        size_t   index;     // deck or pack number
+
+        uint32_t cards     = 0;
+        uint32_t monsters  = 0;
+        uint32_t spells    = 0;
+        uint32_t traps     = 0;
+        uint32_t unknown   = 0; // IDs which aren't cards in the game
+        uint32_t materials = 0; // fusion materials
+
+        std::array<uint32_t, size_t(WCTConstants::Attribute::NUMATTRIBUTES)> attributes {}; // monsters only
+        std::array<uint32_t, size_t(WCTConstants::CardType::NUMCARDTYPES)>   types      {};
+        std::array<uint32_t, NUMLEVELS>                                      levels     {}; // monsters only
+
+        spread_t atk;
+        spread_t def;
+    };
+
+    // Compute statistics for every opponent deck followed by every booster
+    // pack (rares and commons together), in one pass.
+    void ComputeAll(const WCTListerData &data, const WCTCardColumns &columns, std::vector<liststats_t> &stats);
+}
+
+// EOF
@@ -0,0 +1,239 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include <algorithm>
+
+#include "elib/elib.h"
+
+#include "../common/ctrrng.h"
+#include "../common/parallel.h"
+#include "deckfill.h"
+#include "listerdata.h"
+
+using namespace WCTDeckFill;
+
+// Opponents past this number have FLAG_HARDER set at runtime
+static constexpr size_t HARDER_AFTER_DECK = 10;
+
+//
+// Gather up the filler pool from the card data
+//
+void WCTDeckFill::BuildPool(const WCTListerData &data, fillpool_t &pool)
+{
+    using namespace WCTConstants;
+
+    const WCTCardData::carddata_t &carddata = data.carddata.GetData();
+
+    pool.ids.clear();
+    pool.atk.clear();
+    for(size_t i = 1; i < carddata.size(); i++)
+    {
+        const uint32_t cd = carddata[i];
+        const CardType ct = GetCardType(cd);
+        if(ct == CardType::Spell || ct == CardType::Trap || GetMonsterType(cd) != MonsterCardType::Normal)
+            continue;
+
+        const uint16_t id = data.cardids.IDForCardNum(i);
+        if(id == WCTCardIDs::INVALID_ID)
+            continue;
+
+        pool.ids.push_back(id);
+        pool.atk.push_back(GetMonsterATK(cd));
+    }
+}
+
+//
+// AI flags for an opponent as the game sees them
+//
+uint16_t WCTDeckFill::EffectiveFlags(const WCTListerData &data, size_t decknum)
+{
+    uint16_t flags = data.decks.GetRawData()[decknum].flags;
+    if(decknum > HARDER_AFTER_DECK)
+        flags |= WCTOpponentDecks::FLAG_HARDER;
+    return flags;
+}
+
+// Random draws allowed per deck before the rest is taken from the pool in
+// order; only reached when nearly every pool card is at the copy limit
+static constexpr uint64_t MAX_FILL_DRAWS = 1u << 20;
+
+//
+// Count how many more copies of a card the copy limit allows in a deck
+//
+static size_t CopiesLeft(const decklist_t &deck, uint16_t id)
+{
+    const size_t count = size_t(std::count(deck.begin(), deck.end(), id));
+    return count >= MAX_COPIES ? 0 : MAX_COPIES - count;
+}
+
+//
+// With too small a pool, the copy limit would make filling a deck impossible.
+// Copies the fixed part of the decklist already holds count against it.
+//
+static bool CanFill(const WCTListerData &data, const fillpool_t &pool, size_t decknum)
+{
+    const decklist_t &fixed = data.decks.GetDecks()[decknum].GetDeckList();
+    if(fixed.size() >= DECK_SIZE)
+        return true;
+
+    size_t available = 0;
+    for(uint16_t id : pool.ids)
+        available += CopiesLeft(fixed, id);
+    return available >= DECK_SIZE - fixed.size();
+}
+
+//
+// Fill out a deck, calling onFiller(poolindex) for each card added. CanFill
+// must be true for the deck. Should MAX_FILL_DRAWS draws not be enough, the
+// remaining slots go to the first pool cards with copies left.
+//
+template<typename F>
+static void Fill(const WCTListerData &data, const fillpool_t &pool, size_t decknum, uint64_t seed,
+                 decklist_t &deck, F onFiller)
+{
+    const decklist_t &fixed = data.decks.GetDecks()[decknum].GetDeckList();
+    deck.assign(fixed.begin(), fixed.end());
+    if(deck.size() >= DECK_SIZE)
+        return;
+
+    const bool     harder = (EffectiveFlags(data, decknum) & WCTOpponentDecks::FLAG_HARDER) != 0;
+    const uint32_t size   = uint32_t(pool.ids.size());
+    const uint64_t key    = WCTCounterRNG::StreamKey(seed, decknum);
+
+    uint64_t counter = 0;
+    while(deck.size() < DECK_SIZE && counter < MAX_FILL_DRAWS)
+    {
+        const uint64_t r   = WCTCounterRNG::At(key, counter++);
+        uint32_t       idx = WCTCounterRNG::Range(uint32_t(r), size);
+        if(harder == true)
+        {
+            const uint32_t idx2 = WCTCounterRNG::Range(uint32_t(r >> 32), size);
+            if(pool.atk[idx2] > pool.atk[idx])
+                idx = idx2;
+        }
+
+        const uint16_t id = pool.ids[idx];
+        if(CopiesLeft(deck, id) == 0)
+            continue;
+
+        deck.push_back(id);
+        onFiller(idx);
+    }
+
+    for(uint32_t idx = 0; idx < size && deck.size() < DECK_SIZE; idx++)
+    {
+        for(size_t n = CopiesLeft(deck, pool.ids[idx]); n != 0 && deck.size() < DECK_SIZE; n--)
+        {
+            deck.push_back(pool.ids[idx]);
+            onFiller(idx);
+        }
+    }
+}
+
+//
+// Generate the full 40-card deck for an opponent
+//
+bool WCTDeckFill::FillDeck(const WCTListerData &data, const fillpool_t &pool, size_t decknum, uint64_t seed, decklist_t &deck)
+{
+    if(CanFill(data, pool, decknum) == false)
+        return false;
+
+    Fill(data, pool, decknum, seed, deck, [] (uint32_t) {});
+    return true;
+}
+
+//
+// Add one deck into a set of statistics
+//
+static void AccumulateDeck(const WCTListerData &data, const decklist_t &deck, deckstats_t &stats)
+{
+    using namespace WCTConstants;
+
+    ++stats.numDecks;
+    stats.cards += deck.size();
+    for(uint16_t id : deck)
+    {
+        const uint32_t cd = data.carddata.DataForCardNum(data.cardids.CardNumForID(id));
+        const CardType ct = GetCardType(cd);
+
+        if(size_t(ct) < stats.types.size())
+            ++stats.types[size_t(ct)];
+        if(ct == CardType::Spell || ct == CardType::Trap)
+            continue;
+
+        if(const Attribute attr = GetCardAttribute(cd); size_t(attr) < stats.attributes.size())
+            ++stats.attributes[size_t(attr)];
+
+        const uint32_t atk = GetMonsterATK(cd);
+        ++stats.monsters;
+        stats.atkTotal += atk;
+        ++stats.atk[std::min<size_t>(atk / ATK_BUCKET, NUMATKBUCKETS - 1)];
+    }
+}
+
+//
+// Generate a batch of decks in parallel and total up their statistics
+//
+bool WCTDeckFill::Summarize(const WCTListerData &data, const fillpool_t &pool, size_t decknum, uint64_t firstSeed,
+                            uint64_t numSeeds, unsigned int numThreads, deckstats_t &stats)
+{
+    stats = deckstats_t();
+    stats.fillerCounts.assign(pool.ids.size(), 0);
+
+    if(CanFill(data, pool, decknum) == false)
+        return false;
+
+    // per-thread totals, merged once all threads are finished
+    numThreads = WCTParallel::ThreadsFor(size_t(numSeeds), numThreads);
+    std::vector<deckstats_t> threadStats(numThreads);
+
+    WCTParallel::ForRanges(size_t(numSeeds), numThreads, [&] (unsigned int t, size_t begin, size_t end) {
+        deckstats_t &ts = threadStats[t];
+        ts.fillerCounts.assign(pool.ids.size(), 0);
+
+        decklist_t deck;
+        deck.reserve(DECK_SIZE);
+        for(uint64_t s = begin; s < end; s++)
+        {
+            Fill(data, pool, decknum, firstSeed + s, deck, [&ts] (uint32_t idx) {
+                ++ts.fillerCounts[idx];
+                ++ts.filler;
+            });
+            AccumulateDeck(data, deck, ts);
+        }
+    });
+
+    for(const deckstats_t &ts : threadStats)
+    {
+        stats.numDecks += ts.numDecks;
+        stats.cards    += ts.cards;
+        stats.filler   += ts.filler;
+        stats.monsters += ts.monsters;
+        stats.atkTotal += ts.atkTotal;
+        for(size_t i = 0; i < stats.attributes.size(); i++)
+            stats.attributes[i] += ts.attributes[i];
+        for(size_t i = 0; i < stats.types.size(); i++)
+            stats.types[i] += ts.types[i];
+        for(size_t i = 0; i < stats.atk.size(); i++)
+            stats.atk[i] += ts.atk[i];
+        for(size_t i = 0; i < stats.fillerCounts.size(); i++)
+            stats.fillerCounts[i] += ts.fillerCounts[i];
+    }
+    return true;
+}
+
+// EOF
@@ -0,0 +1,86 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include "../common/carddata.h"
+#include "../common/oppdeck.h"
+
+class WCTListerData;
+
+//
+// Simulation of the game filling out opponent decks to 40 cards.
+//
+// The game's filler routine and its junk card table haven't been traced
+// yet, so this is a model of it: the filler pool is every Normal monster,
+// cards are drawn from it uniformly, and no card may appear more than three
+// times in the finished deck, counting the fixed part of the decklist. For
+// decks with FLAG_HARDER (which the game ORs in for opponents past number
+// 10) each pick is the higher-ATK of two draws. Every generated deck is a
+// pure function of the opponent number and the seed.
+//
+namespace WCTDeckFill
+{
+    static constexpr size_t       DECK_SIZE     = 40;
+    static constexpr unsigned int MAX_COPIES    = 3;
+    static constexpr uint32_t     ATK_BUCKET    = 500; // width of each ATK histogram bucket
+    static constexpr size_t       NUMATKBUCKETS = 11;  // the last one holds 5000 and up
+
+    using decklist_t = WCTOpponentDeck::decklist_t;
+
+    // The cards available for filling decks
+    struct fillpool_t
+    {
+        std::vector<uint16_t> ids;
+        std::vector<uint32_t> atk; // parallel to ids
+    };
+
+    // Accumulated statistics over a batch of generated decks
+    struct deckstats_t
+    {
+        uint64_t numDecks = 0;
+        uint64_t cards    = 0; // every card in every deck
+        uint64_t filler   = 0; // of those, how many were filled in
+        uint64_t monsters = 0;
+        uint64_t atkTotal = 0; // over monsters
+
+        std::array<uint64_t, size_t(WCTConstants::Attribute::NUMATTRIBUTES)> attributes {};
+        std::array<uint64_t, size_t(WCTConstants::CardType::NUMCARDTYPES)>   types      {};
+        std::array<uint64_t, NUMATKBUCKETS>                                  atk        {};
+
+        std::vector<uint64_t> fillerCounts; // copies drawn of each fillpool_t entry
+    };
+
+    // Gather up the filler pool from the card data
+    void BuildPool(const WCTListerData &data, fillpool_t &pool);
+
+    // AI flags for an opponent as the game sees them, including FLAG_HARDER
+    uint16_t EffectiveFlags(const WCTListerData &data, size_t decknum);
+
+    // Generate the full 40-card deck for an opponent. Returns false if the
+    // filler pool is too small to complete the deck.
+    bool FillDeck(const WCTListerData &data, const fillpool_t &pool, size_t decknum, uint64_t seed, decklist_t &deck);
+
+    // Generate decks for seeds [firstSeed, firstSeed + numSeeds) in parallel and
+    // total up their statistics. Returns false if the deck can't be completed.
+    bool Summarize(const WCTListerData &data, const fillpool_t &pool, size_t decknum, uint64_t firstSeed,
+                   uint64_t numSeeds, unsigned int numThreads, deckstats_t &stats);
+}
+
+// EOF
@@ -0,0 +1,72 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include "elib/elib.h"
+#include "elib/qstring.h"
+#include "listerdata.h"
+
+//
+// Read in all card information from the ROM file
+//
+bool WCTListerData::ReadFromROM(FILE *f)
+{
+    if(cardnames.ReadCardNames(f) == false)
+    {
+        m_error = "Failed to read in card names from ROM";
+        return false; // oink.
+    }
+
+    if(carddata.ReadCardData(f) == false)
+    {
+        m_error = "Failed to read in card data from ROM";
+        return false; // bahh.
+    }
+
+    if(cardids.ReadCardIDs(f) == false)
+    {
+        m_error = "Failed to read card IDs from ROM";
+        return false; // whinny!
+    }
+
+    if(boosterrefs.ReadBoosterRefs(f) == false)
+    {
+        m_error = "Failed to read booster packs from ROM";
+        return false;
+    }
+
+    if(decks.ReadDecks(f) == false)
+    {
+        m_error = "Failed to read opponent decks from ROM";
+        return false;
+    }
+
+    if(fusiondata.ReadFusionTables(f) == false)
+    {
+        m_error = "Failed to read fusion summons data from ROM";
+        return false;
+    }
+
+    if(ritualdata.ReadRitualData(f) == false)
+    {
+        m_error = "Failed to read ritual data from ROM";
+        return false;
+    }
+
+    return true;
+}
+
+// EOF
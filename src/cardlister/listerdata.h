@@ -0,0 +1,54 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include "../common/boosters.h"
+#include "../common/cardnames.h"
+#include "../common/carddata.h"
+#include "../common/cardids.h"
+#include "../common/iddb.h"
+#include "../common/oppdeck.h"
+
+//
+// All of the card information the card lister reads in from the ROM. Once
+// loaded it is only ever read from, so it can be shared freely between the
+// interactive mode and the query server's worker threads.
+//
+class WCTListerData
+{
+public:
+    WCTCardNames     cardnames;
+    WCTCardData      carddata;
+    WCTRitualData    ritualdata;
+    WCTFusionData    fusiondata;
+    WCTCardIDs       cardids;
+    WCTBoosterRefs   boosterrefs;
+    WCTOpponentDecks decks;
+    WCTIDDatabase    db;
+
+    // Read in all card information from the ROM file. If false is returned,
+    // GetError will describe which table could not be read.
+    bool ReadFromROM(FILE *f);
+
+    const char *GetError() const { return m_error; }
+
+private:
+    const char *m_error = "";
+};
+
+// EOF
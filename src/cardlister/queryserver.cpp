@@ -0,0 +1,729 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+// Socket headers have to come before anything that may pull in windows.h
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "elib/elib.h"
+#include "elib/misc.h"
+#include "elib/qstring.h"
+
+#include "json/json.h"
+
+#include "../common/jsonutils.h"
+#include "listerdata.h"
+#include "queryserver.h"
+
+//=============================================================================
+//
+// Platform socket layer
+//
+//=============================================================================
+
+#ifdef _WIN32
+using socket_t = SOCKET;
+static const socket_t BAD_SOCKET = INVALID_SOCKET;
+static constexpr int  SEND_FLAGS = 0;
+
+static void CloseSocket(socket_t s)    { closesocket(s);          }
+static void ShutdownSocket(socket_t s) { shutdown(s, SD_BOTH);    }
+
+// Whether a failed accept was down to that one client, so it's worth going
+// straight back for the next
+static bool AcceptFailureIsTransient()
+{
+    const int err = WSAGetLastError();
+    return err == WSAECONNRESET || err == WSAEINTR;
+}
+#else
+using socket_t = int;
+static const socket_t BAD_SOCKET = -1;
+static constexpr int  SEND_FLAGS = MSG_NOSIGNAL; // don't die from SIGPIPE if a client goes away
+
+static void CloseSocket(socket_t s)    { close(s);                }
+static void ShutdownSocket(socket_t s) { shutdown(s, SHUT_RDWR);  }
+
+// Whether a failed accept was down to that one client, so it's worth going
+// straight back for the next
+static bool AcceptFailureIsTransient()
+{
+    return errno == ECONNABORTED || errno == EINTR;
+}
+#endif
+
+//
+// Receive whatever is available, up to len bytes. Returns <= 0 on close or error.
+//
+static int RecvSome(socket_t s, char *buf, int len)
+{
+    return int(recv(s, buf, len, 0));
+}
+
+//
+// Send an entire buffer, looping over short writes
+//
+static bool SendAll(socket_t s, const char *buf, size_t len)
+{
+    while(len != 0)
+    {
+        const int sent = int(send(s, buf, int(len), SEND_FLAGS));
+        if(sent <= 0)
+            return false;
+        buf += sent;
+        len -= size_t(sent);
+    }
+    return true;
+}
+
+// Longest request line accepted; a client sending more than this without a
+// newline is dropped rather than buffered without bound
+static constexpr size_t MAX_REQUEST_LENGTH = 64 * 1024;
+
+// Most clients connected at once, each of which has its own thread
+static constexpr size_t MAX_CONNECTIONS = 256;
+
+// How long to wait before accepting again after a failure that isn't just
+// one client's doing
+static constexpr int ACCEPT_RETRY_MS = 100;
+
+//=============================================================================
+//
+// Connection set - every connected client has its own thread reading its
+// requests; they're tracked so they can all be kicked off at shutdown
+//
+//=============================================================================
+
+class WCTConnectionSet final
+{
+public:
+    // Start tracking a client; false if there are already too many
+    bool Add(socket_t s)
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        if(m_stopping == true || m_open.size() >= MAX_CONNECTIONS)
+            return false;
+        m_open.insert(s);
+        return true;
+    }
+
+    // Called by a client's thread as the last thing it does. Everything
+    // happens under the lock: the socket leaves the set before it is closed,
+    // so that accept can't reuse its number while it's still listed, and the
+    // set can't be destroyed by WaitAll returning before this thread is done
+    // with it.
+    void Close(socket_t s)
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        m_open.erase(s);
+        m_cv.notify_all();
+        CloseSocket(s);
+    }
+
+    // Kick every client still connected so that no thread remains blocked
+    // in recv or send
+    void Stop()
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        m_stopping = true;
+        for(socket_t s : m_open)
+            ShutdownSocket(s);
+    }
+
+    // Wait for every client's thread to finish
+    void WaitAll()
+    {
+        std::unique_lock<std::mutex> lock { m_mutex };
+        m_cv.wait(lock, [this] { return m_open.empty(); });
+    }
+
+private:
+    std::mutex                   m_mutex;
+    std::condition_variable      m_cv;
+    std::unordered_set<socket_t> m_open;
+    bool                         m_stopping = false;
+};
+
+//=============================================================================
+//
+// Request queue - client threads push the request lines they've read, and
+// the worker pool answers them
+//
+//=============================================================================
+
+//
+// The complete request lines from one read of a client
+//
+struct requestbatch_t
+{
+    std::vector<std::pair<const char *, const char *>> lines;
+    std::string response;
+    bool        done = false;
+};
+
+class WCTRequestQueue final
+{
+public:
+    // Hand a batch to the next free worker and wait for it to be answered.
+    // A client only ever has one batch waiting, so its answers come back in
+    // the order it asked.
+    void Submit(requestbatch_t &batch)
+    {
+        std::unique_lock<std::mutex> lock { m_mutex };
+        m_queue.push_back(&batch);
+        m_cv.notify_one();
+        m_donecv.wait(lock, [&batch] { return batch.done; });
+    }
+
+    // Wait for a batch; returns nullptr once the server is stopping
+    requestbatch_t *Pop()
+    {
+        std::unique_lock<std::mutex> lock { m_mutex };
+        m_cv.wait(lock, [this] { return m_stopping || m_queue.empty() == false; });
+        if(m_queue.empty() == true)
+            return nullptr;
+        requestbatch_t *const batch = m_queue.front();
+        m_queue.pop_front();
+        return batch;
+    }
+
+    // Called by a worker once it has answered a batch
+    void Finish(requestbatch_t &batch)
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        batch.done = true;
+        m_donecv.notify_all();
+    }
+
+    // Wake all workers so they exit. Only called once no client threads are
+    // left to submit anything.
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock { m_mutex };
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+    }
+
+private:
+    std::mutex                   m_mutex;
+    std::condition_variable      m_cv;     // batches waiting, or stopping
+    std::condition_variable      m_donecv; // a batch has been answered
+    std::deque<requestbatch_t *> m_queue;
+    bool                         m_stopping = false;
+};
+
+//=============================================================================
+//
+// Queries
+//
+//=============================================================================
+
+static std::atomic<bool> s_shutdown { false };
+
+//
+// Make an error response
+//
+static Json::Value ErrorResponse(const char *msg)
+{
+    Json::Value res;
+    res["error"] = msg;
+    return res;
+}
+
+//
+// Check that a request has a member and that it isn't null; jsoncpp would
+// otherwise read a missing or null number as 0
+//
+static bool HasValue(const Json::Value &req, const char *key)
+{
+    return req.isMember(key) == true && req[key].isNull() == false;
+}
+
+//
+// Short description of a card for use in lists
+//
+static Json::Value CardEntry(const WCTListerData &data, uint16_t id)
+{
+    Json::Value ent;
+    ent["id"] = id;
+
+    const size_t num = data.cardids.CardNumForID(id);
+    if(num != 0 && num != WCTCardIDs::npos)
+    {
+        ent["num"]  = Json::UInt(num);
+        ent["name"] = data.cardnames.GetName(WCTConstants::Languages::ENGLISH, num);
+    }
+    else
+    {
+        const qstring &dbname = data.db.GetNameForID(id);
+        if(dbname.empty() == false)
+            ent["user"] = dbname.c_str();
+    }
+    return ent;
+}
+
+//
+// Turn a list of card IDs into a JSON array
+//
+static Json::Value CardListToJson(const WCTListerData &data, const std::vector<uint16_t> &list)
+{
+    Json::Value arr { Json::arrayValue };
+    for(uint16_t id : list)
+        arr.append(CardEntry(data, id));
+    return arr;
+}
+
+//
+// "info": show all the info on a single card
+//
+static Json::Value QueryCardInfo(const WCTListerData &data, const Json::Value &req)
+{
+    using namespace WCTConstants;
+
+    if(HasValue(req, "num") == false)
+        return ErrorResponse("missing num");
+
+    const uint32_t numcards = data.cardnames.GetNumCards();
+    const uint32_t cardnum  = WCTJSONUtils::ValueToUint(req["num"]).value_or(0u);
+    if(cardnum < 1 || cardnum >= numcards)
+        return ErrorResponse("invalid card number");
+
+    Json::Value res;
+    res["num"]  = cardnum;
+    res["id"]   = data.cardids.IDForCardNum(cardnum);
+    res["name"] = data.cardnames.GetName(Languages::ENGLISH, cardnum);
+
+    const uint32_t cd = data.carddata.DataForCardNum(cardnum);
+    const CardType ct = GetCardType(cd);
+    if(ct == CardType::Spell || ct == CardType::Trap)
+    {
+        res["kind"]    = ct == CardType::Spell ? "Spell" : "Trap";
+        res["subtype"] = SafeSpellTrapTypeName(GetSpellTrapType(cd));
+    }
+    else
+    {
+        res["kind"]        = "Monster";
+        res["monstertype"] = SafeMonsterCardTypeName(GetMonsterType(cd));
+        res["level"]       = GetCardLevel(cd);
+        res["type"]        = SafeCardTypeName(ct);
+        res["attribute"]   = SafeAttributeName(GetCardAttribute(cd));
+        res["atk"]         = GetMonsterATK(cd);
+        res["def"]         = GetMonsterDEF(cd);
+    }
+    return res;
+}
+
+//
+// "id": look up a card by its ID, falling back to the user database
+//
+static Json::Value QueryCardID(const WCTListerData &data, const Json::Value &req)
+{
+    if(HasValue(req, "id") == false)
+        return ErrorResponse("missing id");
+
+    const uint16_t id = uint16_t(WCTJSONUtils::ValueToUint(req["id"]).value_or(0u));
+    Json::Value res { CardEntry(data, id) };
+    if(res.isMember("num") == false && res.isMember("user") == false)
+        return ErrorResponse("id not found");
+    return res;
+}
+
+//
+// "search": case-insensitive substring search of the English names and user db
+//
+static Json::Value QuerySearch(const WCTListerData &data, const Json::Value &req)
+{
+    using namespace WCTConstants;
+
+    const std::string term = req["term"].asString();
+    if(term.empty() == true)
+        return ErrorResponse("missing search term");
+
+    Json::Value results { Json::arrayValue };
+    const uint32_t numcards = data.cardnames.GetNumCards();
+    for(uint32_t i = 1; i < numcards; i++)
+    {
+        const char *const name = data.cardnames.GetName(Languages::ENGLISH, i);
+        if(M_StrCaseStr(name, term.c_str()) != nullptr)
+        {
+            Json::Value ent;
+            ent["num"]  = i;
+            ent["id"]   = data.cardids.IDForCardNum(i);
+            ent["name"] = name;
+            results.append(ent);
+        }
+    }
+
+    Json::Value userresults { Json::arrayValue };
+    for(const auto &pair : data.db.GetMap())
+    {
+        if(pair.second.containsNoCase(term.c_str()) == true)
+        {
+            Json::Value ent;
+            ent["id"]   = pair.first;
+            ent["name"] = pair.second.c_str();
+            userresults.append(ent);
+        }
+    }
+
+    Json::Value res;
+    res["results"] = results;
+    res["user"]    = userresults;
+    return res;
+}
+
+//
+// "deck": list an opponent deck
+//
+static Json::Value QueryDeck(const WCTListerData &data, const Json::Value &req)
+{
+    const WCTOpponentDecks::rawdecks_t &rawdecks = data.decks.GetRawData();
+    const WCTOpponentDecks::decks_t    &decks    = data.decks.GetDecks();
+
+    if(HasValue(req, "num") == false)
+        return ErrorResponse("missing num");
+
+    const uint32_t decknum = WCTJSONUtils::ValueToUint(req["num"]).value_or(UINT32_MAX);
+    if(decknum >= rawdecks.size())
+        return ErrorResponse("invalid deck number");
+
+    Json::Value res;
+    res["num"]   = decknum;
+    res["len"]   = rawdecks[decknum].len;
+    res["flags"] = rawdecks[decknum].flags;
+    res["cards"] = CardListToJson(data, decks[decknum].GetDeckList());
+    return res;
+}
+
+//
+// "booster": list a booster pack
+//
+static Json::Value QueryBooster(const WCTListerData &data, const Json::Value &req)
+{
+    const WCTBoosterRefs::boosterrefs_t &refs  = data.boosterrefs.GetRefs();
+    const WCTBoosterRefs::boosters_t    &packs = data.boosterrefs.GetBoosters();
+
+    if(HasValue(req, "num") == false)
+        return ErrorResponse("missing num");
+
+    const uint32_t packnum = WCTJSONUtils::ValueToUint(req["num"]).value_or(UINT32_MAX);
+    if(packnum >= refs.size())
+        return ErrorResponse("invalid booster pack number");
+
+    Json::Value res;
+    res["num"]     = packnum;
+    res["id"]      = refs[packnum].id;
+    res["rares"]   = CardListToJson(data, packs[packnum].GetRares());
+    res["commons"] = CardListToJson(data, packs[packnum].GetCommons());
+    return res;
+}
+
+//
+// "shutdown": stop accepting clients and exit
+//
+static Json::Value QueryShutdown(const WCTListerData &, const Json::Value &)
+{
+    s_shutdown = true;
+
+    Json::Value res;
+    res["ok"] = true;
+    return res;
+}
+
+using queryfn_t = Json::Value (*)(const WCTListerData &, const Json::Value &);
+
+static const struct queryhandler_t
+{
+    const char *cmd;
+    queryfn_t   fn;
+} queryHandlers[] =
+{
+    { "info",     QueryCardInfo },
+    { "id",       QueryCardID   },
+    { "search",   QuerySearch   },
+    { "deck",     QueryDeck     },
+    { "booster",  QueryBooster  },
+    { "shutdown", QueryShutdown },
+};
+
+//
+// Run one request through the appropriate handler
+//
+static Json::Value DispatchQuery(const WCTListerData &data, const Json::Value &req)
+{
+    if(req.isObject() == false)
+        return ErrorResponse("request must be an object");
+
+    const std::string cmd = req["cmd"].asString();
+    for(const queryhandler_t &qh : queryHandlers)
+    {
+        if(cmd == qh.cmd)
+            return qh.fn(data, req);
+    }
+    return ErrorResponse("unknown command");
+}
+
+//=============================================================================
+//
+// Server
+//
+//=============================================================================
+
+//
+// Per-worker state; nothing in here is shared between threads
+//
+class WCTQueryWorker final
+{
+public:
+    WCTQueryWorker(const WCTListerData &data, WCTRequestQueue &queue)
+        : m_data(data), m_queue(queue)
+    {
+        Json::CharReaderBuilder rbuilder;
+        m_upReader.reset(rbuilder.newCharReader());
+        m_wbuilder["indentation"] = ""; // one line per response
+    }
+
+    void Run()
+    {
+        requestbatch_t *batch;
+        while((batch = m_queue.Pop()) != nullptr)
+        {
+            for(const auto &[begin, end] : batch->lines)
+                HandleLine(begin, end, batch->response);
+            m_queue.Finish(*batch);
+        }
+    }
+
+private:
+    const WCTListerData               &m_data;
+    WCTRequestQueue                   &m_queue;
+    std::unique_ptr<Json::CharReader>  m_upReader;
+    Json::StreamWriterBuilder          m_wbuilder;
+
+    // Answer a single request line
+    void HandleLine(const char *begin, const char *end, std::string &response)
+    {
+        Json::Value res;
+        try
+        {
+            Json::Value   req;
+            JSONCPP_STRING errs;
+            if(m_upReader->parse(begin, end, &req, &errs) == true)
+                res = DispatchQuery(m_data, req);
+            else
+                res = ErrorResponse(errs.c_str());
+        }
+        catch(const std::exception &ex)
+        {
+            res = ErrorResponse(ex.what());
+        }
+
+        response += Json::writeString(m_wbuilder, res);
+        response += '\n';
+    }
+};
+
+//
+// Connect to our own socket so the accept loop notices a shutdown request
+//
+static void WakeListener(const sockaddr_un &addr)
+{
+    const socket_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(s != BAD_SOCKET)
+    {
+        connect(s, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr));
+        CloseSocket(s);
+    }
+}
+
+//
+// Read requests from a client until it disconnects, handing each read's
+// complete lines to the worker pool and sending back the answers
+//
+static void ServeClient(socket_t s, WCTRequestQueue &queue, const sockaddr_un &addr)
+{
+    std::string    pending;
+    requestbatch_t batch;
+
+    char buf[4096];
+    int  len;
+    while((len = RecvSome(s, buf, int(sizeof(buf)))) > 0)
+    {
+        pending.append(buf, size_t(len));
+        batch.lines.clear();
+        batch.response.clear();
+        batch.done = false;
+
+        size_t start = 0;
+        size_t eol;
+        while((eol = pending.find('\n', start)) != std::string::npos)
+        {
+            const char *begin = pending.data() + start;
+            const char *end   = pending.data() + eol;
+            if(end != begin && *(end - 1) == '\r')
+                --end;
+            if(end != begin)
+                batch.lines.emplace_back(begin, end);
+            start = eol + 1;
+        }
+
+        if(batch.lines.empty() == false)
+            queue.Submit(batch);
+        pending.erase(0, start);
+
+        if(pending.size() > MAX_REQUEST_LENGTH)
+        {
+            batch.response += "{\"error\":\"request too long\"}\n";
+            SendAll(s, batch.response.data(), batch.response.size());
+            break;
+        }
+
+        if(batch.response.empty() == false && SendAll(s, batch.response.data(), batch.response.size()) == false)
+            break;
+
+        if(s_shutdown == true)
+        {
+            WakeListener(addr);
+            break;
+        }
+    }
+}
+
+//
+// Listen on a Unix domain socket and answer queries until shut down
+//
+bool WCTQueryServer::Run(const WCTListerData &data, const char *sockpath, unsigned int numworkers)
+{
+#ifdef _WIN32
+    WSADATA wsadata;
+    if(WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
+    {
+        std::puts("Could not initialize Winsock\n");
+        return false;
+    }
+#endif
+
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if(std::strlen(sockpath) >= sizeof(addr.sun_path))
+    {
+        std::printf("Socket path '%s' is too long\n", sockpath);
+        return false;
+    }
+    std::strcpy(addr.sun_path, sockpath);
+
+    const socket_t listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener == BAD_SOCKET)
+    {
+        std::puts("Could not create socket\n");
+        return false;
+    }
+
+    // a stale socket file from an earlier run would make bind fail
+    std::remove(sockpath);
+
+    if(bind(listener, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0 ||
+       listen(listener, SOMAXCONN) != 0)
+    {
+        std::printf("Could not listen on '%s'\n", sockpath);
+        CloseSocket(listener);
+        return false;
+    }
+
+    if(numworkers == 0)
+        numworkers = 1;
+
+    WCTRequestQueue queue;
+    std::vector<std::thread> threads;
+    threads.reserve(numworkers);
+    for(unsigned int i = 0; i < numworkers; i++)
+    {
+        threads.emplace_back([&data, &queue] {
+            WCTQueryWorker worker { data, queue };
+            worker.Run();
+        });
+    }
+
+    std::printf("Listening on '%s' with %u workers\n", sockpath, numworkers);
+    std::fflush(stdout);
+
+    WCTConnectionSet clients;
+    while(s_shutdown == false)
+    {
+        const socket_t client = accept(listener, nullptr, nullptr);
+        if(client == BAD_SOCKET)
+        {
+            // anything other than a client giving up before we got to it,
+            // such as running out of file descriptors, won't clear at once;
+            // wait a little rather than spin on it
+            if(AcceptFailureIsTransient() == false)
+                std::this_thread::sleep_for(std::chrono::milliseconds(ACCEPT_RETRY_MS));
+            continue;
+        }
+        if(s_shutdown == true)
+        {
+            CloseSocket(client);
+            break;
+        }
+        if(clients.Add(client) == false)
+        {
+            CloseSocket(client); // too many connected already
+            continue;
+        }
+        std::thread([&clients, &queue, &addr, client] {
+            ServeClient(client, queue, addr);
+            clients.Close(client);
+        }).detach();
+    }
+
+    // clients first, as they may be waiting on the workers
+    clients.Stop();
+    clients.WaitAll();
+    queue.Stop();
+    for(std::thread &t : threads)
+        t.join();
+
+    CloseSocket(listener);
+    std::remove(sockpath);
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+
+    return true;
+}
+
+// EOF
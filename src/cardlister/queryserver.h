@@ -0,0 +1,46 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+class WCTListerData;
+
+//
+// Persistent query daemon. Requests and responses are single-line JSON objects
+// terminated by a newline; any number of them may be sent over one connection.
+//
+//   { "cmd": "info",    "num": 123 }         - full info on a card by number
+//   { "cmd": "id",      "id": "0x0FC9" }     - look up a card by ID
+//   { "cmd": "search",  "term": "dragon" }   - search card names (game and user db)
+//   { "cmd": "deck",    "num": 3 }           - list an opponent deck
+//   { "cmd": "booster", "num": 2 }           - list a booster pack's rares and commons
+//   { "cmd": "shutdown" }                    - stop the server
+//
+// Failed requests are answered with { "error": "message" }.
+//
+namespace WCTQueryServer
+{
+    // Listen on a Unix domain socket at the given path and answer queries until
+    // a shutdown request is received. Each connected client has a thread of its
+    // own reading its requests, so a client holding its connection open never
+    // keeps others waiting; the queries themselves are answered by a pool of
+    // numworkers threads. The data is shared between all workers and is never
+    // modified. Returns false if the socket could not be set up.
+    bool Run(const WCTListerData &data, const char *sockpath, unsigned int numworkers);
+}
+
+// EOF
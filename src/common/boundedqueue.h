@@ -0,0 +1,78 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+//
+// A fixed-capacity queue for handing work from one pipeline stage to the
+// next. Producers block while it is full, so a slow stage holds the ones
+// before it back instead of letting finished work pile up in memory.
+//
+template<typename T>
+class WCTBoundedQueue final
+{
+public:
+    explicit WCTBoundedQueue(size_t capacity) : m_capacity(capacity != 0 ? capacity : 1) {}
+
+    // Add an item, waiting for room if necessary
+    void Push(T item)
+    {
+        std::unique_lock<std::mutex> lock { m_mutex };
+        m_notFull.wait(lock, [this] { return m_items.size() < m_capacity; });
+        m_items.push_back(std::move(item));
+        m_notEmpty.notify_one();
+    }
+
+    // Take everything currently queued, up to maxitems, waiting until there
+    // is at least one item. Returns false once the queue is closed and empty.
+    bool PopBatch(std::vector<T> &out, size_t maxitems)
+    {
+        out.clear();
+        std::unique_lock<std::mutex> lock { m_mutex };
+        m_notEmpty.wait(lock, [this] { return m_items.empty() == false || m_closed; });
+        while(m_items.empty() == false && out.size() < maxitems)
+        {
+            out.push_back(std::move(m_items.front()));
+            m_items.pop_front();
+        }
+        m_notFull.notify_all();
+        return out.empty() == false;
+    }
+
+    // No more items will be pushed
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock { m_mutex };
+        m_closed = true;
+        m_notEmpty.notify_all();
+    }
+
+private:
+    std::mutex              m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    std::deque<T>           m_items;
+    size_t                  m_capacity;
+    bool                    m_closed = false;
+};
+
+// EOF
@@ -15,8 +15,6 @@
   along with this program.  If not, see http://www.gnu.org/licenses/
 */
 
-#include <algorithm>
-
 #include "elib/elib.h"
 #include "cardids.h"
 #include "numcards.h"
@@ -42,17 +40,18 @@ bool WCTCardIDs::ReadCardIDs(FILE *f)
     m_ids.resize(numcards);
 
     // read in the IDs
-    return WCTROMFile::GetVectorFromOffset(f, WCTConstants::OFFS_CARDIDS, m_ids);
-}
+    if(WCTROMFile::GetVectorFromOffset(f, WCTConstants::OFFS_CARDIDS, m_ids) == false)
+        return false;
 
-//
-// Find a given ID in the set of card IDs and return the card number to which it
-// corresponds if found. If not found, npos is returned.
-//
-size_t WCTCardIDs::CardNumForID(cardid_t id) const
-{
-    const auto citr = std::find(m_ids.cbegin(), m_ids.cend(), id);
-    return (citr != m_ids.cend()) ? size_t(citr - m_ids.cbegin()) : npos;
+    // Build the reverse index. Walk backward so that if an ID were ever to appear
+    // more than once, the lowest card number wins, as with a linear search.
+    if(numcards >= NO_CARDNUM)
+        return false; // wouldn't fit in the index
+    m_idToNum.assign(size_t(UINT16_MAX) + 1, NO_CARDNUM);
+    for(size_t i = m_ids.size(); i-- > 0; )
+        m_idToNum[m_ids[i]] = uint16_t(i);
+
+    return true;
 }
 
 // EOF
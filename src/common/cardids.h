@@ -41,10 +41,17 @@ public:
 
     // Find a given ID in the set of card IDs and return the card number to which it
     // corresponds if found. If not found, npos is returned.
-    size_t CardNumForID(cardid_t id) const;
+    size_t CardNumForID(cardid_t id) const
+    {
+        const uint16_t num = m_idToNum.empty() ? NO_CARDNUM : m_idToNum[id];
+        return (num != NO_CARDNUM) ? size_t(num) : npos;
+    }
 
 private:
-    cardids_t m_ids;
+    static constexpr uint16_t NO_CARDNUM = 0xFFFFu;
+
+    cardids_t             m_ids;
+    std::vector<uint16_t> m_idToNum; // reverse index covering all 64K possible IDs
 };
 
 // EOF
@@ -0,0 +1,52 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include "ctrrng.h"
+
+//
+// Fast 64-bit content hashing for telling whether data has changed. Not
+// cryptographic; collisions are only as unlikely as for any good 64-bit hash.
+// Words are read in native byte order, so hashes should not be compared
+// between machines of different endianness.
+//
+namespace WCTContentHash
+{
+    inline uint64_t Hash64(const void *data, size_t len, uint64_t seed = 0)
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        uint64_t h = WCTCounterRNG::Mix(seed + len * WCTCounterRNG::GOLDEN_GAMMA);
+
+        // whole words, then whatever is left zero-extended into one more
+        for(; len >= sizeof(uint64_t); len -= sizeof(uint64_t), p += sizeof(uint64_t))
+        {
+            uint64_t w;
+            std::memcpy(&w, p, sizeof(w));
+            h = WCTCounterRNG::Mix(h ^ w) + WCTCounterRNG::GOLDEN_GAMMA;
+        }
+        if(len != 0)
+        {
+            uint64_t w = 0;
+            std::memcpy(&w, p, len);
+            h = WCTCounterRNG::Mix(h ^ w) + WCTCounterRNG::GOLDEN_GAMMA;
+        }
+        return WCTCounterRNG::Mix(h);
+    }
+}
+
+// EOF
@@ -0,0 +1,114 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include "elib/elib.h"
+#include "cpufeatures.h"
+
+#if WCT_X86_SIMD
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if WCT_X86_SIMD
+
+// CPUID feature bits
+static constexpr uint32_t ECX1_SSSE3   = 1u << 9;
+static constexpr uint32_t ECX1_SSE41   = 1u << 19;
+static constexpr uint32_t ECX1_OSXSAVE = 1u << 27;
+static constexpr uint32_t ECX1_AVX     = 1u << 28;
+static constexpr uint32_t EBX7_AVX2    = 1u << 5;
+
+// XCR0 bits for SSE and AVX register state
+static constexpr uint64_t XCR0_YMM = 0x6;
+
+struct cpuinfo_t
+{
+    uint32_t ecx1 = 0; // CPUID leaf 1, ECX
+    uint32_t ebx7 = 0; // CPUID leaf 7, EBX
+    uint64_t xcr0 = 0;
+};
+
+//
+// Query the processor once
+//
+static cpuinfo_t QueryCPU()
+{
+    cpuinfo_t info;
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 0);
+    const int maxleaf = regs[0];
+    __cpuid(regs, 1);
+    info.ecx1 = uint32_t(regs[2]);
+    if(maxleaf >= 7)
+    {
+        __cpuidex(regs, 7, 0);
+        info.ebx7 = uint32_t(regs[1]);
+    }
+    if(info.ecx1 & ECX1_OSXSAVE)
+        info.xcr0 = _xgetbv(0);
+#else
+    unsigned int eax, ebx, ecx, edx;
+    const unsigned int maxleaf = __get_cpuid_max(0, nullptr);
+    if(__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        info.ecx1 = ecx;
+    if(maxleaf >= 7 && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        info.ebx7 = ebx;
+    if(info.ecx1 & ECX1_OSXSAVE)
+    {
+        uint32_t lo, hi;
+        __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        info.xcr0 = (uint64_t(hi) << 32) | lo;
+    }
+#endif
+    return info;
+}
+
+static const cpuinfo_t &CPUInfo()
+{
+    static const cpuinfo_t info = QueryCPU();
+    return info;
+}
+
+bool WCTCPUFeatures::HasSSSE3()
+{
+    return (CPUInfo().ecx1 & ECX1_SSSE3) != 0;
+}
+
+bool WCTCPUFeatures::HasSSE41()
+{
+    return (CPUInfo().ecx1 & ECX1_SSE41) != 0;
+}
+
+bool WCTCPUFeatures::HasAVX2()
+{
+    const cpuinfo_t &info = CPUInfo();
+    return (info.ecx1 & ECX1_AVX) != 0 && (info.xcr0 & XCR0_YMM) == XCR0_YMM && (info.ebx7 & EBX7_AVX2) != 0;
+}
+
+#else
+
+bool WCTCPUFeatures::HasSSSE3() { return false; }
+bool WCTCPUFeatures::HasSSE41() { return false; }
+bool WCTCPUFeatures::HasAVX2()  { return false; }
+
+#endif
+
+// EOF
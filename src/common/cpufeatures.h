@@ -0,0 +1,46 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+// Whether x86 SIMD code paths are compiled in at all
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define WCT_X86_SIMD 1
+#else
+#define WCT_X86_SIMD 0
+#endif
+
+// Functions using instructions beyond the compiler's baseline must be marked
+// for GCC and Clang; MSVC allows any intrinsic anywhere.
+#if WCT_X86_SIMD && (defined(__GNUC__) || defined(__clang__))
+#define WCT_TARGET(isa) __attribute__((target(isa)))
+#else
+#define WCT_TARGET(isa)
+#endif
+
+//
+// Runtime detection of optional instruction set extensions, so that code can
+// pick the fastest implementation the machine running it supports.
+//
+namespace WCTCPUFeatures
+{
+    bool HasSSSE3();
+    bool HasSSE41();
+    bool HasAVX2(); // includes checking that the OS saves YMM registers
+}
+
+// EOF
@@ -0,0 +1,69 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+//
+// Counter-based random number generation. Every value is a pure function of
+// a key and a counter (the SplitMix64 output function applied to a Weyl
+// sequence), so any number of threads can draw from the same stream at
+// arbitrary positions without sharing state, and a simulation's results
+// depend only on its seed, not on how the work was divided up.
+//
+namespace WCTCounterRNG
+{
+    static constexpr uint64_t GOLDEN_GAMMA = 0x9E3779B97F4A7C15ull;
+
+    // SplitMix64 finalizer
+    inline uint64_t Mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Derive an independent stream key from a seed and a stream number
+    inline uint64_t StreamKey(uint64_t seed, uint64_t stream)
+    {
+        return Mix(seed ^ Mix(stream + GOLDEN_GAMMA));
+    }
+
+    // Random 64-bit value at a given position in a stream
+    inline uint64_t At(uint64_t key, uint64_t counter)
+    {
+        return Mix(key + counter * GOLDEN_GAMMA);
+    }
+
+    // Map 32 random bits onto [0, n) without division
+    inline uint32_t Range(uint32_t bits, uint32_t n)
+    {
+        return uint32_t((uint64_t(bits) * n) >> 32);
+    }
+
+    // Threshold such that (32 random bits) < threshold with the given probability.
+    // This needs 33 bits so that a chance of 1 can be represented exactly.
+    inline uint64_t Threshold(double chance)
+    {
+        if(chance <= 0.0)
+            return 0;
+        if(chance >= 1.0)
+            return uint64_t(1) << 32;
+        return uint64_t(chance * 4294967296.0);
+    }
+}
+
+// EOF
@@ -0,0 +1,208 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#include "elib/elib.h"
+#include "outbuffer.h"
+
+// "00" through "99", for producing two decimal digits at a time
+static const char digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+WCTOutBuffer::WCTOutBuffer(FILE *f, size_t size)
+    : m_file(f), m_upBuf(new char [size]), m_size(size)
+{
+    m_pos = m_upBuf.get();
+    m_end = m_pos + size;
+}
+
+//
+// Write out the buffer contents and reset to the start of it
+//
+void WCTOutBuffer::Drain()
+{
+    const size_t len = size_t(m_pos - m_upBuf.get());
+    if(len != 0 && std::fwrite(m_upBuf.get(), 1, len, m_file) != len)
+        m_error = true;
+    m_pos = m_upBuf.get();
+}
+
+//
+// Write out everything buffered so far
+//
+bool WCTOutBuffer::Flush()
+{
+    Drain();
+    if(std::fflush(m_file) != 0)
+        m_error = true;
+    return !m_error;
+}
+
+//
+// Append a run of characters
+//
+void WCTOutBuffer::Put(const char *str, size_t len)
+{
+    if(size_t(m_end - m_pos) < len)
+    {
+        Drain();
+        if(len > m_size)
+        {
+            // too big to be worth buffering at all
+            if(std::fwrite(str, 1, len, m_file) != len)
+                m_error = true;
+            return;
+        }
+    }
+    std::memcpy(m_pos, str, len);
+    m_pos += len;
+}
+
+//
+// Append digits with zero padding out to the given width
+//
+void WCTOutBuffer::PutDigits(const char *digits, size_t len, unsigned int width)
+{
+    if(width > len)
+    {
+        const size_t pad = width - len;
+        Reserve(pad);
+        std::memset(m_pos, '0', pad);
+        m_pos += pad;
+    }
+    Put(digits, len);
+}
+
+//
+// Append an unsigned integer in decimal
+//
+void WCTOutBuffer::PutUint(uint32_t value, unsigned int width)
+{
+    char  tmp[10]; // enough for 4294967295
+    char *p = tmp + sizeof(tmp);
+
+    while(value >= 100)
+    {
+        const uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        *--p = digitPairs[pair + 1];
+        *--p = digitPairs[pair];
+    }
+    if(value >= 10)
+    {
+        *--p = digitPairs[value * 2 + 1];
+        *--p = digitPairs[value * 2];
+    }
+    else
+    {
+        *--p = char('0' + value);
+    }
+
+    PutDigits(p, size_t(tmp + sizeof(tmp) - p), width);
+}
+
+//
+// Append an unsigned integer in uppercase hexadecimal
+//
+void WCTOutBuffer::PutHex(uint32_t value, unsigned int width)
+{
+    char  tmp[8]; // enough for FFFFFFFF
+    char *p = tmp + sizeof(tmp);
+
+    do
+    {
+        *--p = hexDigits[value & 15];
+        value >>= 4;
+    }
+    while(value != 0);
+
+    PutDigits(p, size_t(tmp + sizeof(tmp) - p), width);
+}
+
+//
+// Append a string as a quoted JSON string literal
+//
+void WCTOutBuffer::PutJSONString(const char *str)
+{
+    Put('"');
+
+    const unsigned char *s   = reinterpret_cast<const unsigned char *>(str);
+    const unsigned char *run = s;
+    for(; *s != '\0'; ++s)
+    {
+        const unsigned char c = *s;
+        if(c >= 0x20 && c < 0x80 && c != '"' && c != '\\')
+            continue; // part of a run that needs no escaping
+
+        Put(reinterpret_cast<const char *>(run), size_t(s - run));
+        run = s + 1;
+
+        Reserve(6);
+        *m_pos++ = '\\';
+        switch(c)
+        {
+        case '"':  *m_pos++ = '"';  break;
+        case '\\': *m_pos++ = '\\'; break;
+        case '\n': *m_pos++ = 'n';  break;
+        case '\r': *m_pos++ = 'r';  break;
+        case '\t': *m_pos++ = 't';  break;
+        default:
+            *m_pos++ = 'u';
+            *m_pos++ = '0';
+            *m_pos++ = '0';
+            *m_pos++ = hexDigits[c >> 4];
+            *m_pos++ = hexDigits[c & 15];
+            break;
+        }
+    }
+    Put(reinterpret_cast<const char *>(run), size_t(s - run));
+
+    Put('"');
+}
+
+//
+// Append a string as a CSV field, quoting it only if necessary
+//
+void WCTOutBuffer::PutCSVString(const char *str)
+{
+    if(str[std::strcspn(str, ",\"\r\n")] == '\0')
+    {
+        Puts(str);
+        return;
+    }
+
+    Put('"');
+    for(const char *s = str; *s != '\0'; ++s)
+    {
+        if(*s == '"')
+            Put('"'); // quotes are doubled
+        Put(*s);
+    }
+    Put('"');
+}
+
+// EOF
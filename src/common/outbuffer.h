@@ -0,0 +1,95 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <memory>
+
+//
+// Formats text directly into a large buffer which is written out to a file
+// only when it fills up or is explicitly flushed, so that producing a lot of
+// small pieces of output doesn't cost a trip through stdio for each one.
+//
+class WCTOutBuffer final
+{
+public:
+    static constexpr size_t DEFAULT_SIZE = 256 * 1024;
+
+    explicit WCTOutBuffer(FILE *f, size_t size = DEFAULT_SIZE);
+    ~WCTOutBuffer() { Flush(); }
+
+    WCTOutBuffer(const WCTOutBuffer &) = delete;
+    WCTOutBuffer &operator = (const WCTOutBuffer &) = delete;
+
+    // Append a single character
+    void Put(char c)
+    {
+        if(m_pos == m_end)
+            Drain();
+        *m_pos++ = c;
+    }
+
+    // Append a run of characters
+    void Put(const char *str, size_t len);
+
+    // Append a null-terminated string
+    void Puts(const char *str) { Put(str, std::strlen(str)); }
+
+    // Append an unsigned integer in decimal, zero-padded to at least the given
+    // number of digits (as with printf's %0*u)
+    void PutUint(uint32_t value, unsigned int width = 0);
+
+    // Append an unsigned integer in uppercase hexadecimal, zero-padded to at
+    // least the given number of digits (as with printf's %0*X)
+    void PutHex(uint32_t value, unsigned int width = 0);
+
+    // Append a string as a quoted JSON string literal. Bytes outside of ASCII
+    // are escaped as \u00XX; the game's strings are not UTF-8, so this keeps
+    // the output valid while preserving the original byte values.
+    void PutJSONString(const char *str);
+
+    // Append a string as a CSV field, quoting it only if necessary
+    void PutCSVString(const char *str);
+
+    // Write out everything buffered so far. Returns false if any write has failed.
+    bool Flush();
+
+    bool HasError() const { return m_error; }
+
+private:
+    FILE                    *m_file;
+    std::unique_ptr<char []> m_upBuf;
+    char                    *m_pos;
+    char                    *m_end;
+    size_t                   m_size;
+    bool                     m_error = false;
+
+    // Make room by writing out the buffer
+    void Drain();
+
+    // Append digits formatted at the end of a scratch buffer, left-padding with zeroes
+    void PutDigits(const char *digits, size_t len, unsigned int width);
+
+    // Ensure at least len bytes are free
+    void Reserve(size_t len)
+    {
+        if(size_t(m_end - m_pos) < len)
+            Drain();
+    }
+};
+
+// EOF
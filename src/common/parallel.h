@@ -0,0 +1,77 @@
+/*
+  Copyright (C) 2023 James Haley
+  
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see http://www.gnu.org/licenses/
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+//
+// Simple fork/join helpers for splitting a batch of independent work items
+// over a fixed number of threads.
+//
+namespace WCTParallel
+{
+    // Number of threads to use when the user hasn't asked for a specific count
+    inline unsigned int DefaultThreads()
+    {
+        const unsigned int n = std::thread::hardware_concurrency();
+        return n != 0 ? n : 1;
+    }
+
+    // Number of threads that will actually be used for count items
+    inline unsigned int ThreadsFor(size_t count, unsigned int numthreads)
+    {
+        if(numthreads == 0)
+            numthreads = DefaultThreads();
+        if(count < numthreads)
+            numthreads = count != 0 ? unsigned(count) : 1;
+        return numthreads;
+    }
+
+    //
+    // Split the items [0, count) into one contiguous range per thread and call
+    // fn(threadnum, begin, end) for each range, returning when all are done.
+    // Thread numbers run from 0 to ThreadsFor(count, numthreads) - 1, so callers
+    // can give each thread its own slot for results. With one thread, fn runs
+    // directly on the calling thread.
+    //
+    template<typename F>
+    void ForRanges(size_t count, unsigned int numthreads, F fn)
+    {
+        numthreads = ThreadsFor(count, numthreads);
+        if(numthreads == 1)
+        {
+            fn(0u, size_t(0), count);
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        threads.reserve(numthreads);
+        for(unsigned int i = 0; i < numthreads; i++)
+        {
+            const size_t begin = count / numthreads * i + std::min<size_t>(i, count % numthreads);
+            const size_t end   = begin + count / numthreads + (i < count % numthreads ? 1 : 0);
+            threads.emplace_back(fn, i, begin, end);
+        }
+        for(std::thread &t : threads)
+            t.join();
+    }
+}
+
+// EOF